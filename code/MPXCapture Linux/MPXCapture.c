@@ -2,29 +2,58 @@
  * MPXCapture.c    High-Performance MPX Analyzer Tool
  * 
  * Features:
- * - DSP chain (19 kHz PLL locked)
+ * - DSP chain (19 kHz PLL locked), block-based (2048 frames per pass)
  * - Precision Pilot Measurement (IQ demod + RMS)
+ * - Table-driven NCOs (32-bit phase accumulator), 57 kHz ref by pilot phasor cubing
+ * - Multirate baseband (CIC decimation to ~24 kHz for IQ LPF, RMS, gating and loop filters)
  * - Precision RDS Measurement (IQ demod + RMS) with Dual-Mode reference
+ * - RDS group decoder on the same baseband (PI, PS, PTY, RadioText, TP/TA, block error rate)
+ * - Stereo metrics from the pilot phasor (L/R/M/S levels, separation, correlation, 38 kHz residual, pilot ppm)
  * - Pilot-present gating
- * - Real-time FFT Spectrum
- * - Dynamic Config Reload
- * - MPX TruePeak (Catmull-Rom 4x/8x)
+ * - Real-time FFT Spectrum (planned real-input FFT, radix-4, overlapped Welch STFT)
+ * - Display-bin reduction (peak/RMS per bucket, linear/log/MPX scale)
+ * - Noise floor (quickselect median of the quiet MPX gaps + minimum statistics), pilot and RDS SNR
+ * - Zoom spectra around chosen carriers (NCO down-conversion, CIC + Kaiser FIR decimation, complex FFT), e.g. pilot and RDS
+ * - Live reconfiguration (inotify config watch, --control=PATH socket), incl. FFT size and window,
+ *   via immutable config snapshots swapped at block boundaries
+ * - MPX TruePeak (polyphase FIR oversampling 4x/8x/16x)
  * - DC Blocker (High-pass) 
- * - ITU-R BS.412 MPX Power Measurement (60s Integration)
+ * - ITU-R BS.412 MPX Power Measurement (exact 60 s sliding window, 10 / 60 min maxima)
+ * - True-peak deviation histograms (0.1 kHz buckets, rolling 1 min / 1 h / 24 h): percentiles, time over limit, overdeviation events
+ * - JSON-lines, binary framed or shared-memory ring output (--output=json|f32|u16|u8|shm)
+ * - Reader / meter / spectrum threads with lock-free SPSC rings (--threads=0 to disable)
+ * - Pluggable input: stdin (arecord pipe), raw/WAV file, direct ALSA mmap capture (--input=)
+ * - FLOAT_LE / S16_LE / S24_3LE / S32_LE input (--format=), converted in one pass with the gains folded in
+ * - Multi-source: several inputs and/or both channels in one process on a worker pool, tagged by source id
+ * - Benchmark / accuracy harness on a synthetic MPX signal (--bench)
+ * - Per-stage timing, read/write wait, drop and late-frame counters as periodic stats records (--stats=MS)
+ * - Max/min hold traces and a u8 dB waterfall ring per source, sent row by row and in full on request
+ * - Long-term metrics archive: per-second and per-minute min/max/mean in an mmap'd ring file (--archive=)
  *
- * Compile Linux (static):              gcc MPXCapture.c -O3 -ffast-math -lm -static -o MPXCapture
- * Compile Linux (max compatibility):   gcc MPXCapture.c -O3 -ffast-math -fno-tree-vectorize -lm -static -o MPXCapture
+ * Compile Linux (static):              gcc MPXCapture.c -O3 -ffast-math -pthread -lm -static -o MPXCapture
+ * Compile Linux (max compatibility):   gcc MPXCapture.c -O3 -ffast-math -fno-tree-vectorize -pthread -lm -static -o MPXCapture
+ * Compile without threads:             add -DMPX_NO_THREADS (and drop -pthread)
+ * Compile with ALSA capture:           add -DMPX_WITH_ALSA ... -lasound (dynamic, or static with libasound.a)
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
 
+#include <stdatomic.h>
+
+#ifndef MPX_NO_THREADS
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -41,6 +70,8 @@
 /* ============================================================
    GLOBALS FOR DYNAMIC CONFIG
    ============================================================ */
+// Written by the config side only (startup, then the config thread; see
+// CONFIG SNAPSHOT). The processing stages read the published snapshot.
 float G_MeterInputCalibrationDB = 0.0f;
 float G_SpectrumInputCalibrationDB = 0.0f;
 float G_MeterGain = 1.0f;
@@ -58,15 +89,53 @@ float G_MeterRDSScale   = 1.0f;
 float G_SpectrumAttack = 0.25f;
 float G_SpectrumDecay  = 0.15f;
 int   G_SpectrumSendInterval = 30;
+int   G_SpectrumOverlap = 50;   // percent: 0, 50 or 75
+int   G_SpectrumBins = 0;       // display bins, 0 = all fftSize/2
+int   G_SpectrumBinScale = 0;   // BINSCALE_*
+int   G_SpectrumBinMode = 0;    // BINMODE_*
+int   G_FftSize = 4096;         // command line, then "fftSize" (see CONFIG SNAPSHOT)
+int   G_SpectrumWindow = 0;     // WINDOW_*
+int   G_HistoryRows = 0;        // waterfall rows kept, 0 = history off (see SPECTRUM HISTORY)
+int   G_HistoryBins = 256;      // bins per waterfall row / hold trace
+int   G_HistoryInterval = 200;  // ms per waterfall row
+float G_HoldTime = 0.0f;        // max/min hold reset period in s, 0 = only on request
+
+// Display-bin layouts (see DISPLAY BINS)
+enum { BINSCALE_LINEAR = 0, BINSCALE_LOG, BINSCALE_MPX };
+enum { BINMODE_PEAK = 0, BINMODE_RMS };
+enum { WINDOW_HANN = 0, WINDOW_BLACKMANHARRIS, WINDOW_FLATTOP };
+static const char *G_WindowNames[] = { "hann", "blackmanharris", "flattop" };
+
+// FFT sizes accepted on the command line, from the config file and the
+// control socket
+#define CONFIG_MIN_FFT 512
+#define CONFIG_MAX_FFT 65536
+#define HISTORY_MAX_ROWS 3600
+#define HISTORY_MAX_BINS 1024
+#define ZOOM_MAX_WINDOWS 4
+#define ZOOM_MIN_FFT 256
 
 // Options
-int   G_TruePeakFactor = 8;     // 4 or 8
+int   G_TruePeakFactor = 8;     // 4, 8 or 16
 int   G_EnableMpxLpf   = 1;     // "MPX_LPF_100kHz" 0/1
+int   G_RdsDecoder     = 1;     // "RdsDecoder" 0/1 (see RDS DECODER)
+int   G_StereoMetrics  = 1;     // "StereoMetrics" 0/1 (see STEREO METER)
+int   G_DeviationHistogram = 1; // "DeviationHistogram" 0/1 (see DEVIATION HISTOGRAM)
+float G_DeviationLimit = 75.0f; // "DeviationLimit" kHz, overdeviation threshold
+int   G_ZoomCount = 0;          // "ZoomSpectrum" windows, 0 = off (see ZOOM SPECTRUM)
+float G_ZoomCentre[ZOOM_MAX_WINDOWS];   // Hz
+float G_ZoomSpan[ZOOM_MAX_WINDOWS];     // Hz, shown around the centre
+int   G_ZoomFftSize = 2048;     // "ZoomFftSize" complex points per zoom FFT
 
 #define BASE_PREAMP 3.0f
 
+// Frames per stdin read; the DSP chain works on whole blocks of this size
+#define BLOCK_FRAMES 2048
+
 char   G_ConfigPath[1024] = {0};
 time_t G_LastConfigModTime = 0;
+off_t  G_LastConfigSize = 0;
+atomic_uint G_ConfigGeneration;     // published snapshots (stats records)
 
 /* ============================================================
    JSON PARSER (simple key: float/int)
@@ -107,23 +176,63 @@ static int get_json_int(const char* json, const char* key, int currentVal) {
     return (int)lroundf(f);
 }
 
-static void update_config(void) {
-    if (strlen(G_ConfigPath) == 0) return;
-
-    struct stat attr;
-    if (stat(G_ConfigPath, &attr) != 0) return;
+// Copies a string value into out (truncated to outSize). Returns 1 if found.
+static int get_json_string(const char* json, const char* key, char *out, size_t outSize) {
+    if (!json || !key || !out || outSize == 0) return 0;
+    char searchKey[128];
+    snprintf(searchKey, sizeof(searchKey), "\"%s\"", key);
+    char* pos = strstr((char*)json, searchKey);
+    if (!pos) return 0;
+    pos += strlen(searchKey);
+    while (*pos && (isspace((unsigned char)*pos) || *pos == ':')) pos++;
+    if (*pos != '"') return 0;
+    pos++;
+    size_t n = 0;
+    while (pos[n] && pos[n] != '"' && n + 1 < outSize) { out[n] = pos[n]; n++; }
+    out[n] = 0;
+    return 1;
+}
 
-    if (G_LastConfigModTime != 0 && attr.st_mtime == G_LastConfigModTime) return;
-    G_LastConfigModTime = attr.st_mtime;
+// "ZoomSpectrum": "centre:span,..." in Hz, e.g. "19000:1000,57000:6000";
+// "" or "off" switches the zoom spectra off. Malformed entries are skipped.
+static void config_parse_zoom(const char *spec) {
+    int count = 0;
+    const char *p = spec;
+    while (*p && count < ZOOM_MAX_WINDOWS) {
+        char *end;
+        float centre = strtof(p, &end);
+        if (end != p && *end == ':') {
+            const char *q = end + 1;
+            float span = strtof(q, &end);
+            if (end != q && centre > 0.0f && span >= 100.0f && span < 2.0f * centre) {
+                G_ZoomCentre[count] = centre;
+                G_ZoomSpan[count] = span;
+                count++;
+            }
+        }
+        p = strchr(p, ',');
+        if (!p) break;
+        p++;
+    }
+    G_ZoomCount = count;
+}
 
-    char *string = NULL;
-    for (int attempts = 0; attempts < 5; attempts++) {
-        string = read_file_content(G_ConfigPath);
-        if (string && strlen(string) > 10 && strchr(string, '{')) break;
-        if (string) { free(string); string = NULL; }
-        sleep_ms(50);
+// Inverse of config_parse_zoom, for the logs and the control socket
+static void config_format_zoom(int count, const float *centre, const float *span, char *out, size_t size) {
+    size_t n = 0;
+    out[0] = 0;
+    for (int w = 0; w < count && n < size; w++) {
+        int k = snprintf(out + n, size - n, "%s%g:%g", w ? "," : "", centre[w], span[w]);
+        if (k < 0) break;
+        n += (size_t)k;
     }
-    if (!string) return;
+}
+
+// Applies the keys present in a JSON object to the settings globals
+// (config file, or one line on the control socket). Out-of-range values
+// leave their setting alone; returns the first such key, NULL if none.
+static const char* config_apply_json(const char *string) {
+    const char *rejected = NULL;
 
     float mGain = get_json_float(string, "MeterInputCalibration", -9999.0f);
     if (mGain > -9000.0f) {
@@ -149,24 +258,131 @@ static void update_config(void) {
 
     float interval = get_json_float(string, "SpectrumSendInterval", -9999.0f);
     if (interval > 0.0f) G_SpectrumSendInterval = (int)interval;
+    else if (interval > -9000.0f && !rejected) rejected = "SpectrumSendInterval";
 
     // New optional keys
     int tpf = get_json_int(string, "TruePeakFactor", G_TruePeakFactor);
-    if (tpf == 8 || tpf == 4) G_TruePeakFactor = tpf;
+    if (tpf == 4 || tpf == 8 || tpf == 16) G_TruePeakFactor = tpf;
+    else if (!rejected) rejected = "TruePeakFactor";
 
     G_EnableMpxLpf = get_json_int(string, "MPX_LPF_100kHz", G_EnableMpxLpf) ? 1 : 0;
+    G_RdsDecoder = get_json_int(string, "RdsDecoder", G_RdsDecoder) ? 1 : 0;
+    G_StereoMetrics = get_json_int(string, "StereoMetrics", G_StereoMetrics) ? 1 : 0;
+    G_DeviationHistogram = get_json_int(string, "DeviationHistogram", G_DeviationHistogram) ? 1 : 0;
+
+    float devLimit = get_json_float(string, "DeviationLimit", -9999.0f);
+    if (devLimit > 0.0f && devLimit < 150.0f) G_DeviationLimit = devLimit;
+    else if (devLimit > -9000.0f && !rejected) rejected = "DeviationLimit";
+
+    int ovl = get_json_int(string, "SpectrumOverlap", G_SpectrumOverlap);
+    if (ovl == 0 || ovl == 50 || ovl == 75) G_SpectrumOverlap = ovl;
+    else if (!rejected) rejected = "SpectrumOverlap";
+
+    int nBins = get_json_int(string, "SpectrumBins", G_SpectrumBins);
+    if (nBins >= 0) G_SpectrumBins = nBins;
+    else if (!rejected) rejected = "SpectrumBins";
+
+    int hRows = get_json_int(string, "SpectrumHistoryRows", G_HistoryRows);
+    if (hRows >= 0 && hRows <= HISTORY_MAX_ROWS) G_HistoryRows = hRows;
+    else if (!rejected) rejected = "SpectrumHistoryRows";
+
+    int hBins = get_json_int(string, "SpectrumHistoryBins", G_HistoryBins);
+    if (hBins >= 16 && hBins <= HISTORY_MAX_BINS) G_HistoryBins = hBins;
+    else if (!rejected) rejected = "SpectrumHistoryBins";
+
+    int hInterval = get_json_int(string, "SpectrumHistoryInterval", G_HistoryInterval);
+    if (hInterval >= 10) G_HistoryInterval = hInterval;
+    else if (!rejected) rejected = "SpectrumHistoryInterval";
+
+    float hold = get_json_float(string, "SpectrumHoldTime", -9999.0f);
+    if (hold >= 0.0f) G_HoldTime = hold;
+    else if (hold > -9000.0f && !rejected) rejected = "SpectrumHoldTime";
+
+    int fft = get_json_int(string, "fftSize", G_FftSize);
+    if (fft >= CONFIG_MIN_FFT && fft <= CONFIG_MAX_FFT && (fft & (fft - 1)) == 0) G_FftSize = fft;
+    else if (!rejected) rejected = "fftSize";
+
+    int zoomFft = get_json_int(string, "ZoomFftSize", G_ZoomFftSize);
+    if (zoomFft >= ZOOM_MIN_FFT && zoomFft <= CONFIG_MAX_FFT && (zoomFft & (zoomFft - 1)) == 0) G_ZoomFftSize = zoomFft;
+    else if (!rejected) rejected = "ZoomFftSize";
+
+    char zoom[128];
+    if (get_json_string(string, "ZoomSpectrum", zoom, sizeof(zoom))) config_parse_zoom(zoom);
+
+    char word[16];
+    if (get_json_string(string, "SpectrumBinScale", word, sizeof(word))) {
+        if (strcmp(word, "linear") == 0) G_SpectrumBinScale = BINSCALE_LINEAR;
+        else if (strcmp(word, "log") == 0) G_SpectrumBinScale = BINSCALE_LOG;
+        else if (strcmp(word, "mpx") == 0) G_SpectrumBinScale = BINSCALE_MPX;
+        else if (!rejected) rejected = "SpectrumBinScale";
+    }
+    if (get_json_string(string, "SpectrumBinMode", word, sizeof(word))) {
+        if (strcmp(word, "peak") == 0) G_SpectrumBinMode = BINMODE_PEAK;
+        else if (strcmp(word, "rms") == 0) G_SpectrumBinMode = BINMODE_RMS;
+        else if (!rejected) rejected = "SpectrumBinMode";
+    }
+    if (get_json_string(string, "SpectrumWindow", word, sizeof(word))) {
+        int w = 0;
+        while (w <= WINDOW_FLATTOP && strcmp(word, G_WindowNames[w]) != 0) w++;
+        if (w <= WINDOW_FLATTOP) G_SpectrumWindow = w;
+        else if (!rejected) rejected = "SpectrumWindow";
+    }
 
     // Clamp spectrum smoothing
     if (G_SpectrumAttack > 1.0f) G_SpectrumAttack = 1.0f; if (G_SpectrumAttack < 0.01f) G_SpectrumAttack = 0.01f;
     if (G_SpectrumDecay  > 1.0f) G_SpectrumDecay  = 1.0f; if (G_SpectrumDecay  < 0.01f) G_SpectrumDecay  = 0.01f;
+    return rejected;
+}
 
-    fprintf(stderr, "[MPX-C] Config Update (%s):\n", G_ConfigPath);
+static void config_log(const char *origin) {
+    fprintf(stderr, "[MPX-C] Config Update (%s):\n", origin);
     fprintf(stderr, "   MeterGain: %.2f dB (x%.6f)\n", G_MeterInputCalibrationDB, G_MeterGain);
     fprintf(stderr, "   Scales:    Pilot=%.6f, MPX=%.6f, RDS=%.6f\n", G_MeterPilotScale, G_MeterMPXScale, G_MeterRDSScale);
-    fprintf(stderr, "   Spectrum:  Attack=%.3f Decay=%.3f Interval=%dms\n", G_SpectrumAttack, G_SpectrumDecay, G_SpectrumSendInterval);
+    fprintf(stderr, "   Spectrum:  Attack=%.3f Decay=%.3f Interval=%dms Overlap=%d%%\n", G_SpectrumAttack, G_SpectrumDecay, G_SpectrumSendInterval, G_SpectrumOverlap);
+    fprintf(stderr, "   FFT:       %d points, %s window\n", G_FftSize, G_WindowNames[G_SpectrumWindow]);
+    fprintf(stderr, "   Bins:      %d (0 = all), scale=%s, mode=%s\n", G_SpectrumBins,
+            G_SpectrumBinScale == BINSCALE_LOG ? "log" : G_SpectrumBinScale == BINSCALE_MPX ? "mpx" : "linear",
+            G_SpectrumBinMode == BINMODE_RMS ? "rms" : "peak");
     fprintf(stderr, "   MPX Peak:  TruePeakFactor=%d, MPX_LPF_100kHz=%d\n", G_TruePeakFactor, G_EnableMpxLpf);
+    fprintf(stderr, "   RDS:       decoder %s\n", G_RdsDecoder ? "on" : "off");
+    fprintf(stderr, "   Stereo:    metrics %s\n", G_StereoMetrics ? "on" : "off");
+    fprintf(stderr, "   Deviation: histogram %s, limit %.1f kHz\n", G_DeviationHistogram ? "on" : "off", G_DeviationLimit);
+    fprintf(stderr, "   History:   %d rows x %d bins, %d ms/row, hold reset %.1f s (0 = on request)\n",
+            G_HistoryRows, G_HistoryBins, G_HistoryInterval, G_HoldTime);
+    char zoom[128];
+    config_format_zoom(G_ZoomCount, G_ZoomCentre, G_ZoomSpan, zoom, sizeof(zoom));
+    fprintf(stderr, "   Zoom:      %s, %d-point FFT\n", G_ZoomCount ? zoom : "off", G_ZoomFftSize);
+}
+
+// Re-reads the config file if it changed (force: even with the same
+// mtime/size, e.g. on an inotify event). Returns 1 if it was applied.
+// May sleep while the file is being rewritten, so never call it from
+// the processing path when a config thread exists.
+static int update_config(int force) {
+    if (strlen(G_ConfigPath) == 0) return 0;
+
+    struct stat attr;
+    if (stat(G_ConfigPath, &attr) != 0) return 0;
+
+    if (!force && G_LastConfigModTime != 0 && attr.st_mtime == G_LastConfigModTime && attr.st_size == G_LastConfigSize) return 0;
+    G_LastConfigModTime = attr.st_mtime;
+    G_LastConfigSize = attr.st_size;
+
+    char *string = NULL;
+    for (int attempts = 0; attempts < 5; attempts++) {
+        string = read_file_content(G_ConfigPath);
+        if (string && strlen(string) > 10 && strchr(string, '{')) break;
+        if (string) { free(string); string = NULL; }
+        sleep_ms(50);
+    }
+    if (!string) return 0;
+
+    const char *rejected = config_apply_json(string);
+    config_log(G_ConfigPath);
+    if (rejected) fprintf(stderr, "[MPX-C] Invalid %s ignored\n", rejected);
 
     free(string);
+    return 1;
 }
 
 /* ============================================================
@@ -212,12 +428,24 @@ static void BiQuad_LowPass(BiQuadFilter *f, float sampleRate, float frequency, f
     f->a1 = a1 / a0; f->a2 = a2 / a0;
 }
 
-static float BiQuad_Process(BiQuadFilter *f, float x) {
-    float y = f->b0 * x + f->b1 * f->x1 + f->b2 * f->x2
-            - f->a1 * f->y1 - f->a2 * f->y2;
-    f->x2 = f->x1; f->x1 = x;
-    f->y2 = f->y1; f->y1 = y;
-    return y;
+// State is kept in registers for the whole block.
+// in and out may point to the same buffer.
+static void BiQuad_ProcessBlock(BiQuadFilter *f, const float *in, float *out, int n) {
+    const float b0 = f->b0, b1 = f->b1, b2 = f->b2;
+    const float a1 = f->a1, a2 = f->a2;
+    float x1 = f->x1, x2 = f->x2;
+    float y1 = f->y1, y2 = f->y2;
+
+    for (int i = 0; i < n; i++) {
+        float x = in[i];
+        float y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+        x2 = x1; x1 = x;
+        y2 = y1; y1 = y;
+        out[i] = y;
+    }
+
+    f->x1 = x1; f->x2 = x2;
+    f->y1 = y1; f->y2 = y2;
 }
 
 /* ============================================================
@@ -237,11 +465,20 @@ static void DCBlocker_Init(DCBlocker *d) {
     d->R  = 0.9995f; 
 }
 
-static float DCBlocker_Process(DCBlocker *d, float x) {
-    float y = x - d->x1 + d->R * d->y1;
-    d->x1 = x;
-    d->y1 = y;
-    return y;
+static void DCBlocker_ProcessBlock(DCBlocker *d, const float *in, float *out, int n) {
+    const float R = d->R;
+    float x1 = d->x1, y1 = d->y1;
+
+    for (int i = 0; i < n; i++) {
+        float x = in[i];
+        float y = x - x1 + R * y1;
+        x1 = x;
+        y1 = y;
+        out[i] = y;
+    }
+
+    d->x1 = x1;
+    d->y1 = y1;
 }
 
 /* ============================================================
@@ -258,50 +495,200 @@ static float exp_alpha_from_tau(float sampleRate, float tauSeconds) {
 }
 
 /* ============================================================
-   TRUE PEAK (Factor 4/8) via Catmull-Rom interpolation
+   BS.412 MPX POWER (exact 60 s sliding window)
+   ============================================================ */
+// ITU-R BS.412 integrates the MPX power over 60 s. Squared samples (in
+// kHz) are summed per chunk in float, the chunk sums go into a double
+// 100 ms sub-window sum, and the last BS412_SUBWINDOWS completed
+// sub-windows form the window. The window sum is updated by adding the
+// new and subtracting the oldest sub-window, so every 100 ms step is
+// O(1); it is re-summed once per revolution to keep rounding from
+// drifting. Until 60 s have been seen the window covers what is there.
+//
+// Rolling maxima of the 60 s power are kept per minute (full windows
+// only), so the maximum over the last N minutes costs N compares.
+#define BS412_SUBWINDOWS   600      // 600 x 100 ms = 60 s
+#define BS412_MAX_MINUTES  60
+#define BS412_SUB_PER_MIN  600
+
+// Reference Power for 0 dBr:
+// Defined as power of a sinusoidal tone with +/- 19 kHz deviation.
+// This value (180.5) assumes that the input signal is scaled to kHz units before squaring.
+// Power = (Amp/sqrt(2))^2 = (19^2)/2 = 361/2 = 180.5
+#define BS412_REF_POWER 180.5f
+
+typedef struct {
+    int subLen;                     // samples per sub-window
+    int subFill;                    // samples in the current sub-window
+    double subSum;                  // sum of squares, current sub-window
+    double ring[BS412_SUBWINDOWS];  // completed sub-window sums
+    int ringPos, ringCount;
+    double windowSum;
+    double power;                   // mean power of the window (kHz^2)
+
+    double minuteMax[BS412_MAX_MINUTES];  // max full-window power per minute
+    int minutePos, minuteCount;
+    int subInMinute;
+    double curMinuteMax;            // < 0: no full window this minute yet
+} Bs412Meter;
+
+static void Bs412_Init(Bs412Meter *m, int sampleRate) {
+    memset(m, 0, sizeof(Bs412Meter));
+    m->subLen = sampleRate / 10;
+    if (m->subLen < 1) m->subLen = 1;
+    m->curMinuteMax = -1.0;
+}
+
+static void Bs412_CloseSubWindow(Bs412Meter *m) {
+    if (m->ringCount == BS412_SUBWINDOWS) m->windowSum -= m->ring[m->ringPos];
+    else m->ringCount++;
+    m->ring[m->ringPos] = m->subSum;
+    m->windowSum += m->subSum;
+    if (++m->ringPos == BS412_SUBWINDOWS) {
+        m->ringPos = 0;
+        double exact = 0.0;
+        for (int k = 0; k < BS412_SUBWINDOWS; k++) exact += m->ring[k];
+        m->windowSum = exact;
+    }
+    m->power = m->windowSum / ((double)m->ringCount * (double)m->subLen);
+    m->subSum = 0.0;
+    m->subFill = 0;
+
+    if (m->ringCount == BS412_SUBWINDOWS && m->power > m->curMinuteMax) m->curMinuteMax = m->power;
+    if (++m->subInMinute == BS412_SUB_PER_MIN) {
+        m->subInMinute = 0;
+        if (m->curMinuteMax >= 0.0) {
+            m->minuteMax[m->minutePos] = m->curMinuteMax;
+            m->minutePos = (m->minutePos + 1) % BS412_MAX_MINUTES;
+            if (m->minuteCount < BS412_MAX_MINUTES) m->minuteCount++;
+        }
+        m->curMinuteMax = -1.0;
+    }
+}
+
+// x: n samples; scale maps them to kHz
+static void Bs412_Process(Bs412Meter *m, const float *x, int n, float scale) {
+    const float s2 = scale * scale;
+    while (n > 0) {
+        int k = m->subLen - m->subFill;
+        if (k > n) k = n;
+        float partial = 0.0f;
+        for (int i = 0; i < k; i++) partial += x[i] * x[i];
+        m->subSum += (double)partial * (double)s2;
+        m->subFill += k;
+        x += k;
+        n -= k;
+        if (m->subFill == m->subLen) Bs412_CloseSubWindow(m);
+    }
+}
+
+// Highest 60 s power over the last `minutes` (minute resolution); the
+// current power until a full window exists
+static double Bs412_MaxPower(const Bs412Meter *m, int minutes) {
+    double mx = m->curMinuteMax;
+    int n = (minutes - 1 < m->minuteCount) ? minutes - 1 : m->minuteCount;
+    for (int k = 1; k <= n; k++) {
+        double v = m->minuteMax[(m->minutePos - k + BS412_MAX_MINUTES) % BS412_MAX_MINUTES];
+        if (v > mx) mx = v;
+    }
+    return (mx >= 0.0) ? mx : m->power;
+}
+
+static float Bs412_dBr(double power) {
+    return 10.0f * log10f((float)power / BS412_REF_POWER + 1e-12f);
+}
+
+/* ============================================================
+   TRUE PEAK (Factor 4/8/16) via polyphase FIR oversampling
    ============================================================ */
-typedef struct { float x0, x1, x2, x3; int warm; } TruePeakN;
+// Windowed-sinc interpolator (Kaiser, TP_TAPS taps per phase, in the
+// spirit of ITU-R BS.1770 Annex 2). Every input sample produces all
+// `factor` interpolated points; phase 0 reproduces the input sample, so
+// only factor-1 phases are computed. Each phase is run as a short FIR
+// across the chunk and folded into a running max-abs, so both loops
+// vectorize across samples.
+#define TP_TAPS       12
+#define TP_MAX_PHASES 16
+#define TP_CHUNK      256
+#define TP_KAISER_BETA 6.0
+
+typedef struct {
+    int factor;                                // 0 until designed
+    float coef[TP_MAX_PHASES][TP_TAPS];        // [phase][tap]
+    float hist[TP_TAPS - 1 + TP_CHUNK];        // last TP_TAPS-1 inputs + chunk
+} TruePeakN;
 
 static void TruePeakN_Init(TruePeakN *tp) { memset(tp, 0, sizeof(TruePeakN)); }
 
-static float catmull_rom(float p0, float p1, float p2, float p3, float t) {
-    float t2 = t * t;
-    float t3 = t2 * t;
-    return 0.5f * (
-        (2.0f * p1) +
-        (-p0 + p2) * t +
-        (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
-        (-p0 + 3.0f * p1 - 3.0f * p2 + p3) * t3
-    );
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
 }
 
-static float TruePeakN_Process(TruePeakN *tp, float x, int factor) {
-    if (factor != 8) factor = 4;
+static void TruePeakN_Design(TruePeakN *tp, int factor) {
+    const int L = factor;
+    const int center = (TP_TAPS / 2) * L;     // kernel index of the input sample
+    const double half = (double)center;
+
+    memset(tp->coef, 0, sizeof(tp->coef));
+    for (int p = 0; p < L; p++) {
+        double sum = 0.0;
+        double h[TP_TAPS];
+        for (int t = 0; t < TP_TAPS; t++) {
+            int k = p + t * L - center;        // offset in output samples
+            double x = (double)k / (double)L;
+            double sinc = (k == 0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double r = (double)k / half;
+            double w = (fabs(r) < 1.0) ? bessel_i0(TP_KAISER_BETA * sqrt(1.0 - r * r)) / bessel_i0(TP_KAISER_BETA) : 0.0;
+            h[t] = sinc * w;
+            sum += h[t];
+        }
+        // Unity DC gain per phase
+        for (int t = 0; t < TP_TAPS; t++) tp->coef[p][t] = (float)(h[t] / sum);
+    }
+    tp->factor = factor;
+}
 
-    if (tp->warm < 4) {
-        if (tp->warm == 0) { tp->x0 = x; tp->x1 = x; tp->x2 = x; tp->x3 = x; }
-        else if (tp->warm == 1) { tp->x1 = x; tp->x2 = x; tp->x3 = x; }
-        else if (tp->warm == 2) { tp->x2 = x; tp->x3 = x; }
-        else { tp->x3 = x; }
-        tp->warm++;
-        return fabsf(x);
+// x: TP_TAPS-1 history samples followed by n new ones.
+static void TruePeakN_Kernel(const TruePeakN *tp, const float *x, float *out, int n) {
+    // Phase 0 is the input sample itself (delayed to the kernel centre)
+    const float *x0 = x + TP_TAPS - 1 - TP_TAPS / 2;
+    for (int i = 0; i < n; i++) out[i] = fabsf(x0[i]);
+
+    for (int p = 1; p < tp->factor; p++) {
+        const float *c = tp->coef[p];
+        for (int i = 0; i < n; i++) {
+            const float *xp = x + i + TP_TAPS - 1;   // newest sample
+            float acc = 0.0f;
+            for (int t = 0; t < TP_TAPS; t++) acc += c[t] * xp[-t];
+            out[i] = fmaxf(out[i], fabsf(acc));
+        }
     }
+}
 
-    tp->x0 = tp->x1;
-    tp->x1 = tp->x2;
-    tp->x2 = tp->x3;
-    tp->x3 = x;
+// Writes the per-sample true-peak magnitude of in[] to out[] (may alias).
+// The peak is delayed by TP_TAPS/2 input samples.
+static void TruePeakN_ProcessBlock(TruePeakN *tp, const float *in, float *out, int n, int factor) {
+    if (factor != 4 && factor != 16) factor = 8;
+    if (tp->factor != factor) TruePeakN_Design(tp, factor);
 
-    float p0 = tp->x0, p1 = tp->x1, p2 = tp->x2, p3 = tp->x3;
+    float *hist = tp->hist;
+    while (n > 0) {
+        int len = (n > TP_CHUNK) ? TP_CHUNK : n;
+        memcpy(hist + TP_TAPS - 1, in, sizeof(float) * (size_t)len);
 
-    float maxAbs = 0.0f;
-    for (int k = 0; k <= factor; k++) {
-        float t = (float)k / (float)factor;
-        float y = catmull_rom(p0, p1, p2, p3, t);
-        float a = fabsf(y);
-        if (a > maxAbs) maxAbs = a;
+        TruePeakN_Kernel(tp, hist, out, len);
+
+        memmove(hist, hist + len, sizeof(float) * (TP_TAPS - 1));
+        in += len;
+        out += len;
+        n -= len;
     }
-    return maxAbs;
 }
 
 /* ============================================================
@@ -341,6 +728,312 @@ static float PeakHoldRelease_Process(PeakHoldRelease *e, float x) {
     return e->value;
 }
 
+// Runs the envelope over a block and returns the value after the last sample.
+static float PeakHoldRelease_ProcessBlock(PeakHoldRelease *e, const float *in, int n) {
+    for (int i = 0; i < n; i++) PeakHoldRelease_Process(e, in[i]);
+    return e->value;
+}
+
+/* ============================================================
+   DEVIATION HISTOGRAM (true peak, rolling 1 min / 1 h / 24 h)
+   ============================================================ */
+// Every true-peak sample (in kHz) is counted into a fixed-bucket
+// histogram of DEV_BUCKET_KHZ resolution; the last bucket collects
+// everything above. Windows are built from mergeable sub-histograms in
+// three tiers: 1 s sub-windows make the 1 min window, 1 min sub-windows
+// the 1 h window and 1 h sub-windows the 24 h window. Each tier keeps a
+// ring of its completed sub-histograms and their bucket-wise sum, which
+// is updated by adding the new and subtracting the oldest, so closing a
+// sub-window costs O(buckets). A full window is that sum alone, i.e.
+// its completed sub-windows like the BS.412 window, so it never spans
+// more than its length (the 24 h figures move once an hour). Until a
+// window is full it also takes what is still in progress in its own and
+// the lower tiers, read in O(buckets), and covers what is there. Counts
+// are exact integers, so nothing drifts.
+//
+// An overdeviation event starts when the true peak reaches the limit
+// after at least DEV_EVENT_GAP_MS below it; events are counted in the
+// sub-window they start in.
+#define DEV_BUCKET_KHZ   0.1f
+#define DEV_BUCKETS      1501       // 0 .. 150 kHz + overflow
+#define DEV_MAX_SUBS     60
+#define DEV_WINDOWS      3
+#define DEV_PERCENTILES  5
+#define DEV_EVENT_GAP_MS 50
+#define DEV_RECORD_MS    1000
+
+static const int   G_DevSubs[DEV_WINDOWS] = { 60, 60, 24 };   // sub-windows per window
+static const char *G_DevWindowNames[DEV_WINDOWS] = { "1m", "1h", "24h" };
+static const float G_DevPercentiles[DEV_PERCENTILES] = { 50.0f, 90.0f, 99.0f, 99.9f, 99.99f };
+static const char *G_DevPercentileNames[DEV_PERCENTILES] = { "p50", "p90", "p99", "p999", "p9999" };
+
+typedef struct {
+    uint32_t cur[DEV_BUCKETS];                  // sub-window in progress
+    uint32_t ring[DEV_MAX_SUBS][DEV_BUCKETS];   // completed sub-windows
+    uint64_t sum[DEV_BUCKETS];                  // of the ring
+    uint32_t curEvents, ringEvents[DEV_MAX_SUBS];
+    uint64_t sumEvents;
+    int subs, pos, count;
+    int subFill;            // lower-tier sub-windows (tier 0: samples) in cur
+} DevTier;
+
+typedef struct {
+    float seconds;                  // audio covered
+    float pct[DEV_PERCENTILES];     // kHz the true peak stayed below (bucket upper edge)
+    float max;                      // kHz, upper edge of the highest bucket hit
+    float over;                     // seconds at or above the limit
+    uint32_t events;                // overdeviation events
+} DevWindowInfo;
+
+typedef struct {
+    uint32_t seq;                   // bumped per summary
+    float limit;                    // kHz
+    DevWindowInfo w[DEV_WINDOWS];
+} DeviationInfo;
+
+typedef struct {
+    DevTier tier[DEV_WINDOWS];
+    int sampleRate;
+    float limit;                    // kHz
+    int gapSamples, below;          // event hysteresis
+    int recordSamples, recordFill;
+    DeviationInfo info;             // last summary
+} DevHistogram;
+
+static void Dev_Reset(DevHistogram *d) {
+    for (int k = 0; k < DEV_WINDOWS; k++) {
+        DevTier *t = &d->tier[k];
+        memset(t, 0, sizeof(DevTier));
+        t->subs = G_DevSubs[k];
+    }
+    d->below = d->gapSamples;
+    d->recordFill = 0;
+}
+
+static void Dev_Init(DevHistogram *d, int sampleRate, float limit) {
+    memset(d, 0, sizeof(DevHistogram));
+    d->sampleRate = sampleRate;
+    d->limit = limit;
+    d->gapSamples = (int)((long long)sampleRate * DEV_EVENT_GAP_MS / 1000);
+    d->recordSamples = (int)((long long)sampleRate * DEV_RECORD_MS / 1000);
+    Dev_Reset(d);
+}
+
+// Moves the sub-window in progress into the ring
+static void DevTier_Close(DevTier *t) {
+    uint32_t *slot = t->ring[t->pos];
+    if (t->count == t->subs) {
+        for (int b = 0; b < DEV_BUCKETS; b++) t->sum[b] -= slot[b];
+        t->sumEvents -= t->ringEvents[t->pos];
+    } else {
+        t->count++;
+    }
+    memcpy(slot, t->cur, sizeof(t->cur));
+    for (int b = 0; b < DEV_BUCKETS; b++) t->sum[b] += t->cur[b];
+    t->ringEvents[t->pos] = t->curEvents;
+    t->sumEvents += t->curEvents;
+    t->pos = (t->pos + 1) % t->subs;
+    memset(t->cur, 0, sizeof(t->cur));
+    t->curEvents = 0;
+    t->subFill = 0;
+}
+
+// One second is complete: it goes into the minute in progress, a
+// complete minute into the hour in progress.
+static void Dev_CloseSecond(DevHistogram *d) {
+    for (int k = 0; k < DEV_WINDOWS; k++) {
+        DevTier *t = &d->tier[k];
+        if (k + 1 < DEV_WINDOWS) {
+            DevTier *up = &d->tier[k + 1];
+            for (int b = 0; b < DEV_BUCKETS; b++) up->cur[b] += t->cur[b];
+            up->curEvents += t->curEvents;
+            up->subFill++;
+        }
+        DevTier_Close(t);
+        if (k + 1 == DEV_WINDOWS || d->tier[k + 1].subFill < G_DevSubs[k]) break;
+    }
+}
+
+// Tiers whose sub-windows in progress belong to window w: 0..w while
+// its ring is filling, none once it is full
+static int Dev_PartialTiers(const DevHistogram *d, int w) {
+    return (d->tier[w].count < d->tier[w].subs) ? w + 1 : 0;
+}
+
+// Window w: the ring sum of its tier plus the sub-windows in progress
+// (see Dev_PartialTiers). limitBucket: first bucket at or above the limit.
+static uint64_t Dev_WindowCount(const DevHistogram *d, int w, int partial, int b) {
+    uint64_t c = d->tier[w].sum[b];
+    for (int k = 0; k < partial; k++) c += d->tier[k].cur[b];
+    return c;
+}
+
+static void Dev_Summarize(const DevHistogram *d, int w, int limitBucket, DevWindowInfo *out) {
+    const int partial = Dev_PartialTiers(d, w);
+    uint64_t total = 0, over = 0;
+    int top = -1;
+    for (int b = 0; b < DEV_BUCKETS; b++) {
+        uint64_t c = Dev_WindowCount(d, w, partial, b);
+        if (c == 0) continue;
+        total += c;
+        if (b >= limitBucket) over += c;
+        top = b;
+    }
+    memset(out, 0, sizeof(DevWindowInfo));
+    uint64_t events = d->tier[w].sumEvents;
+    for (int k = 0; k < partial; k++) events += d->tier[k].curEvents;
+    out->events = (uint32_t)events;
+    if (total == 0) return;
+    out->seconds = (float)((double)total / (double)d->sampleRate);
+    out->over = (float)((double)over / (double)d->sampleRate);
+    out->max = (float)(top + 1) * DEV_BUCKET_KHZ;
+
+    // One pass for all percentiles (ascending)
+    uint64_t cum = 0;
+    int p = 0;
+    for (int b = 0; b < DEV_BUCKETS && p < DEV_PERCENTILES; b++) {
+        cum += Dev_WindowCount(d, w, partial, b);
+        while (p < DEV_PERCENTILES && (double)cum >= (double)total * (G_DevPercentiles[p] / 100.0)) {
+            out->pct[p++] = (float)(b + 1) * DEV_BUCKET_KHZ;
+        }
+    }
+}
+
+static void Dev_Record(DevHistogram *d) {
+    DeviationInfo *info = &d->info;
+    int limitBucket = (int)(d->limit / DEV_BUCKET_KHZ + 0.5f);
+    if (limitBucket > DEV_BUCKETS - 1) limitBucket = DEV_BUCKETS - 1;
+    info->seq++;
+    info->limit = d->limit;
+    for (int w = 0; w < DEV_WINDOWS; w++) Dev_Summarize(d, w, limitBucket, &info->w[w]);
+}
+
+// x: n true-peak samples; scale maps them to kHz. Refreshes d->info
+// every DEV_RECORD_MS.
+static void Dev_Process(DevHistogram *d, const float *x, int n, float scale) {
+    const float toBucket = scale / DEV_BUCKET_KHZ;
+    const float limitX = d->limit / scale;
+    DevTier *t = &d->tier[0];
+    while (n > 0) {
+        int k = d->sampleRate - t->subFill;
+        if (k > n) k = n;
+        uint32_t *cur = t->cur;
+        for (int i = 0; i < k; i++) {
+            float f = x[i] * toBucket;
+            // NaN lands in the overflow bucket too
+            int b = (f < (float)(DEV_BUCKETS - 1)) ? (int)f : DEV_BUCKETS - 1;
+            cur[b]++;
+            if (x[i] >= limitX) {
+                if (d->below >= d->gapSamples) t->curEvents++;
+                d->below = 0;
+            } else if (d->below < d->gapSamples) {
+                d->below++;
+            }
+        }
+        t->subFill += k;
+        d->recordFill += k;
+        x += k;
+        n -= k;
+        if (t->subFill == d->sampleRate) Dev_CloseSecond(d);
+        if (d->recordFill >= d->recordSamples) {
+            d->recordFill = 0;
+            Dev_Record(d);
+        }
+    }
+}
+
+/* ============================================================
+   NCO (32-bit phase accumulator + sin/cos table)
+   ============================================================ */
+// Phase is an unsigned 32-bit fraction of a full turn, so wrapping is
+// free and 3x / 2x phase multiples are exact. sin/cos come from a
+// 1024-point table with linear interpolation (max error ~5e-6).
+#define NCO_TABLE_BITS 10
+#define NCO_TABLE_SIZE (1 << NCO_TABLE_BITS)
+#define NCO_FRAC_BITS  (32 - NCO_TABLE_BITS)
+#define NCO_FRAC_MASK  ((1u << NCO_FRAC_BITS) - 1u)
+#define NCO_QUARTER    0x40000000u
+
+#define NCO_RAD_TO_PHASE (4294967296.0f / (2.0f * (float)M_PI))
+
+static float G_NcoSinTable[NCO_TABLE_SIZE + 1];  // +1 guard for interpolation
+
+static int G_NcoTableReady = 0;
+
+// Shared by all demodulators; built once
+static void Nco_InitTable(void) {
+    if (G_NcoTableReady) return;
+    G_NcoTableReady = 1;
+    for (int i = 0; i <= NCO_TABLE_SIZE; i++) {
+        G_NcoSinTable[i] = (float)sin(2.0 * M_PI * (double)i / (double)NCO_TABLE_SIZE);
+    }
+}
+
+static inline float Nco_Sin(uint32_t phase) {
+    uint32_t idx = phase >> NCO_FRAC_BITS;
+    float frac = (float)(phase & NCO_FRAC_MASK) * (1.0f / (float)(1u << NCO_FRAC_BITS));
+    float a = G_NcoSinTable[idx];
+    return a + (G_NcoSinTable[idx + 1] - a) * frac;
+}
+
+static inline void Nco_SinCos(uint32_t phase, float *s, float *c) {
+    *s = Nco_Sin(phase);
+    *c = Nco_Sin(phase + NCO_QUARTER);
+}
+
+// Phase increment per sample for a frequency in Hz
+static uint32_t Nco_PhaseInc(float sampleRate, float frequency) {
+    double inc = (double)frequency / (double)sampleRate * 4294967296.0;
+    return (uint32_t)(int64_t)llround(inc);
+}
+
+// Frequency correction in rad/sample -> signed phase increment
+static inline uint32_t Nco_RadToPhase(float rad) {
+    return (uint32_t)(int32_t)(rad * NCO_RAD_TO_PHASE);
+}
+
+// Third harmonic of a unit phasor: (c + js)^3
+static inline void Nco_Cube(float c, float s, float *c3, float *s3) {
+    float c2 = c * c, s2 = s * s;
+    *c3 = c * (c2 - 3.0f * s2);
+    *s3 = s * (3.0f * c2 - s2);
+}
+
+// Compares the table NCO (and the cubed 57k phasor) against libm and
+// logs the worst-case amplitude and phase error.
+static void Nco_ReportAccuracy(void) {
+    static int reported = 0;
+    if (reported) return;
+    reported = 1;
+
+    double maxAmpErr = 0.0, maxPhaseErr = 0.0, maxPhaseErr3 = 0.0;
+    const int steps = 1 << 16;
+
+    for (int k = 0; k < steps; k++) {
+        // odd multiplier so all table positions and fractions get hit
+        uint32_t phase = (uint32_t)k * 2654435761u;
+        double rad = (double)phase * (2.0 * M_PI / 4294967296.0);
+
+        float s, c, c3, s3;
+        Nco_SinCos(phase, &s, &c);
+        Nco_Cube(c, s, &c3, &s3);
+
+        double es = fabs((double)s - (double)sinf((float)rad));
+        double ec = fabs((double)c - (double)cosf((float)rad));
+        if (es > maxAmpErr) maxAmpErr = es;
+        if (ec > maxAmpErr) maxAmpErr = ec;
+
+        double pe = fabs(remainder(atan2((double)s, (double)c) - rad, 2.0 * M_PI));
+        if (pe > maxPhaseErr) maxPhaseErr = pe;
+
+        double pe3 = fabs(remainder(atan2((double)s3, (double)c3) - 3.0 * rad, 2.0 * M_PI));
+        if (pe3 > maxPhaseErr3) maxPhaseErr3 = pe3;
+    }
+
+    fprintf(stderr, "[NCO] Table %d pts (interp) vs libm: max amp err=%.2e, phase err=%.2e rad, 57k (cubed) phase err=%.2e rad\n",
+            NCO_TABLE_SIZE, maxAmpErr, maxPhaseErr, maxPhaseErr3);
+}
+
 /* ============================================================
    PLL GAINS (Type-II, 2nd order)
    ============================================================ */
@@ -362,52 +1055,675 @@ static void PLL_ComputeGains(float sampleRate, float loopBwHz, float zeta, float
     *outKi = ki;
 }
 
+/* ============================================================
+   CIC DECIMATOR
+   ============================================================ */
+// Third-order CIC: integrators at the input rate, combs at the output
+// rate. Runs in wrapping 32-bit integer arithmetic, so the integrators
+// never drift. The nulls at multiples of the output rate keep everything
+// that would alias into the narrow pilot/RDS basebands out; passband
+// droop is ~0.4 dB at 2.4 kHz for R=8 (192k -> 24k).
+#define CIC_ORDER 3
+
+typedef struct {
+    int R;
+    int phase;                  // input samples since the last output
+    uint32_t integ[CIC_ORDER];
+    uint32_t comb[CIC_ORDER];
+    float inScale;              // float -> fixed point
+    float inLimit;              // clamp so that the output cannot wrap
+    float outScale;             // fixed point -> float, includes 1/R^N
+} CicDecimator;
+
+static void Cic_Init(CicDecimator *c, int R) {
+    memset(c, 0, sizeof(CicDecimator));
+    c->R = (R < 1) ? 1 : R;
+    // Gain is R^N (growth bits); keep 4 integer bits (|x| < 16) for the input
+    int growth = (int)ceilf((float)CIC_ORDER * log2f((float)c->R));
+    int fracBits = 31 - growth - 4;
+    c->inScale  = ldexpf(1.0f, fracBits);
+    c->inLimit  = 0.999f * ldexpf(1.0f, 31 - growth);
+    c->outScale = 1.0f / (c->inScale * powf((float)c->R, (float)CIC_ORDER));
+}
+
+// Decimates n samples; returns the number of outputs written. out may
+// alias in (outputs never overtake inputs).
+static int Cic_DecimateBlock(CicDecimator *c, const float *in, int n, float *out) {
+    uint32_t i0 = c->integ[0], i1 = c->integ[1], i2 = c->integ[2];
+    const float scale = c->inScale, lim = c->inLimit, outScale = c->outScale;
+    const int R = c->R;
+    int phase = c->phase;
+    int m = 0;
+
+    for (int k = 0; k < n; k++) {
+        float xs = clampf(in[k] * scale, -lim, lim);
+        i0 += (uint32_t)(int32_t)xs;
+        i1 += i0;
+        i2 += i1;
+        if (++phase == R) {
+            phase = 0;
+            uint32_t y = i2;
+            uint32_t t0 = y  - c->comb[0]; c->comb[0] = y;
+            uint32_t t1 = t0 - c->comb[1]; c->comb[1] = t0;
+            uint32_t t2 = t1 - c->comb[2]; c->comb[2] = t1;
+            out[m++] = (float)(int32_t)t2 * outScale;
+        }
+    }
+
+    c->integ[0] = i0; c->integ[1] = i1; c->integ[2] = i2;
+    c->phase = phase;
+    return m;
+}
+
+/* ============================================================
+   RDS DECODER (groups from the 57 kHz baseband)
+   ============================================================ */
+// Runs on the decimated, low-passed RDS I/Q of the demodulator (see MPX
+// DEMODULATOR), so it shares its pilot-derived 57 kHz reference instead
+// of recovering the subcarrier a second time:
+//   - a Costas loop removes the remaining carrier phase (RDS may be in
+//     phase or in quadrature with the third pilot harmonic, and the
+//     57 kHz PLL fallback leaves a slow drift);
+//   - a Gardner timing loop strobes the signal four times per bit
+//     (1187.5 bit/s), at the centre of each biphase half and at the
+//     transition after it (linearly interpolated between baseband
+//     samples). Each half is integrated from transition to transition;
+//     of the two ways to pair halves into bits, the one with the larger
+//     swing between its halves is used;
+//   - differential decoding removes the sign ambiguity of the BPSK;
+//   - blocks are found by syndrome (two offset words 26 bits apart in the
+//     right order) and then checked one by one against the expected
+//     offset. Bursts of up to 2 bits are corrected, as in most receivers:
+//     the code could fix 5, but longer "corrections" are mostly wrong.
+//     RDS_SYNC_LOSS bad blocks in a row drop the sync;
+//   - groups 0A/0B (PS, TA, MS) and 2A/2B (RadioText) are assembled; PI,
+//     PTY and TP come from every group. PS and RT change only once all
+//     their segments have been received.
+// Block error rate: the share of uncorrectable blocks among the last
+// RDS_BLER_BLOCKS while in sync, 1 without sync.
+#define RDS_BITRATE       1187.5f
+#define RDS_COSTAS_BW     5.0f      // Hz
+#define RDS_CLOCK_KP      0.004f    // timing loop gains (per half-bit, error normalized to the power)
+#define RDS_CLOCK_KI      0.00002f
+#define RDS_CLOCK_PULL    0.002f    // max. bit rate deviation (relative)
+#define RDS_PAIR_ALPHA    0.005f    // smoothing of the pairing decision (per half-bit)
+#define RDS_BLER_BLOCKS   100       // ~2.2 s
+#define RDS_SYNC_LOSS     16
+#define RDS_PS_LEN        8
+#define RDS_RT_LEN        64
+
+// Offset words A, B, C, C', D and the block they mark
+static const uint16_t G_RdsOffsets[5] = { 0x0FC, 0x198, 0x168, 0x350, 0x1B4 };
+static const int G_RdsOffsetBlock[5] = { 0, 1, 2, 2, 3 };
+
+static uint32_t G_RdsBurstTable[1024];  // syndrome of an error burst -> burst
+static int G_RdsTableReady = 0;
+
+// Decoded data; seq changes with every field except bler and groups
+typedef struct {
+    uint32_t seq;
+    int sync;
+    int pi;                     // -1 until received
+    int pty, tp, ta, ms;
+    char ps[RDS_PS_LEN + 1];    // raw RDS characters, "" until complete
+    char rt[RDS_RT_LEN + 1];
+    float bler;
+    uint32_t groups;            // groups decoded (valid block B)
+} RdsInfo;
+
+typedef struct {
+    float fs;
+
+    // Costas loop: phase on the table NCO (see NCO)
+    uint32_t phase;
+    float costasGain;
+    float pow, powAlpha;        // mean |IQ|^2
+
+    // Timing: clk counts strobes (4 per bit)
+    float clk, clkStep, clkStep0, clkInteg;
+    float yPrev;                // previous baseband sample
+    int transition;             // next strobe is a transition sample
+    float centrePrev, transitionVal;
+    float halfAcc, halfPrev;     // half-bit being integrated, previous one
+    float pairSwing[2];         // mean |half - previous half| per pairing
+    int pairing, halfIndex;
+    int codedPrev;
+
+    // Blocks
+    uint32_t reg;               // last 26 bits
+    long long bitCount, syncPos;
+    int syncBlock;
+    int synced, blockBits, nextBlock, badRun;
+    unsigned char blerRing[RDS_BLER_BLOCKS];
+    int blerPos, blerBad;
+
+    // Group being assembled
+    uint16_t group[4];
+    int groupOk;                // bit per valid block
+    int groupCPrime;            // block 3 carried offset C'
+
+    // Text assembly
+    char psBuf[RDS_PS_LEN];
+    int psMask;
+    char rtBuf[RDS_RT_LEN];
+    uint32_t rtMask;
+    int rtAB, rtEnd;
+
+    RdsInfo info;
+} RdsDecoder;
+
+// Check bits of a 16-bit information word: info x^10 mod
+// g(x) = x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1
+static uint32_t rds_check_bits(uint32_t info) {
+    uint32_t reg = 0;
+    for (int i = 15; i >= 0; i--) {
+        uint32_t fb = ((info >> i) ^ (reg >> 9)) & 1u;
+        reg = (reg << 1) & 0x3FFu;
+        if (fb) reg ^= 0x1B9u;
+    }
+    return reg;
+}
+
+// Offset word of an intact 26-bit block; linear, so the syndrome of
+// block ^ burst is offset ^ syndrome(burst)
+static uint32_t rds_syndrome(uint32_t block) {
+    return (block & 0x3FFu) ^ rds_check_bits(block >> 10);
+}
+
+static void Rds_InitTable(void) {
+    if (G_RdsTableReady) return;
+    G_RdsTableReady = 1;
+    for (int k = 0; k < 26; k++) {
+        G_RdsBurstTable[rds_syndrome(1u << k)] = 1u << k;
+        if (k < 25) G_RdsBurstTable[rds_syndrome(3u << k)] = 3u << k;
+    }
+}
+
+static void Rds_Reset(RdsDecoder *d) {
+    float fs = d->fs;
+    memset(d, 0, sizeof(RdsDecoder));
+    d->fs = fs;
+    d->costasGain = 2.0f * (float)M_PI * RDS_COSTAS_BW / fs * NCO_RAD_TO_PHASE;
+    d->powAlpha = exp_alpha_from_tau(fs, 0.100f);
+    d->pow = 1e-12f;
+    d->phase = NCO_QUARTER / 2;         // pi/4: not on a stable or unstable point of the Costas loop
+    d->clkStep0 = d->clkStep = 4.0f * RDS_BITRATE / fs;
+    d->rtAB = -1;
+    d->rtEnd = -1;
+    d->info.pi = -1;
+    d->info.bler = 1.0f;
+}
+
+static void Rds_Init(RdsDecoder *d, float fs) {
+    Rds_InitTable();
+    Nco_InitTable();
+    d->fs = fs;
+    Rds_Reset(d);
+}
+
+// Raw characters, so that JSON escaping happens in one place (output)
+static int Rds_PsSegment(RdsDecoder *d, int seg, uint16_t chars) {
+    if (seg == 0) d->psMask = 0;
+    d->psBuf[2 * seg] = (char)(chars >> 8);
+    d->psBuf[2 * seg + 1] = (char)(chars & 0xFF);
+    d->psMask |= 1 << seg;
+    if (d->psMask != 0xF || memcmp(d->info.ps, d->psBuf, RDS_PS_LEN) == 0) return 0;
+    memcpy(d->info.ps, d->psBuf, RDS_PS_LEN);
+    d->info.ps[RDS_PS_LEN] = 0;
+    return 1;
+}
+
+// One RadioText segment: 4 characters (2A) or 2 (2B, 32-character text).
+// Published once every segment up to the end (CR or full length) is in.
+static int Rds_RtSegment(RdsDecoder *d, int addr, int versionB, const char *chars) {
+    int segLen = versionB ? 2 : 4;
+    for (int k = 0; k < segLen; k++) {
+        int p = addr * segLen + k;
+        d->rtBuf[p] = chars[k];
+        if (chars[k] == '\r' && (d->rtEnd < 0 || p < d->rtEnd)) d->rtEnd = p;
+    }
+    d->rtMask |= 1u << addr;
+
+    int len = (d->rtEnd >= 0) ? d->rtEnd : 16 * segLen;
+    uint32_t need = (1u << ((len + segLen - 1) / segLen)) - 1u;
+    if ((d->rtMask & need) != need) return 0;
+
+    while (len > 0 && d->rtBuf[len - 1] == ' ') len--;
+    if ((int)strlen(d->info.rt) == len && memcmp(d->info.rt, d->rtBuf, (size_t)len) == 0) return 0;
+    memcpy(d->info.rt, d->rtBuf, (size_t)len);
+    d->info.rt[len] = 0;
+    return 1;
+}
+
+static void Rds_Group(RdsDecoder *d) {
+    if (!(d->groupOk & 2)) return;
+    const uint16_t B = d->group[1];
+    const int type = B >> 12, versionB = (B >> 11) & 1;
+    RdsInfo *info = &d->info;
+    int changed = 0;
+
+    int pi = -1;
+    if (d->groupOk & 1) pi = d->group[0];
+    else if (versionB && (d->groupOk & 4) && d->groupCPrime) pi = d->group[2];
+    if (pi >= 0 && pi != info->pi) {
+        if (info->pi >= 0) {
+            // Another station: its text starts over
+            info->ps[0] = info->rt[0] = 0;
+            d->psMask = 0;
+            d->rtMask = 0;
+            d->rtAB = -1;
+        }
+        info->pi = pi;
+        changed = 1;
+    }
+    int tp = (B >> 10) & 1, pty = (B >> 5) & 0x1F;
+    if (tp != info->tp || pty != info->pty) { info->tp = tp; info->pty = pty; changed = 1; }
+    info->groups++;
+
+    if (type == 0) {
+        int ta = (B >> 4) & 1, ms = (B >> 3) & 1;
+        if (ta != info->ta || ms != info->ms) { info->ta = ta; info->ms = ms; changed = 1; }
+        if (d->groupOk & 8) changed |= Rds_PsSegment(d, B & 3, d->group[3]);
+    } else if (type == 2) {
+        int ab = (B >> 4) & 1, addr = B & 0xF;
+        if (ab != d->rtAB) {
+            // Text A/B flag toggled: a new RadioText follows
+            d->rtAB = ab;
+            memset(d->rtBuf, ' ', RDS_RT_LEN);
+            d->rtMask = 0;
+            d->rtEnd = -1;
+        }
+        // 2A needs blocks C and D, 2B only D
+        int need = versionB ? 8 : 12;
+        if ((d->groupOk & need) == need) {
+            char c[4] = {
+                (char)(d->group[2] >> 8), (char)(d->group[2] & 0xFF),
+                (char)(d->group[3] >> 8), (char)(d->group[3] & 0xFF)
+            };
+            changed |= Rds_RtSegment(d, addr, versionB, versionB ? c + 2 : c);
+        }
+    }
+    if (changed) info->seq++;
+}
+
+static void Rds_BlockResult(RdsDecoder *d, int bad) {
+    d->blerBad += bad - d->blerRing[d->blerPos];
+    d->blerRing[d->blerPos] = (unsigned char)bad;
+    if (++d->blerPos == RDS_BLER_BLOCKS) d->blerPos = 0;
+    d->info.bler = (float)d->blerBad / (float)RDS_BLER_BLOCKS;
+    d->badRun = bad ? d->badRun + 1 : 0;
+}
+
+// Block expected at d->nextBlock, in sync
+static void Rds_Block(RdsDecoder *d) {
+    const int blk = d->nextBlock;
+    d->nextBlock = (blk + 1) & 3;
+    uint32_t w = d->reg;
+    uint32_t syn = rds_syndrome(w);
+
+    // Offsets that may mark this block (C or C' for block 3)
+    int first = (blk < 2) ? blk : (blk == 2) ? 2 : 4;
+    int last = (blk == 2) ? 3 : first;
+    int found = -1;
+    for (int k = first; k <= last && found < 0; k++) {
+        if (syn == G_RdsOffsets[k]) found = k;
+    }
+    for (int k = first; k <= last && found < 0; k++) {
+        uint32_t burst = G_RdsBurstTable[syn ^ G_RdsOffsets[k]];
+        if (burst) { w ^= burst; found = k; }
+    }
+
+    Rds_BlockResult(d, found < 0);
+    if (found >= 0) {
+        d->group[blk] = (uint16_t)(w >> 10);
+        d->groupOk |= 1 << blk;
+        if (found == 3) d->groupCPrime = 1;
+    }
+    if (blk == 3) {
+        Rds_Group(d);
+        d->groupOk = 0;
+        d->groupCPrime = 0;
+    }
+
+    if (d->badRun >= RDS_SYNC_LOSS) {
+        d->synced = 0;
+        d->syncPos = 0;
+        d->info.sync = 0;
+        d->info.bler = 1.0f;
+        d->info.seq++;
+    }
+}
+
+// Looks for an offset word at the current bit; two of them 26 bits apart
+// (or a multiple) in the right order give block sync.
+static void Rds_Search(RdsDecoder *d) {
+    uint32_t syn = rds_syndrome(d->reg);
+    for (int k = 0; k < 5; k++) {
+        if (syn != G_RdsOffsets[k]) continue;
+        int blk = G_RdsOffsetBlock[k];
+        long long dist = d->bitCount - d->syncPos;
+        if (d->syncPos > 0 && dist % 26 == 0 && dist <= 26 * 8 &&
+            (d->syncBlock + dist / 26) % 4 == blk) {
+            d->synced = 1;
+            d->blockBits = 0;
+            d->nextBlock = (blk + 1) & 3;
+            d->badRun = 0;
+            memset(d->blerRing, 0, sizeof(d->blerRing));
+            d->blerPos = d->blerBad = 0;
+            d->info.bler = 0.0f;
+            d->info.sync = 1;
+            d->info.seq++;
+            d->group[blk] = (uint16_t)(d->reg >> 10);
+            d->groupOk = (blk < 3) ? 1 << blk : 0;
+            d->groupCPrime = (k == 3);
+        }
+        d->syncPos = d->bitCount;
+        d->syncBlock = blk;
+        return;
+    }
+}
+
+static void Rds_Bit(RdsDecoder *d, int bit) {
+    d->reg = ((d->reg << 1) | (uint32_t)bit) & 0x3FFFFFFu;
+    d->bitCount++;
+    if (!d->synced) {
+        Rds_Search(d);
+    } else if (++d->blockBits == 26) {
+        d->blockBits = 0;
+        Rds_Block(d);
+    }
+}
+
+// y: baseband at a strobe; invPow: 1 / mean power
+static void Rds_Strobe(RdsDecoder *d, float y, float invPow) {
+    if (!d->transition) {
+        // Gardner: the transition sample between two half-bit centres is
+        // zero when the clock is right; e > 0 means early
+        float e = d->transitionVal * (d->centrePrev - y) * invPow;
+        d->clkInteg = clampf(d->clkInteg - RDS_CLOCK_KI * e, -RDS_CLOCK_PULL, RDS_CLOCK_PULL);
+        d->clkStep = d->clkStep0 * (1.0f + d->clkInteg);
+        d->clk -= RDS_CLOCK_KP * e;
+        d->centrePrev = y;
+        d->transition = 1;
+        return;
+    }
+    d->transitionVal = y;
+    d->transition = 0;
+
+    // The half-bit that just ended, integrated between transitions.
+    // Biphase: the two halves of a bit always have opposite signs, so the
+    // pairing with the larger mean swing is the right one.
+    float half = d->halfAcc;
+    float swing = d->halfPrev - half;
+    d->halfAcc = 0.0f;
+    d->halfPrev = half;
+
+    int par = d->halfIndex & 1;
+    d->halfIndex ^= 1;
+    d->pairSwing[par] += (fabsf(swing) * sqrtf(invPow) - d->pairSwing[par]) * RDS_PAIR_ALPHA;
+    if (d->pairSwing[par ^ 1] > 1.25f * d->pairSwing[d->pairing]) d->pairing = par ^ 1;
+    if (par != d->pairing) return;
+
+    int coded = swing > 0.0f;
+    Rds_Bit(d, coded ^ d->codedPrev);
+    d->codedPrev = coded;
+}
+
+// n baseband I/Q samples at d->fs
+static void Rds_Process(RdsDecoder *d, const float *I, const float *Q, int n) {
+    uint32_t phase = d->phase;
+    float pow = d->pow, yPrev = d->yPrev;
+    const float gain = d->costasGain, powAlpha = d->powAlpha;
+
+    for (int i = 0; i < n; i++) {
+        float c, s;
+        Nco_SinCos(phase, &s, &c);
+        float re = I[i] * c + Q[i] * s;
+        float im = Q[i] * c - I[i] * s;
+        pow += (re * re + im * im - pow) * powAlpha;
+        float invPow = 1.0f / (pow + 1e-20f);
+
+        // Costas: BPSK leaves the data in re; re * im ~ sin(2 x phase error).
+        // The gain is in phase units, the accumulator wraps by itself.
+        phase += (uint32_t)(int32_t)(gain * re * im * invPow);
+
+        d->clk += d->clkStep;
+        if (d->clk >= 1.0f) {
+            d->clk -= 1.0f;
+            // The strobe was d->clk / clkStep samples ago
+            float y = re - (d->clk / d->clkStep) * (re - yPrev);
+            Rds_Strobe(d, y, invPow);
+        }
+        d->halfAcc += re;
+        yPrev = re;
+    }
+    d->phase = phase; d->pow = pow; d->yPrev = yPrev;
+}
+
+/* ============================================================
+   STEREO METER (L/R from the pilot PLL's phasor)
+   ============================================================ */
+// A stereo decoder on the pilot PLL rather than a second carrier
+// recovery: with the pilot at sin(th), the subcarrier is sin(2 th) and
+// the pilot phasor gives it directly (sin 2th = 2 sin th cos th). The
+// demodulator hands over the runs of its pilot NCO (start phase and step
+// of every stretch between loop updates), and a pass of its own forms
+//   L = x (1 + 2 sin 2th)    R = x (1 - 2 sin 2th)    C = x cos 2th
+// so that after lowpassing L = M + S, R = M - S (M = (L+R)/2,
+// S = (L-R)/2). x has the measured pilot subtracted first. Without pilot
+// the subcarrier terms are left out, i.e. mono decoding (L = R = M).
+// L and R are CIC-decimated like the pilot / RDS mixers, C only summed
+// over each period (it is lowpassed to STEREO_CARRIER_HZ anyway), and the
+// rest runs at the decimated rate: powers of L and R and their product
+// over STEREO_TAU (M and S powers follow from those), and the residual
+// 38 kHz carrier as the lowpassed phasor (C, (L-R)/4).
+// Limits of the ~24 kHz baseband: the droop-compensated audio band is
+// flat within 0.6 dB to 6 kHz and -3 dB at 9 kHz, what the CIC lets
+// alias from the subcarrier sidebands puts the floor for separation at
+// ~40 dB, and S content below ~20 Hz reads as residual carrier.
+#define STEREO_TAU        0.300f    // s, power / correlation averaging
+#define STEREO_SEP_MAX    60.0f     // dB, reading for a silent channel
+#define STEREO_CARRIER_HZ 10.0f     // residual carrier lowpass
+#define STEREO_FLAT_HZ    3000.0f   // droop compensation exact here
+
+typedef struct {
+    int on;                 // StereoMetrics on (else all zero)
+    int pilot;              // measured with pilot (stereo decoding)
+    float l, r, m, s;       // RMS levels, kHz deviation (M = (L+R)/2, S = (L-R)/2)
+    float sep;              // dB between the louder and the quieter channel
+    float cor;              // L/R correlation -1..1
+    float c38;              // residual 38 kHz carrier, scaled like the pilot
+    float ppm;              // pilot frequency error (relative to the sample clock)
+} StereoInfo;
+
+// The pilot NCO over len samples at a constant step: phase is what the
+// phase detector sees at the first sample, which the loop locks to cos
+// (so th = phase + pi/2)
+typedef struct {
+    uint32_t phase, inc;
+    int len;
+    int pilot;              // pilot present (else mono)
+} PilotRun;
+
+typedef struct {
+    CicDecimator cicL, cicR;
+    int decim, carrierPos;
+    float carrierAcc;               // C over the current period
+    float droopA;                   // CIC droop compensation [-a, 1 + 2a, -a]
+    float histL[2], histR[2];
+    BiQuadFilter lpfI[2], lpfQ[2];  // residual carrier, 4th order
+    float powL, powR, prodLR;
+    float alpha;
+    float carrierI, carrierQ;       // newest lowpassed carrier phasor
+} StereoMeter;
+
+static void Stereo_Init(StereoMeter *st, int decim, float decimRate) {
+    memset(st, 0, sizeof(StereoMeter));
+    Cic_Init(&st->cicL, decim);
+    Cic_Init(&st->cicR, decim);
+    st->decim = decim;
+    for (int k = 0; k < 2; k++) {
+        BiQuad_LowPass(&st->lpfI[k], decimRate, STEREO_CARRIER_HZ, 0.707f);
+        BiQuad_LowPass(&st->lpfQ[k], decimRate, STEREO_CARRIER_HZ, 0.707f);
+    }
+    // CIC gain at STEREO_FLAT_HZ, and the 3-tap filter that inverts it
+    float w = (float)M_PI * STEREO_FLAT_HZ / (decimRate * (float)decim);
+    float cic = powf(sinf(w * (float)decim) / ((float)decim * sinf(w)), (float)CIC_ORDER);
+    st->droopA = (1.0f / cic - 1.0f) / (2.0f * (1.0f - cosf(2.0f * (float)M_PI * STEREO_FLAT_HZ / decimRate)));
+    st->alpha = exp_alpha_from_tau(decimRate, STEREO_TAU);
+}
+
+// x: the samples the runs cover; pilotAmp: pilot amplitude (in x) to
+// subtract; L, R, C: scratch for as many samples
+static void Stereo_Process(StereoMeter *st, const float *x, const PilotRun *runs, int nRuns,
+                           float pilotAmp, float *L, float *R, float *C) {
+    float carrierAcc = st->carrierAcc;
+    int carrierPos = st->carrierPos, mc = 0, n = 0;
+    const int decim = st->decim;
+    const float invR = 1.0f / (float)decim;
+
+    for (int k = 0; k < nRuns; k++) {
+        uint32_t phase = runs[k].phase;
+        const uint32_t inc = runs[k].inc;
+        const float g = runs[k].pilot ? 1.0f : 0.0f, amp = g * pilotAmp;
+        for (int j = 0; j < runs[k].len; j++, n++) {
+            float ps, pc;
+            Nco_SinCos(phase, &ps, &pc);
+            phase += inc;
+            // th = phase + pi/2: sin 2th = -2 s c, cos 2th = s^2 - c^2
+            float xs  = x[n] - amp * pc;
+            float s38 = -2.0f * g * ps * pc;
+            float c38 = g * (ps * ps - pc * pc);
+            L[n] = xs + 2.0f * xs * s38;
+            R[n] = xs - 2.0f * xs * s38;
+            carrierAcc += xs * c38;
+            if (++carrierPos == decim) {
+                C[mc++] = carrierAcc * invR;
+                carrierAcc = 0.0f;
+                carrierPos = 0;
+            }
+        }
+    }
+    st->carrierAcc = carrierAcc;
+    st->carrierPos = carrierPos;
+
+    // The CICs count the same samples, so they emit mc outputs too
+    Cic_DecimateBlock(&st->cicL, L, n, L);
+    Cic_DecimateBlock(&st->cicR, R, n, R);
+    const int m = mc;
+    if (m == 0) return;
+
+    float powL = st->powL, powR = st->powR, prodLR = st->prodLR;
+    float l1 = st->histL[0], l2 = st->histL[1], r1 = st->histR[0], r2 = st->histR[1];
+    const float a = st->alpha, da = st->droopA;
+    for (int i = 0; i < m; i++) {
+        // Droop-compensated, one sample late
+        float l = (1.0f + 2.0f * da) * l1 - da * (L[i] + l2);
+        float r = (1.0f + 2.0f * da) * r1 - da * (R[i] + r2);
+        l2 = l1; l1 = L[i];
+        r2 = r1; r1 = R[i];
+        powL   += (l * l - powL)   * a;
+        powR   += (r * r - powR)   * a;
+        prodLR += (l * r - prodLR) * a;
+        L[i] = 0.25f * (l - r);     // x sin 2th: quadrature part of the carrier
+    }
+    st->powL = powL; st->powR = powR; st->prodLR = prodLR;
+    st->histL[0] = l1; st->histL[1] = l2; st->histR[0] = r1; st->histR[1] = r2;
+
+    for (int k = 0; k < 2; k++) {
+        BiQuad_ProcessBlock(&st->lpfI[k], C, C, m);
+        BiQuad_ProcessBlock(&st->lpfQ[k], L, L, m);
+    }
+    st->carrierI = C[m - 1];
+    st->carrierQ = L[m - 1];
+}
+
+// Readings; levelScale maps x to kHz (MPX scale), carrierScale the half
+// amplitude of the carrier (pilot scale, so c38 compares with the pilot).
+static void Stereo_Read(const StereoMeter *st, float levelScale, float carrierScale, StereoInfo *out) {
+    float pl = fmaxf(st->powL, 0.0f), pr = fmaxf(st->powR, 0.0f);
+    float pm = fmaxf(0.25f * (pl + pr + 2.0f * st->prodLR), 0.0f);
+    float ps = fmaxf(0.25f * (pl + pr - 2.0f * st->prodLR), 0.0f);
+    float hi = fmaxf(pl, pr), lo = fminf(pl, pr);
+
+    out->l = sqrtf(pl) * levelScale;
+    out->r = sqrtf(pr) * levelScale;
+    out->m = sqrtf(pm) * levelScale;
+    out->s = sqrtf(ps) * levelScale;
+    out->sep = (hi > 1e-20f) ? fminf(10.0f * log10f(hi / fmaxf(lo, 1e-30f)), STEREO_SEP_MAX) : 0.0f;
+    out->cor = (pl > 1e-20f && pr > 1e-20f) ? clampf(st->prodLR / sqrtf(pl * pr), -1.0f, 1.0f) : 0.0f;
+    out->c38 = sqrtf(st->carrierI * st->carrierI + st->carrierQ * st->carrierQ) * carrierScale;
+}
+
 /* ============================================================
    MPX DEMODULATOR (Pilot PLL + RDS Dual-Mode Ref)
    ============================================================ */
+#define DEMOD_CHUNK 256
+#define DEMOD_BASEBAND_RATE 24000   // target rate of the decimated IQ / loop path
+
 typedef struct {
     int sampleRate;
 
+    // Baseband decimation: mixers, NCOs and phase detectors run at
+    // sampleRate, everything downstream at sampleRate / decim.
+    int decim;
+    int decimPos;               // input samples into the current period
+    float decimRate;
+
     // Filters
     BiQuadFilter bpf19;
     BiQuadFilter bpf57;
 
-    // Pilot IQ LPF
+    // Mixer output decimators (pilot I/Q, RDS I/Q)
+    CicDecimator cicI_Pilot;
+    CicDecimator cicQ_Pilot;
+    CicDecimator cicI_Rds;
+    CicDecimator cicQ_Rds;
+
+    // Pilot IQ LPF (decimated rate)
     BiQuadFilter lpfI_Pilot;
     BiQuadFilter lpfQ_Pilot;
 
-    // RDS IQ LPF
+    // RDS IQ LPF (decimated rate)
     BiQuadFilter lpfI_Rds;
     BiQuadFilter lpfQ_Rds;
 
-    // Pilot PLL
-    float p_phaseRad;
-    float p_w0Rad;
+    // Pilot PLL (loop filter updated once per decimation period)
+    uint32_t p_phase;
+    uint32_t p_w0;
+    uint32_t p_inc;             // w0 + current frequency correction
     float p_integrator;
     float p_kp, p_ki;
     float p_errLP, p_errAlpha;
+    float p_errAcc;             // phase detector sum over the period
 
     // 57k fallback PLL (locks directly to 57k when pilot absent)
-    float r_phaseRad;
-    float r_w0Rad;
+    uint32_t r_phase;
+    uint32_t r_w0;
+    uint32_t r_inc;
     float r_integrator;
     float r_kp, r_ki;
     float r_errLP, r_errAlpha;
+    float r_errAcc;
 
-    // Power estimators
+    // Power estimators (fed with the mean square of each period)
     float pilotPow, pilotPowAlpha;
     float mpxPow,   mpxPowAlpha;
     float rdsPow,   rdsPowAlpha;
+    float mpxSqAcc, pilotSqAcc, rdsSqAcc;
 
     // RMS smoothing (mag^2)
     float meanSqPilot;
     float meanSqRds;
     float rmsAlpha;
+    float absentDecay;          // meanSqPilot decay per period without pilot
 
-    // Pilot presence gate
+    // Pilot presence gate (counts in decimation periods)
     int pilotPresent;
     int presentCount;
     int absentCount;
+    int presentHold;
+    int absentHold;
 
     // RDS reference blend: 1.0 = pilot-derived (3x), 0.0 = 57-PLL
     float rdsRefBlend;
@@ -417,53 +1733,78 @@ typedef struct {
     float pilotMag;
     float rdsMag;
 
-} MpxDemodulator;
+    RdsDecoder *rds;            // fed with the RDS baseband, NULL = off (see RDS DECODER)
+    StereoMeter *stereo;        // fed with the pilot NCO runs, NULL = off (see STEREO METER)
+    float pilotAmp;             // newest lowpassed pilot amplitude
+
+    // Per-chunk scratch (see MpxDemod_ProcessBlock)
+    float pilotF[DEMOD_CHUNK];
+    float rds57[DEMOD_CHUNK];
+    float mixQP[DEMOD_CHUNK];
+    float mixQR[DEMOD_CHUNK];
+    float mixL[DEMOD_CHUNK];
+    float mixR[DEMOD_CHUNK];
+    float mixC[DEMOD_CHUNK];
+    PilotRun runs[DEMOD_CHUNK + 1];
+    unsigned char presentOut[DEMOD_CHUNK];
 
-static void MpxDemod_ResetPilotPLL(MpxDemodulator *d) {
-    d->p_integrator = 0.0f;
-    d->p_errLP = 0.0f;
-}
-static void MpxDemod_ResetRdsPLL(MpxDemodulator *d) {
-    d->r_integrator = 0.0f;
-    d->r_errLP = 0.0f;
-}
+} MpxDemodulator;
 
 static void MpxDemod_Init(MpxDemodulator *d, int sampleRate) {
     memset(d, 0, sizeof(MpxDemodulator));
     d->sampleRate = sampleRate;
 
+    d->decim = sampleRate / DEMOD_BASEBAND_RATE;
+    if (d->decim < 1) d->decim = 1;
+    d->decimRate = (float)sampleRate / (float)d->decim;
+
     BiQuad_BandPass(&d->bpf19, (float)sampleRate, 19000.0f, 20.0f);
     BiQuad_BandPass(&d->bpf57, (float)sampleRate, 57000.0f, 20.0f);
 
-    BiQuad_LowPass(&d->lpfI_Pilot, (float)sampleRate, 50.0f,   0.707f);
-    BiQuad_LowPass(&d->lpfQ_Pilot, (float)sampleRate, 50.0f,   0.707f);
+    Cic_Init(&d->cicI_Pilot, d->decim);
+    Cic_Init(&d->cicQ_Pilot, d->decim);
+    Cic_Init(&d->cicI_Rds,   d->decim);
+    Cic_Init(&d->cicQ_Rds,   d->decim);
 
-    BiQuad_LowPass(&d->lpfI_Rds,   (float)sampleRate, 2400.0f, 0.707f);
-    BiQuad_LowPass(&d->lpfQ_Rds,   (float)sampleRate, 2400.0f, 0.707f);
+    BiQuad_LowPass(&d->lpfI_Pilot, d->decimRate, 50.0f,   0.707f);
+    BiQuad_LowPass(&d->lpfQ_Pilot, d->decimRate, 50.0f,   0.707f);
 
-    d->p_w0Rad = 2.0f * (float)M_PI * 19000.0f / (float)sampleRate;
-    d->r_w0Rad = 2.0f * (float)M_PI * 57000.0f / (float)sampleRate;
+    BiQuad_LowPass(&d->lpfI_Rds,   d->decimRate, 2400.0f, 0.707f);
+    BiQuad_LowPass(&d->lpfQ_Rds,   d->decimRate, 2400.0f, 0.707f);
+
+    Nco_InitTable();
+    d->p_w0 = Nco_PhaseInc((float)sampleRate, 19000.0f);
+    d->r_w0 = Nco_PhaseInc((float)sampleRate, 57000.0f);
+    d->p_inc = d->p_w0;
+    d->r_inc = d->r_w0;
 
     // PLL design targets
     const float LOOP_BW_PILOT = 2.0f; // 1..5 Hz typical
     const float LOOP_BW_RDS   = 2.0f; // keep narrow, stable
     const float ZETA = 0.707f;
 
+    // Gains are per input sample (the correction is applied to every
+    // sample's phase step); the integrator advances decim samples per update.
     PLL_ComputeGains((float)sampleRate, LOOP_BW_PILOT, ZETA, &d->p_kp, &d->p_ki);
     PLL_ComputeGains((float)sampleRate, LOOP_BW_RDS,   ZETA, &d->r_kp, &d->r_ki);
 
-    // Power + smoothing
-    d->pilotPowAlpha = exp_alpha_from_tau((float)sampleRate, 0.050f);
-    d->mpxPowAlpha   = exp_alpha_from_tau((float)sampleRate, 0.100f);
-    d->rdsPowAlpha   = exp_alpha_from_tau((float)sampleRate, 0.050f);
+    // Power + smoothing (all at the decimated rate)
+    d->pilotPowAlpha = exp_alpha_from_tau(d->decimRate, 0.050f);
+    d->mpxPowAlpha   = exp_alpha_from_tau(d->decimRate, 0.100f);
+    d->rdsPowAlpha   = exp_alpha_from_tau(d->decimRate, 0.050f);
 
-    d->p_errAlpha    = exp_alpha_from_tau((float)sampleRate, 0.010f);
-    d->r_errAlpha    = exp_alpha_from_tau((float)sampleRate, 0.010f);
+    d->p_errAlpha    = exp_alpha_from_tau(d->decimRate, 0.010f);
+    d->r_errAlpha    = exp_alpha_from_tau(d->decimRate, 0.010f);
 
-    d->rmsAlpha      = exp_alpha_from_tau((float)sampleRate, 0.100f);
+    d->rmsAlpha      = exp_alpha_from_tau(d->decimRate, 0.100f);
+    d->absentDecay   = powf(0.9995f, (float)d->decim);
 
     // Blend time (how quickly we switch references)
-    d->blendAlpha    = exp_alpha_from_tau((float)sampleRate, 0.050f); // 50ms
+    d->blendAlpha    = exp_alpha_from_tau(d->decimRate, 0.050f); // 50ms
+
+    // Gate hold times: 2000 / 8000 input samples
+    d->presentHold = 2000 / d->decim;
+    d->absentHold  = 8000 / d->decim;
 
     d->pilotPow = 1e-6f;
     d->mpxPow   = 1e-6f;
@@ -475,399 +1816,5093 @@ static void MpxDemod_Init(MpxDemodulator *d, int sampleRate) {
     fprintf(stderr, "[PLL] Pilot: BL=%.2fHz -> Kp=%.10f Ki=%.10f\n", LOOP_BW_PILOT, d->p_kp, d->p_ki);
     fprintf(stderr, "[PLL] RDS57: BL=%.2fHz -> Kp=%.10f Ki=%.10f\n", LOOP_BW_RDS,   d->r_kp, d->r_ki);
     fprintf(stderr, "[RDS] Dual-Mode ref enabled (pilot->3x when present, 57PLL when absent). Blend tau ~50ms.\n");
+    fprintf(stderr, "[MPX] Baseband: CIC%d decimation by %d -> %.0f Hz (IQ LPF, RMS, gating, loop filters)\n",
+            CIC_ORDER, d->decim, d->decimRate);
+    Nco_ReportAccuracy();
 }
 
-static void MpxDemod_Process(MpxDemodulator *d, float rawSample) {
-    // Broadband MPX RMS for pilot presence gating
-    d->mpxPow += (rawSample * rawSample - d->mpxPow) * d->mpxPowAlpha;
-    float mpxRms = sqrtf(fmaxf(d->mpxPow, 1e-12f));
+static void MpxDemod_ProcessChunk(MpxDemodulator *d, const float *x, int n) {
+    float *pilotF = d->pilotF;
+    float *rds57  = d->rds57;
+    unsigned char *presentOut = d->presentOut;
 
-    // Pilot filter for PLL input + pilotRms estimate
-    float pilotFiltered = BiQuad_Process(&d->bpf19, rawSample);
-    d->pilotPow += (pilotFiltered * pilotFiltered - d->pilotPow) * d->pilotPowAlpha;
-    float pilotRms = sqrtf(fmaxf(d->pilotPow, 1e-12f));
+    // --- Pass 1: PLL-independent filters ---
+    // Pilot filter for PLL input, 57k filter for the fallback PLL
+    BiQuad_ProcessBlock(&d->bpf19, x, pilotF, n);
+    BiQuad_ProcessBlock(&d->bpf57, x, rds57, n);
 
+    // --- Pass 2: NCOs + mixers per sample; gating and loop filters once
+    //     per decimation period ---
     // Gate: pilotRms must be a fraction of broadband MPX RMS
     const float PILOT_REL_THRESH = 0.01f;
-    const int PRESENT_HOLD_SAMPLES = 2000;
-    const int ABSENT_HOLD_SAMPLES  = 8000;
+    const float radPerHz = (2.0f * (float)M_PI) / (float)d->sampleRate;
+    const int R = d->decim;
+    const float invR = 1.0f / (float)R;
+
+    // Mixer outputs: I overwrites the band-passed input of the same
+    // sample once it has been used by the phase detector
+    float *mixIP = pilotF;
+    float *mixQP = d->mixQP;
+    float *mixIR = rds57;
+    float *mixQR = d->mixQR;
+    PilotRun *runs = d->runs;
+    int nRuns = 0;
+
+    // PLL state is held in locals for the chunk; the mixer outputs are
+    // float stores and would otherwise force reloads through d.
+    uint32_t p_phase = d->p_phase, r_phase = d->r_phase;
+    uint32_t p_inc = d->p_inc, r_inc = d->r_inc;
+    float p_integrator = d->p_integrator, p_errLP = d->p_errLP, p_errAcc = d->p_errAcc;
+    float r_integrator = d->r_integrator, r_errLP = d->r_errLP, r_errAcc = d->r_errAcc;
+    float mpxSqAcc = d->mpxSqAcc, pilotSqAcc = d->pilotSqAcc, rdsSqAcc = d->rdsSqAcc;
+    float rdsRefBlend = d->rdsRefBlend;
+    int pilotPresent = d->pilotPresent;
+    int presentCount = d->presentCount, absentCount = d->absentCount;
+    int decimPos = d->decimPos;
+    int m = 0;
+
+    const float p_kp = d->p_kp, p_kiR = d->p_ki * (float)R, p_errAlpha = d->p_errAlpha;
+    const float r_kp = d->r_kp, r_kiR = d->r_ki * (float)R, r_errAlpha = d->r_errAlpha;
+    const uint32_t p_w0 = d->p_w0, r_w0 = d->r_w0;
+    const float blendAlpha = d->blendAlpha;
+
+    // sin of the current phase feeds the phase detector of the next sample,
+    // so each NCO is evaluated once per sample.
+    float p_s, p_c, r_s, r_c;
+    Nco_SinCos(p_phase, &p_s, &p_c);
+    Nco_SinCos(r_phase, &r_s, &r_c);
+
+    for (int i = 0; i < n; ) {
+        int run = R - decimPos;
+        if (run > n - i) run = n - i;
+        const int end = i + run;
+
+        const float b = rdsRefBlend;
+        PilotRun *pr = &runs[nRuns++];
+        pr->phase = p_phase; pr->inc = p_inc; pr->len = run; pr->pilot = pilotPresent;
+        for (; i < end; i++) {
+            float rawSample = x[i];
+            float pilotFiltered = pilotF[i];
+            float rdsFiltered57 = rds57[i];
+
+            mpxSqAcc   += rawSample * rawSample;
+            pilotSqAcc += pilotFiltered * pilotFiltered;
+            rdsSqAcc   += rdsFiltered57 * rdsFiltered57;
+
+            // --- PILOT PLL: phase detector + NCO step ---
+            p_errAcc += pilotFiltered * (-p_s);
+            p_phase += p_inc;
+            Nco_SinCos(p_phase, &p_s, &p_c);
+
+            // --- PILOT IQ mixer on RAW MPX (uses pilot phase) ---
+            mixIP[i] = rawSample * p_c;
+            mixQP[i] = rawSample * p_s;
+
+            // Always compute pilot-derived 57 carrier (pilot phasor cubed)
+            float c57_p, s57_p;
+            Nco_Cube(p_c, p_s, &c57_p, &s57_p);
+
+            // Run the 57PLL mainly when pilot is absent; when pilot present, keep it aligned (fast sync)
+            if (!pilotPresent) {
+                r_errAcc += rdsFiltered57 * (-r_s);
+                r_phase += r_inc;
+                Nco_SinCos(r_phase, &r_s, &r_c);
+            } else {
+                // lock it to pilot-derived phase while pilot is present (prevents jump at switchover)
+                r_phase = 3u * p_phase;
+                r_s = s57_p;
+                r_c = c57_p;
+            }
 
-    int presentNow = (mpxRms > 1e-9f) && ((pilotRms / (mpxRms + 1e-9f)) > PILOT_REL_THRESH);
+            // Blend carrier (smooth switching)
+            float c57 = b * c57_p + (1.0f - b) * r_c;
+            float s57 = b * s57_p + (1.0f - b) * r_s;
 
-    if (presentNow) {
-        d->presentCount++;
-        d->absentCount = 0;
-        if (!d->pilotPresent && d->presentCount > PRESENT_HOLD_SAMPLES) {
-            d->pilotPresent = 1;
-            MpxDemod_ResetPilotPLL(d);
-            // Align the 57 PLL to pilot-derived phase to avoid jumps
-            d->r_phaseRad = fmodf(3.0f * d->p_phaseRad, 2.0f * (float)M_PI);
-            MpxDemod_ResetRdsPLL(d);
+            // --- RDS IQ mixer ---
+            // Use RAW MPX for consistent calibration, or use rdsFiltered57 if you want extra cleanliness.
+            mixIR[i] = rawSample * c57;
+            mixQR[i] = rawSample * s57;
         }
-    } else {
-        d->absentCount++;
-        d->presentCount = 0;
-        if (d->pilotPresent && d->absentCount > ABSENT_HOLD_SAMPLES) {
-            d->pilotPresent = 0;
-            MpxDemod_ResetPilotPLL(d);
-            // keep 57PLL running / reset it for clean lock
-            MpxDemod_ResetRdsPLL(d);
+
+        decimPos += run;
+        if (decimPos < R) break;
+        decimPos = 0;
+
+        // --- Decimated update: power estimators + gate ---
+        d->mpxPow   += (mpxSqAcc * invR   - d->mpxPow)   * d->mpxPowAlpha;
+        d->pilotPow += (pilotSqAcc * invR - d->pilotPow) * d->pilotPowAlpha;
+        d->rdsPow   += (rdsSqAcc * invR   - d->rdsPow)   * d->rdsPowAlpha;
+        mpxSqAcc = pilotSqAcc = rdsSqAcc = 0.0f;
+
+        float mpxRms = sqrtf(fmaxf(d->mpxPow, 1e-12f));
+        float pRms   = sqrtf(fmaxf(d->pilotPow, 1e-12f));
+        float rRms   = sqrtf(fmaxf(d->rdsPow, 1e-12f));
+        int presentNow = (mpxRms > 1e-9f) && ((pRms / (mpxRms + 1e-9f)) > PILOT_REL_THRESH);
+
+        if (presentNow) {
+            presentCount++;
+            absentCount = 0;
+            if (!pilotPresent && presentCount > d->presentHold) {
+                pilotPresent = 1;
+                p_integrator = 0.0f; p_errLP = 0.0f;   // reset pilot PLL
+                // Align the 57 PLL to pilot-derived phase to avoid jumps
+                r_phase = 3u * p_phase;
+                r_integrator = 0.0f; r_errLP = 0.0f;   // reset 57 PLL
+            }
+        } else {
+            absentCount++;
+            presentCount = 0;
+            if (pilotPresent && absentCount > d->absentHold) {
+                pilotPresent = 0;
+                p_integrator = 0.0f; p_errLP = 0.0f;
+                // keep 57PLL running / reset it for clean lock
+                r_integrator = 0.0f; r_errLP = 0.0f;
+                Nco_SinCos(r_phase, &r_s, &r_c);
+            }
         }
-    }
 
-    // --- PILOT PLL UPDATE (always free-run nominal; only correct when pilotPresent) ---
-    float p_s = sinf(d->p_phaseRad);
-    float p_err = pilotFiltered * (-p_s);
-    float p_errNorm = p_err / (pilotRms + 1e-9f);
+        // --- PILOT PLL loop filter (always free-run nominal; only correct when pilotPresent) ---
+        float p_errNorm = (p_errAcc * invR) / (pRms + 1e-9f);
+        p_errAcc = 0.0f;
 
-    d->p_errLP += (p_errNorm - d->p_errLP) * d->p_errAlpha;
-    float pe = d->p_errLP;
+        p_errLP += (p_errNorm - p_errLP) * p_errAlpha;
+        float pe = p_errLP;
 
-    if (d->pilotPresent) {
-        d->p_integrator += d->p_ki * pe;
+        if (pilotPresent) {
+            p_integrator += p_kiR * pe;
 
-        float radPerHz = (2.0f * (float)M_PI) / (float)d->sampleRate;
-        float maxPull = 50.0f * radPerHz;
-        d->p_integrator = clampf(d->p_integrator, -maxPull, +maxPull);
+            float maxPull = 50.0f * radPerHz;
+            p_integrator = clampf(p_integrator, -maxPull, +maxPull);
 
-        float freqOffset = d->p_kp * pe + d->p_integrator;
-        d->p_phaseRad += d->p_w0Rad + freqOffset;
-    } else {
-        d->p_phaseRad += d->p_w0Rad;
-        d->meanSqPilot *= 0.9995f;
-    }
+            float freqOffset = p_kp * pe + p_integrator;
+            p_inc = p_w0 + Nco_RadToPhase(freqOffset);
+        } else {
+            p_inc = p_w0;
+        }
 
-    float twoPi = 2.0f * (float)M_PI;
-    if (d->p_phaseRad >= twoPi) d->p_phaseRad -= twoPi;
-    if (d->p_phaseRad < 0.0f)  d->p_phaseRad += twoPi;
+        // --- 57PLL loop filter ---
+        float r_errNorm = (r_errAcc * invR) / (rRms + 1e-9f);
+        r_errAcc = 0.0f;
 
-    // --- PILOT IQ AMPLITUDE on RAW MPX (uses pilot phase) ---
-    float p_c = cosf(d->p_phaseRad);
-    float I_P = BiQuad_Process(&d->lpfI_Pilot, rawSample * p_c);
-    float Q_P = BiQuad_Process(&d->lpfQ_Pilot, rawSample * sinf(d->p_phaseRad));
-    float magSqPilot = (I_P * I_P + Q_P * Q_P);
-    d->meanSqPilot += (magSqPilot - d->meanSqPilot) * d->rmsAlpha;
-    d->pilotMag = d->pilotPresent ? sqrtf(fmaxf(d->meanSqPilot, 0.0f)) : 0.0f;
+        if (!pilotPresent) {
+            r_errLP += (r_errNorm - r_errLP) * r_errAlpha;
+            float re = r_errLP;
 
-    // --- RDS REFERENCE: blend between pilot-derived 57 and fallback 57-PLL ---
-    // Update blend factor
-    float targetBlend = d->pilotPresent ? 1.0f : 0.0f;
-    d->rdsRefBlend += (targetBlend - d->rdsRefBlend) * d->blendAlpha;
+            r_integrator += r_kiR * re;
 
-    // Always compute pilot-derived 57 phase
-    float phase57_pilot = 3.0f * d->p_phaseRad;
-    while (phase57_pilot >= twoPi) phase57_pilot -= twoPi;
-    float c57_p = cosf(phase57_pilot);
-    float s57_p = sinf(phase57_pilot);
+            float maxPull = 100.0f * radPerHz; // a bit wider because 57k is higher
+            r_integrator = clampf(r_integrator, -maxPull, +maxPull);
 
-    // --- 57k PLL (fallback): lock directly on 57k bandpass output ---
-    float rdsFiltered57 = BiQuad_Process(&d->bpf57, rawSample);
+            float freqOffset = r_kp * re + r_integrator;
+            r_inc = r_w0 + Nco_RadToPhase(freqOffset);
+        } else {
+            r_integrator = 0.0f;
+            r_errLP = 0.0f;
+            r_inc = r_w0;
+        }
 
-    // RMS for normalization of 57 PLL detector
-    d->rdsPow += (rdsFiltered57 * rdsFiltered57 - d->rdsPow) * d->rdsPowAlpha;
-    float rdsRms = sqrtf(fmaxf(d->rdsPow, 1e-12f));
+        // --- RDS REFERENCE: blend between pilot-derived 57 and fallback 57-PLL ---
+        float targetBlend = pilotPresent ? 1.0f : 0.0f;
+        rdsRefBlend += (targetBlend - rdsRefBlend) * blendAlpha;
 
-    // Run the 57PLL mainly when pilot is absent; when pilot present, keep it aligned (fast sync)
-    if (!d->pilotPresent) {
-        float r_s = sinf(d->r_phaseRad);
-        float r_err = rdsFiltered57 * (-r_s);
-        float r_errNorm = r_err / (rdsRms + 1e-9f);
+        presentOut[m++] = (unsigned char)pilotPresent;
+    }
 
-        d->r_errLP += (r_errNorm - d->r_errLP) * d->r_errAlpha;
-        float re = d->r_errLP;
+    d->p_phase = p_phase; d->p_inc = p_inc;
+    d->p_integrator = p_integrator; d->p_errLP = p_errLP; d->p_errAcc = p_errAcc;
+    d->r_phase = r_phase; d->r_inc = r_inc;
+    d->r_integrator = r_integrator; d->r_errLP = r_errLP; d->r_errAcc = r_errAcc;
+    d->mpxSqAcc = mpxSqAcc; d->pilotSqAcc = pilotSqAcc; d->rdsSqAcc = rdsSqAcc;
+    d->rdsRefBlend = rdsRefBlend;
+    d->pilotPresent = pilotPresent;
+    d->presentCount = presentCount; d->absentCount = absentCount;
+    d->decimPos = decimPos;
+
+    // --- Pass 3: decimate, IQ lowpass + RMS smoothing at the decimated rate ---
+    // The CICs count the same samples as decimPos, so they emit one output
+    // per completed period above (m of them).
+    Cic_DecimateBlock(&d->cicI_Pilot, mixIP, n, mixIP);
+    Cic_DecimateBlock(&d->cicQ_Pilot, mixQP, n, mixQP);
+    Cic_DecimateBlock(&d->cicI_Rds,   mixIR, n, mixIR);
+    Cic_DecimateBlock(&d->cicQ_Rds,   mixQR, n, mixQR);
+    if (d->stereo) Stereo_Process(d->stereo, x, runs, nRuns, d->pilotAmp, d->mixL, d->mixR, d->mixC);
+    if (m == 0) return;
+
+    BiQuad_ProcessBlock(&d->lpfI_Pilot, mixIP, mixIP, m);
+    BiQuad_ProcessBlock(&d->lpfQ_Pilot, mixQP, mixQP, m);
+    BiQuad_ProcessBlock(&d->lpfI_Rds,   mixIR, mixIR, m);
+    BiQuad_ProcessBlock(&d->lpfQ_Rds,   mixQR, mixQR, m);
+    if (d->rds) Rds_Process(d->rds, mixIR, mixQR, m);
+    d->pilotAmp = 2.0f * sqrtf(mixIP[m - 1] * mixIP[m - 1] + mixQP[m - 1] * mixQP[m - 1]);
+
+    {
+        float meanSqPilot = d->meanSqPilot, meanSqRds = d->meanSqRds;
+        const float a = d->rmsAlpha, decay = d->absentDecay;
+        for (int i = 0; i < m; i++) {
+            if (!presentOut[i]) meanSqPilot *= decay;
+            float magSqPilot = (mixIP[i] * mixIP[i] + mixQP[i] * mixQP[i]);
+            meanSqPilot += (magSqPilot - meanSqPilot) * a;
+
+            float magSqRds = (mixIR[i] * mixIR[i] + mixQR[i] * mixQR[i]);
+            meanSqRds += (magSqRds - meanSqRds) * a;
+        }
+        d->meanSqPilot = meanSqPilot; d->meanSqRds = meanSqRds;
+    }
+
+    d->pilotMag = d->pilotPresent ? sqrtf(fmaxf(d->meanSqPilot, 0.0f)) : 0.0f;
+    d->rdsMag = sqrtf(fmaxf(d->meanSqRds, 0.0f));
+
+    // If you *want* to force RDS=0 when pilot is absent, uncomment:
+    // if (!d->pilotPresent) d->rdsMag = 0.0f;
+}
+
+// Pilot frequency error from the PLL integrator (0 without pilot). The
+// reference is the sample clock, so a sound card off by x ppm reads -x.
+static float MpxDemod_PilotPpm(const MpxDemodulator *d) {
+    if (!d->pilotPresent) return 0.0f;
+    const float radPerHz = (2.0f * (float)M_PI) / (float)d->sampleRate;
+    return d->p_integrator / radPerHz / 19000.0f * 1e6f;
+}
+
+// Processes n samples of (gain-calibrated) MPX. Work is done in chunks of
+// DEMOD_CHUNK so that the per-stage scratch buffers stay in L1 cache.
+static void MpxDemod_ProcessBlock(MpxDemodulator *d, const float *x, int n) {
+    while (n > 0) {
+        int len = (n > DEMOD_CHUNK) ? DEMOD_CHUNK : n;
+        MpxDemod_ProcessChunk(d, x, len);
+        x += len;
+        n -= len;
+    }
+}
+
+/* ============================================================
+   FFT (Spectrum)
+   ============================================================ */
+typedef struct { float r, i; } Complex;
+
+// Plan for a real-input FFT of size n, computed as an n/2-point complex
+// FFT (radix-4 stages, one radix-2 stage if log2(n/2) is odd) followed by
+// a post-twiddle that splits the even/odd spectra. All tables are built
+// once per size and are read-only afterwards, so one plan is shared by
+// every spectrum of that size (see FftPlan_Acquire); the work buffer
+// belongs to the caller.
+typedef struct {
+    int n;          // real input length
+    int m;          // complex FFT length (n/2)
+    int log2m;
+    int *bitrev;    // bit-reversal permutation, m entries
+    Complex *tw;    // exp(-j*2*pi*k/m), k < m
+    Complex *rtw;   // exp(-j*2*pi*k/n), k < m (real split post-twiddle)
+    int refs;
+} FftPlan;
+
+static void FftPlan_Destroy(FftPlan *p) {
+    if (!p) return;
+    free(p->bitrev);
+    free(p->tw);
+    free(p->rtw);
+    free(p);
+}
+
+static FftPlan* FftPlan_Create(int n) {
+    FftPlan *p = (FftPlan*)calloc(1, sizeof(FftPlan));
+    if (!p) return NULL;
+
+    p->n = n;
+    p->m = n / 2;
+    while ((1 << p->log2m) < p->m) p->log2m++;
+
+    p->bitrev = (int*)malloc(sizeof(int) * (size_t)p->m);
+    p->tw     = (Complex*)malloc(sizeof(Complex) * (size_t)p->m);
+    p->rtw    = (Complex*)malloc(sizeof(Complex) * (size_t)p->m);
+    if (!p->bitrev || !p->tw || !p->rtw) {
+        FftPlan_Destroy(p);
+        return NULL;
+    }
+
+    for (int k = 0; k < p->m; k++) {
+        int r = 0;
+        for (int b = 0; b < p->log2m; b++) r |= ((k >> b) & 1) << (p->log2m - 1 - b);
+        p->bitrev[k] = r;
+
+        double a = -2.0 * M_PI * (double)k / (double)p->m;
+        p->tw[k].r = (float)cos(a);
+        p->tw[k].i = (float)sin(a);
+
+        double ar = -2.0 * M_PI * (double)k / (double)p->n;
+        p->rtw[k].r = (float)cos(ar);
+        p->rtw[k].i = (float)sin(ar);
+    }
+    return p;
+}
+
+// Plans are built by the config side (startup, or a new fftSize being
+// published, see CONFIG SNAPSHOT) and picked up by the output stages from
+// the cache, so acquiring an already published size is only a lookup.
+// The lock is never taken per frame.
+#define FFT_PLAN_CACHE 4
+static FftPlan *G_FftPlans[FFT_PLAN_CACHE];
+#ifndef MPX_NO_THREADS
+static pthread_mutex_t G_FftPlanLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static FftPlan* FftPlan_Acquire(int n) {
+#ifndef MPX_NO_THREADS
+    pthread_mutex_lock(&G_FftPlanLock);
+#endif
+    int freeSlot = -1;
+    FftPlan *p = NULL;
+    for (int i = 0; i < FFT_PLAN_CACHE && !p; i++) {
+        if (G_FftPlans[i] && G_FftPlans[i]->n == n) { p = G_FftPlans[i]; p->refs++; }
+        else if (!G_FftPlans[i] && freeSlot < 0) freeSlot = i;
+    }
+    if (!p) {
+        p = FftPlan_Create(n);
+        if (p) p->refs = 1;
+        if (p && freeSlot >= 0) G_FftPlans[freeSlot] = p;
+    }
+#ifndef MPX_NO_THREADS
+    pthread_mutex_unlock(&G_FftPlanLock);
+#endif
+    return p;
+}
+
+static void FftPlan_Release(FftPlan *p) {
+    if (!p) return;
+#ifndef MPX_NO_THREADS
+    pthread_mutex_lock(&G_FftPlanLock);
+#endif
+    int last = (--p->refs == 0);
+    if (last) for (int i = 0; i < FFT_PLAN_CACHE; i++) if (G_FftPlans[i] == p) G_FftPlans[i] = NULL;
+#ifndef MPX_NO_THREADS
+    pthread_mutex_unlock(&G_FftPlanLock);
+#endif
+    if (last) FftPlan_Destroy(p);
+}
+
+// In-place forward complex FFT of p->m points already in bit-reversed order.
+static void FftPlan_ComplexStages(const FftPlan *p, Complex *x) {
+    const int m = p->m;
+    const Complex *tw = p->tw;
+    int h = 1;
+
+    if (p->log2m & 1) {
+        for (int k = 0; k < m; k += 2) {
+            Complex a = x[k], b = x[k + 1];
+            x[k].r = a.r + b.r;     x[k].i = a.i + b.i;
+            x[k + 1].r = a.r - b.r; x[k + 1].i = a.i - b.i;
+        }
+        h = 2;
+    }
+
+    // Each radix-4 pass merges groups of size h into groups of size 4h
+    for (; h < m; h <<= 2) {
+        const int stride = m / (4 * h);
+        for (int g = 0; g < m; g += 4 * h) {
+            for (int k = 0; k < h; k++) {
+                Complex w1 = tw[k * stride];
+                Complex w2 = tw[2 * k * stride];
+                Complex w3 = tw[3 * k * stride];
+
+                Complex *x0 = &x[g + k];
+                Complex *x1 = x0 + h;
+                Complex *x2 = x1 + h;
+                Complex *x3 = x2 + h;
+
+                Complex y1, y2, y3;
+                y1.r = w2.r * x1->r - w2.i * x1->i;  y1.i = w2.r * x1->i + w2.i * x1->r;
+                y2.r = w1.r * x2->r - w1.i * x2->i;  y2.i = w1.r * x2->i + w1.i * x2->r;
+                y3.r = w3.r * x3->r - w3.i * x3->i;  y3.i = w3.r * x3->i + w3.i * x3->r;
+
+                float s0r = x0->r + y1.r, s0i = x0->i + y1.i;
+                float d0r = x0->r - y1.r, d0i = x0->i - y1.i;
+                float s1r = y2.r + y3.r,  s1i = y2.i + y3.i;
+                float d1r = y2.r - y3.r,  d1i = y2.i - y3.i;
+
+                x0->r = s0r + s1r;  x0->i = s0i + s1i;
+                x2->r = s0r - s1r;  x2->i = s0i - s1i;
+                // -j * d1
+                x1->r = d0r + d1i;  x1->i = d0i - d1r;
+                x3->r = d0r - d1i;  x3->i = d0i + d1r;
+            }
+        }
+    }
+}
+
+// Forward FFT of n real samples. Writes bins 0..n/2-1 to out.
+// work: n/2 entries of scratch.
+static void FftPlan_RealForward(const FftPlan *p, const float *in, Complex *out, Complex *work) {
+    const int m = p->m;
+    const Complex *z = (const Complex*)in;   // even/odd samples as re/im
+    Complex *Z = work;
+
+    for (int k = 0; k < m; k++) Z[k] = z[p->bitrev[k]];
+    FftPlan_ComplexStages(p, Z);
+
+    // X[k] = E[k] - j * W^k * O[k]
+    for (int k = 0; k < m; k++) {
+        Complex a = Z[k];
+        Complex b = Z[k ? m - k : 0];
+        float er = 0.5f * (a.r + b.r), ei = 0.5f * (a.i - b.i);
+        float orr = 0.5f * (a.r - b.r), oi = 0.5f * (a.i + b.i);
+        Complex w = p->rtw[k];
+        float pr = w.r * orr - w.i * oi;
+        float pi = w.r * oi + w.i * orr;
+        out[k].r = er + pi;
+        out[k].i = ei - pr;
+    }
+}
+
+static int is_power_of_two(int x) { return x > 0 && ((x & (x - 1)) == 0); }
+
+/* ============================================================
+   SPECTRUM (streaming STFT, Welch averaging)
+   ============================================================ */
+// Samples go into a ring of fftSize. Every hop samples the ring is
+// windowed and transformed, and the bin powers are accumulated until the
+// next output frame takes the average. Every input sample is covered.
+typedef struct {
+    int fftSize;
+    int hop;            // samples between FFTs (fftSize * (1 - overlap))
+    int ringPos;        // next write index (oldest sample once full)
+    int filled;         // samples in ring, saturates at fftSize
+    int sinceHop;       // samples since the last FFT
+
+    float *ring;        // fftSize
+    float *window;      // fftSize, copy of the configured window
+    float windowNorm;   // amplitude correction relative to Hann (see Window_Create)
+    float sineGain;     // reading of a sine of amplitude 1 (about 0.5)
+    float noiseBw;      // equivalent noise bandwidth of the window, in bins
+    float *frame;       // fftSize, windowed + unwrapped ring
+    Complex *bins;      // fftSize / 2
+    Complex *work;      // fftSize / 2, FFT scratch
+    float *powAcc;      // fftSize / 2, sum of |X|^2
+    int frames;         // FFTs in powAcc
+    FftPlan *plan;
+} SpectrumStage;
+
+static void Spectrum_Free(SpectrumStage *s) {
+    FftPlan_Release(s->plan);
+    free(s->ring);
+    free(s->window);
+    free(s->frame);
+    free(s->bins);
+    free(s->work);
+    free(s->powAcc);
+    memset(s, 0, sizeof(SpectrumStage));
+}
+
+static void Spectrum_SetOverlap(SpectrumStage *s, int overlapPercent) {
+    int hop = (s->fftSize * (100 - overlapPercent)) / 100;
+    s->hop = (hop < 1) ? 1 : hop;
+    if (s->sinceHop >= s->hop) s->sinceHop = s->hop - 1;
+}
+
+// Symmetric analysis window of n points, plus the factor that makes a
+// sine read the same amplitude as with the original Hann window (Hann
+// itself is 1, so its output is unchanged). NULL if out of memory.
+static float* Window_Create(int type, int n, float *norm) {
+    float *w = (float*)malloc(sizeof(float) * (size_t)n);
+    if (!w) return NULL;
+
+    *norm = 1.0f;
+    if (type == WINDOW_HANN) {
+        for (int i = 0; i < n; i++) {
+            w[i] = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * (float)i / (float)(n - 1)));
+        }
+        return w;
+    }
+
+    double sum = 0.0, hannSum = 0.0;
+    for (int i = 0; i < n; i++) {
+        double x = 2.0 * M_PI * (double)i / (double)(n - 1);
+        if (type == WINDOW_BLACKMANHARRIS) {
+            w[i] = (float)(0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x));
+        } else {
+            w[i] = (float)(0.21557895 - 0.41663158 * cos(x) + 0.277263158 * cos(2.0 * x)
+                         - 0.083578947 * cos(3.0 * x) + 0.006947368 * cos(4.0 * x));
+        }
+        sum += w[i];
+        hannSum += 0.5 * (1.0 - cos(x));
+    }
+    if (sum > 0.0) *norm = (float)(hannSum / sum);
+    return w;
+}
+
+// Sine and noise gains of the window as used by Spectrum_TakeAverage
+static void Spectrum_WindowGains(SpectrumStage *s) {
+    double sum = 0.0, sumSq = 0.0;
+    for (int i = 0; i < s->fftSize; i++) {
+        sum += s->window[i];
+        sumSq += (double)s->window[i] * s->window[i];
+    }
+    s->sineGain = (float)(sum * s->windowNorm / (double)s->fftSize);
+    s->noiseBw = (sum > 0.0) ? (float)((double)s->fftSize * sumSq / (sum * sum)) : 1.0f;
+}
+
+static int Spectrum_Init(SpectrumStage *s, int fftSize, int overlapPercent, const float *window, float windowNorm) {
+    memset(s, 0, sizeof(SpectrumStage));
+    s->fftSize = fftSize;
+
+    s->ring   = (float*)calloc((size_t)fftSize, sizeof(float));
+    s->window = (float*)malloc(sizeof(float) * (size_t)fftSize);
+    s->frame  = (float*)malloc(sizeof(float) * (size_t)fftSize);
+    s->bins   = (Complex*)malloc(sizeof(Complex) * (size_t)fftSize / 2);
+    s->work   = (Complex*)malloc(sizeof(Complex) * (size_t)fftSize / 2);
+    s->powAcc = (float*)calloc((size_t)fftSize / 2, sizeof(float));
+    s->plan   = FftPlan_Acquire(fftSize);
+
+    if (!s->ring || !s->window || !s->frame || !s->bins || !s->work || !s->powAcc || !s->plan) {
+        Spectrum_Free(s);
+        return 0;
+    }
+
+    memcpy(s->window, window, sizeof(float) * (size_t)fftSize);
+    s->windowNorm = windowNorm;
+    Spectrum_WindowGains(s);
+
+    Spectrum_SetOverlap(s, overlapPercent);
+    return 1;
+}
+
+// New window of the same size. The FFTs averaged so far used the old one
+// and are dropped.
+static void Spectrum_SetWindow(SpectrumStage *s, const float *window, float windowNorm) {
+    memcpy(s->window, window, sizeof(float) * (size_t)s->fftSize);
+    s->windowNorm = windowNorm;
+    Spectrum_WindowGains(s);
+    memset(s->powAcc, 0, sizeof(float) * (size_t)s->fftSize / 2);
+    s->frames = 0;
+}
+
+// Switches to another FFT size. The newest samples of the old ring are
+// carried over, so the input keeps flowing through and the first FFT of
+// the new size does not wait for a refill. Keeps the old size (returns 0)
+// if out of memory.
+static int Spectrum_Resize(SpectrumStage *s, int fftSize, int overlapPercent, const float *window, float windowNorm) {
+    SpectrumStage n;
+    if (!Spectrum_Init(&n, fftSize, overlapPercent, window, windowNorm)) return 0;
+
+    int keep = (s->filled < fftSize) ? s->filled : fftSize;
+    for (int i = 0; i < keep; i++) n.ring[i] = s->ring[(s->ringPos + s->fftSize - keep + i) & (s->fftSize - 1)];
+    n.ringPos = keep & (fftSize - 1);
+    n.filled = keep;
+    n.sinceHop = (s->sinceHop < n.hop) ? s->sinceHop : n.hop - 1;
+
+    Spectrum_Free(s);
+    *s = n;
+    return 1;
+}
+
+static void Spectrum_Analyze(SpectrumStage *s) {
+    const int n = s->fftSize;
+    const int head = n - s->ringPos;   // oldest part: ring[ringPos..n)
+
+    for (int i = 0; i < head; i++) s->frame[i] = s->ring[s->ringPos + i] * s->window[i];
+    for (int i = head; i < n; i++) s->frame[i] = s->ring[i - head] * s->window[i];
+
+    FftPlan_RealForward(s->plan, s->frame, s->bins, s->work);
+
+    for (int k = 0; k < n / 2; k++) {
+        s->powAcc[k] += s->bins[k].r * s->bins[k].r + s->bins[k].i * s->bins[k].i;
+    }
+    s->frames++;
+}
+
+static void Spectrum_Push(SpectrumStage *s, const float *x, int n, float gain) {
+    while (n > 0) {
+        int len = s->hop - s->sinceHop;
+        if (len > n) len = n;
+
+        for (int i = 0; i < len; ) {
+            int run = s->fftSize - s->ringPos;
+            if (run > len - i) run = len - i;
+            for (int j = 0; j < run; j++) s->ring[s->ringPos + j] = x[i + j] * gain;
+            s->ringPos = (s->ringPos + run) & (s->fftSize - 1);
+            i += run;
+        }
+
+        s->filled = (s->filled + len > s->fftSize) ? s->fftSize : s->filled + len;
+        s->sinceHop += len;
+        x += len;
+        n -= len;
+
+        if (s->sinceHop >= s->hop) {
+            s->sinceHop = 0;
+            if (s->filled >= s->fftSize) Spectrum_Analyze(s);
+        }
+    }
+}
+
+// Welch average of everything since the last call, as linear amplitude
+// per bin (same scaling as a single Hann-windowed frame). Returns 0 if no
+// FFT has completed since the last call.
+static int Spectrum_TakeAverage(SpectrumStage *s, float *outAmp) {
+    if (s->frames == 0) return 0;
+    const float norm = 1.0f / (float)s->frames;
+    const float scale = 2.0f / (float)s->fftSize * s->windowNorm;
+    for (int k = 0; k < s->fftSize / 2; k++) {
+        outAmp[k] = sqrtf(s->powAcc[k] * norm) * scale;
+        s->powAcc[k] = 0.0f;
+    }
+    s->frames = 0;
+    return 1;
+}
+
+// Gain from the Welch amplitude to the values sent in frames
+#define SPECTRUM_DISPLAY_GAIN 15.0f
+
+/* ============================================================
+   DISPLAY BINS (bucket map)
+   ============================================================ */
+// Reduces the fftSize/2 FFT magnitudes to a smaller number of display
+// bins before smoothing and output. Display bin j sits at position
+// j/(bins-1) of the chosen scale and takes the maximum (or RMS) of the
+// FFT bins between the midpoints to its neighbours; a display bin that
+// falls between two FFT bins takes the nearest one. The bin ranges are
+// computed once per layout, so the per-frame pass is a plain loop.
+//
+// Scales (fLow/fHigh are sent with each frame so the client can place
+// the bins):
+//   linear  0 .. Nyquist
+//   log     fLow (20 Hz) .. Nyquist, logarithmic
+//   mpx     80% of the bins for 0 .. fLow (100 kHz), the rest up to
+//           Nyquist. Falls back to linear when Nyquist <= 100 kHz.
+#define BINSCALE_LOG_FMIN   20.0f
+#define BINSCALE_MPX_FSPLIT 100000.0f
+#define BINSCALE_MPX_SHARE  0.8f
+
+typedef struct {
+    int bins;           // display bins, 0 = pass-through
+    int scale;          // BINSCALE_* actually in use
+    int mode;           // BINMODE_*
+    float fLow, fHigh;
+    int *lo, *hi;       // FFT bin range [lo, hi) per display bin
+    int configured;
+} BinMap;
+
+static float BinMap_PosToFreq(const BinMap *m, float pos) {
+    if (m->scale == BINSCALE_LOG) return m->fLow * powf(m->fHigh / m->fLow, pos);
+    if (m->scale == BINSCALE_MPX) {
+        if (pos < BINSCALE_MPX_SHARE) return m->fLow * pos / BINSCALE_MPX_SHARE;
+        return m->fLow + (m->fHigh - m->fLow) * (pos - BINSCALE_MPX_SHARE) / (1.0f - BINSCALE_MPX_SHARE);
+    }
+    return m->fHigh * pos;
+}
+
+static void BinMap_Free(BinMap *m) {
+    free(m->lo);
+    free(m->hi);
+    memset(m, 0, sizeof(BinMap));
+}
+
+// (Re)builds the map. bins <= 0 or >= fftSize/2 leaves the spectrum at
+// full resolution. Returns 1 if the layout changed.
+static int BinMap_Configure(BinMap *m, int sampleRate, int fftSize, int bins, int scale, int mode) {
+    const int maxBin = fftSize / 2;
+    const float nyquist = 0.5f * (float)sampleRate;
+
+    if (bins >= maxBin || bins < 0) bins = 0;
+    if (bins > 0 && bins < 16) bins = 16;
+    if (scale == BINSCALE_MPX && nyquist <= BINSCALE_MPX_FSPLIT) scale = BINSCALE_LINEAR;
+    if (bins == 0) scale = BINSCALE_LINEAR;
+
+    if (m->configured && m->bins == bins && m->scale == scale) {
+        m->mode = mode;
+        return 0;
+    }
+
+    free(m->lo);
+    free(m->hi);
+    m->lo = m->hi = NULL;
+    m->bins = bins;
+    m->scale = scale;
+    m->mode = mode;
+    m->configured = 1;
+    m->fLow = (scale == BINSCALE_LOG) ? BINSCALE_LOG_FMIN : (scale == BINSCALE_MPX) ? BINSCALE_MPX_FSPLIT : 0.0f;
+    m->fHigh = nyquist;
+    if (bins == 0) return 1;
+
+    m->lo = (int*)malloc(sizeof(int) * (size_t)bins);
+    m->hi = (int*)malloc(sizeof(int) * (size_t)bins);
+    if (!m->lo || !m->hi) {
+        BinMap_Free(m);
+        return 1;
+    }
+
+    const float binHz = (float)sampleRate / (float)fftSize;
+    const float step = 1.0f / (float)(bins - 1);
+    for (int j = 0; j < bins; j++) {
+        float pLo = ((float)j - 0.5f) * step;
+        float pHi = ((float)j + 0.5f) * step;
+        float fLo = (j == 0) ? 0.0f : BinMap_PosToFreq(m, pLo);
+        float fHi = (j == bins - 1) ? nyquist : BinMap_PosToFreq(m, pHi);
+
+        int lo = (int)ceilf(fLo / binHz);
+        int hi = (int)ceilf(fHi / binHz);
+        if (lo > maxBin) lo = maxBin;
+        if (hi > maxBin) hi = maxBin;
+        if (hi <= lo) {
+            lo = (int)lroundf(BinMap_PosToFreq(m, (float)j * step) / binHz);
+            if (lo > maxBin - 1) lo = maxBin - 1;
+            hi = lo + 1;
+        }
+        m->lo[j] = lo;
+        m->hi[j] = hi;
+    }
+    return 1;
+}
+
+// in: fftSize/2 magnitudes, out: m->bins values (may not alias in)
+static void BinMap_Reduce(const BinMap *m, const float *in, float *out) {
+    if (m->mode == BINMODE_RMS) {
+        for (int j = 0; j < m->bins; j++) {
+            float acc = 0.0f;
+            for (int k = m->lo[j]; k < m->hi[j]; k++) acc += in[k] * in[k];
+            out[j] = sqrtf(acc / (float)(m->hi[j] - m->lo[j]));
+        }
+    } else {
+        for (int j = 0; j < m->bins; j++) {
+            float mx = 0.0f;
+            for (int k = m->lo[j]; k < m->hi[j]; k++) if (in[k] > mx) mx = in[k];
+            out[j] = mx;
+        }
+    }
+}
+
+/* ============================================================
+   NOISE FLOOR (quiet MPX gaps, minimum statistics)
+   ============================================================ */
+// Estimated once per spectrum frame from the Welch powers, before the
+// display bins and smoothing:
+//   1. The powers of the FFT bins in the gaps of the MPX spectrum that
+//      carry nothing (G_NoiseGaps: between the program and the stereo
+//      subcarrier, outside NOISE_GUARD_HZ of 19 kHz; a gap above RDS
+//      would also catch SCA/DARC and RDS splatter) are copied out and
+//      quickselect takes their median in O(n). Spurs or program spill in
+//      a few gap bins do not move it. Dividing by the median of a chi-square with 2 x (FFTs
+//      averaged) degrees of freedom (Wilson-Hilferty) gives the mean
+//      noise power per bin.
+//   2. A minimum-statistics tracker follows these frame estimates: they
+//      are smoothed (NOISE_SMOOTH), the minimum is kept over each of
+//      NOISE_SUBWINDOWS sub-windows, and the floor is the lowest minimum
+//      of the last NOISE_TRACK_MS. A burst of splatter into the gaps lifts
+//      single frames but not the floor; a floor that really rises is
+//      followed after at most NOISE_TRACK_MS. The median over a few
+//      hundred bins varies little between frames, so the minimum reads
+//      low by a fraction of a dB only.
+// The floor goes out as kHz RMS deviation in NOISE_REF_HZ of bandwidth.
+// Pilot power is the excess over the floor in the bins within
+// NOISE_PILOT_BINS of 19 kHz, RDS power the excess within
+// NOISE_RDS_HALF_HZ of 57 kHz. The SNRs (dB) set them against the noise
+// in NOISE_REF_HZ and in the RDS band; both are ratios within one
+// spectrum, independent of the meter calibration.
+#define NOISE_REF_HZ       1000.0f
+#define NOISE_RDS_HALF_HZ  2400.0f
+#define NOISE_PILOT_BINS   6
+#define NOISE_GUARD_HZ     1000.0f // the pilot's window sidelobes still show at 6 bins of 4096
+#define NOISE_GUARD_MIN_BINS 2
+#define NOISE_MIN_BINS     8
+#define NOISE_FALLBACK_BINS 32     // fewer bins in G_NoiseGaps: try G_NoiseFallbackGap
+#define NOISE_SMOOTH       0.7f
+#define NOISE_SUBWINDOWS   4
+#define NOISE_TRACK_MS     2000
+#define NOISE_SNR_MIN      (-20.0f)
+
+static const float G_NoiseGaps[][2] = { { 16500.0f, 18500.0f }, { 19500.0f, 22500.0f } };
+// For small FFTs (below 2048 at 192 kHz) the gaps above are only a few
+// bins from the pilot and its sidelobes lift them. Above 80 kHz the RDS
+// skirts have decayed; DARC or a receiver that rolls off there does read
+// into it. Needs a sample rate of about 176 kHz or more.
+static const float G_NoiseFallbackGap[2] = { 80000.0f, 94000.0f };
+
+typedef struct {
+    float nf;           // kHz RMS in NOISE_REF_HZ, 0 = no estimate
+    float pilotSnr;     // dB, pilot against the noise in NOISE_REF_HZ
+    float rdsSnr;       // dB, RDS against the noise in its band
+} NoiseInfo;
+
+typedef struct {
+    int *gapBins;       // FFT bins of the gaps
+    float *scratch;     // their powers, reordered by the selection
+    int nGap;
+    int pilotLo, pilotHi, rdsLo, rdsHi;     // bin ranges [lo, hi)
+    float binHz;
+
+    float smooth;       // smoothed frame estimate (power per bin), < 0 before the first
+    float curMin;
+    float subMin[NOISE_SUBWINDOWS];
+    int curFrames, framesPerSub, nSub, sub;
+} NoiseTracker;
+
+// k-th smallest of a[0..n) (0-based); reorders a. Wirth's selection,
+// O(n) on average.
+static float select_kth(float *a, int n, int k) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        const float pivot = a[k];
+        int i = lo, j = hi;
+        do {
+            while (a[i] < pivot) i++;
+            while (pivot < a[j]) j--;
+            if (i <= j) {
+                float t = a[i]; a[i] = a[j]; a[j] = t;
+                i++; j--;
+            }
+        } while (i <= j);
+        if (j < k) lo = i;
+        if (k < i) hi = j;
+    }
+    return a[k];
+}
+
+static void Noise_Free(NoiseTracker *nt) {
+    free(nt->gapBins);
+    free(nt->scratch);
+    memset(nt, 0, sizeof(NoiseTracker));
+}
+
+static void Noise_Reset(NoiseTracker *nt) {
+    nt->smooth = -1.0f;
+    nt->curMin = 1e30f;
+    nt->curFrames = 0;
+    nt->nSub = 0;
+    nt->sub = 0;
+}
+
+static void noise_add_gap(NoiseTracker *nt, const float gap[2], int maxBin, int pilotBin, int guardBins) {
+    int lo = (int)ceilf(gap[0] / nt->binHz);
+    int hi = (int)floorf(gap[1] / nt->binHz);
+    for (int k = lo; k <= hi && k < maxBin; k++) {
+        if (abs(k - pilotBin) > guardBins) nt->gapBins[nt->nGap++] = k;
+    }
+}
+
+// Bin ranges for a new FFT size. Without enough gap bins (sample rate
+// below 128 kHz with a small FFT) there is no estimate.
+static void Noise_Configure(NoiseTracker *nt, int sampleRate, int fftSize) {
+    const int maxBin = fftSize / 2;
+    const float binHz = (float)sampleRate / (float)fftSize;
+    const int pilotBin = (int)lroundf(19000.0f / binHz);
+    const int rdsBin = (int)lroundf(57000.0f / binHz);
+    const int rdsHalf = (int)(NOISE_RDS_HALF_HZ / binHz);
+    int guardBins = (int)ceilf(NOISE_GUARD_HZ / binHz);
+    int framesPerSub = nt->framesPerSub;
+
+    Noise_Free(nt);
+    nt->framesPerSub = framesPerSub > 0 ? framesPerSub : 1;
+    nt->binHz = binHz;
+    nt->pilotLo = pilotBin - NOISE_PILOT_BINS;
+    nt->pilotHi = pilotBin + NOISE_PILOT_BINS + 1;
+    nt->rdsLo = rdsBin - rdsHalf;
+    nt->rdsHi = rdsBin + rdsHalf + 1;
+    if (nt->pilotHi > maxBin) nt->pilotLo = nt->pilotHi = 0;
+    if (nt->rdsHi > maxBin) nt->rdsLo = nt->rdsHi = 0;
+    Noise_Reset(nt);
+
+    nt->gapBins = (int*)malloc(sizeof(int) * (size_t)maxBin);
+    nt->scratch = (float*)malloc(sizeof(float) * (size_t)maxBin);
+    if (!nt->gapBins || !nt->scratch) {
+        Noise_Free(nt);
+        return;
+    }
+    if (guardBins < NOISE_GUARD_MIN_BINS) guardBins = NOISE_GUARD_MIN_BINS;
+    for (size_t g = 0; g < sizeof(G_NoiseGaps) / sizeof(G_NoiseGaps[0]); g++)
+        noise_add_gap(nt, G_NoiseGaps[g], maxBin, pilotBin, guardBins);
+    if (nt->nGap < NOISE_FALLBACK_BINS) {
+        const int nMain = nt->nGap;
+        noise_add_gap(nt, G_NoiseFallbackGap, maxBin, pilotBin, guardBins);
+        if (nt->nGap - nMain > nMain) {
+            memmove(nt->gapBins, nt->gapBins + nMain, sizeof(int) * (size_t)(nt->nGap - nMain));
+            nt->nGap -= nMain;
+        } else {
+            nt->nGap = nMain;
+        }
+    }
+}
+
+// Sub-window length from the frame interval
+static void Noise_SetTiming(NoiseTracker *nt, int sendIntervalMs) {
+    int frames = NOISE_TRACK_MS / (NOISE_SUBWINDOWS * (sendIntervalMs > 0 ? sendIntervalMs : 1));
+    nt->framesPerSub = frames > 0 ? frames : 1;
+}
+
+// amp: fftSize/2 Welch amplitudes averaged over ffts FFTs. kHzPerUnit:
+// kHz of a sine per unit of its reading; noiseBwBins: equivalent noise
+// bandwidth of the window in bins.
+static void Noise_Process(NoiseTracker *nt, const float *amp, int ffts, float kHzPerUnit, float noiseBwBins, NoiseInfo *out) {
+    memset(out, 0, sizeof(NoiseInfo));
+    if (nt->nGap < NOISE_MIN_BINS) return;
+
+    for (int i = 0; i < nt->nGap; i++) {
+        float a = amp[nt->gapBins[i]];
+        nt->scratch[i] = a * a;
+    }
+    float med = select_kth(nt->scratch, nt->nGap, nt->nGap / 2);
+    float dof = 2.0f * (float)(ffts > 0 ? ffts : 1);
+    float wh = 1.0f - 2.0f / (9.0f * dof);
+    float binPow = med / (wh * wh * wh);
+
+    // Minimum statistics
+    nt->smooth = (nt->smooth < 0.0f) ? binPow : nt->smooth * NOISE_SMOOTH + binPow * (1.0f - NOISE_SMOOTH);
+    if (nt->smooth < nt->curMin) nt->curMin = nt->smooth;
+    float floorPow = nt->curMin;
+    for (int j = 0; j < nt->nSub; j++) if (nt->subMin[j] < floorPow) floorPow = nt->subMin[j];
+    if (++nt->curFrames >= nt->framesPerSub) {
+        nt->subMin[nt->sub] = nt->curMin;
+        nt->sub = (nt->sub + 1) % NOISE_SUBWINDOWS;
+        if (nt->nSub < NOISE_SUBWINDOWS) nt->nSub++;
+        nt->curMin = 1e30f;
+        nt->curFrames = 0;
+    }
+    if (floorPow <= 0.0f) return;
+
+    // A bin holds the power reading^2 / 2 (sine units) of noiseBwBins bins
+    float density = 0.5f * floorPow / (noiseBwBins * nt->binHz);
+    out->nf = sqrtf(density * NOISE_REF_HZ) * kHzPerUnit;
+
+    float pilot = 0.0f, rds = 0.0f;
+    for (int k = nt->pilotLo; k < nt->pilotHi; k++) pilot += amp[k] * amp[k];
+    for (int k = nt->rdsLo; k < nt->rdsHi; k++) rds += amp[k] * amp[k];
+    pilot -= floorPow * (float)(nt->pilotHi - nt->pilotLo);
+    rds -= floorPow * (float)(nt->rdsHi - nt->rdsLo);
+    // Excess power over noise in the reference band, both in bin units
+    float pRef = floorPow * NOISE_REF_HZ / nt->binHz;
+    float rRef = floorPow * 2.0f * NOISE_RDS_HALF_HZ / nt->binHz;
+    out->pilotSnr = (pilot > 0.0f) ? fmaxf(10.0f * log10f(pilot / pRef), NOISE_SNR_MIN) : NOISE_SNR_MIN;
+    out->rdsSnr = (rds > 0.0f) ? fmaxf(10.0f * log10f(rds / rRef), NOISE_SNR_MIN) : NOISE_SNR_MIN;
+}
+
+/* ============================================================
+   ZOOM SPECTRUM (digital down-conversion around a carrier)
+   ============================================================ */
+// Fine-resolution spectra of narrow bands such as the pilot (19 kHz
+// +/- 500 Hz) or RDS (57 kHz +/- 3 kHz), up to ZOOM_MAX_WINDOWS at once
+// ("ZoomSpectrum"). Each window down-converts the DC-blocked samples on
+// its own:
+//   1. The table NCO mixes the window centre to 0 Hz (I/Q).
+//   2. A CIC (see CIC DECIMATOR) decimates by R1, keeping its output rate
+//      at least ZOOM_CIC_MARGIN x span. Its nulls then sit on everything
+//      that would alias into the window, which is suppressed by ~90 dB;
+//      the droop over the window is < 0.05 dB and is not corrected.
+//   3. A Kaiser windowed-sinc FIR (ZOOM_FIR_ATTEN dB) decimates by R2 to
+//      the final rate of at least 2 x span, computing only the samples it
+//      keeps. It passes +/- span/2 and stops from rate - span/2, so
+//      nothing aliases into the bins that are sent.
+//   4. Complex FFTs of ZoomFftSize points (SpectrumWindow, 50% overlap)
+//      are Welch-averaged until the next record.
+// Every ZOOM_RECORD_MS of audio each window that completed an FFT hands
+// out the bins within +/- span/2, in ascending frequency, as sine
+// amplitudes in kHz deviation: a carrier of A kHz on a bin reads A, and
+// the power of a band is the sum of the squared values / (2 x noiseBw).
+#define ZOOM_CIC_MARGIN  16
+#define ZOOM_CIC_MAX_R   16      // keeps 15 fraction bits in the CIC
+#define ZOOM_FIR_ATTEN   80.0
+#define ZOOM_MAX_TAPS    1023
+#define ZOOM_RECORD_MS   500
+
+typedef struct {
+    int id;                     // index in ZoomSpectrum
+    float centre, span;         // Hz
+    int R1, R2;                 // CIC / FIR decimation
+    float rate;                 // Hz after both
+    uint32_t phase, phaseInc;
+    CicDecimator cicI, cicQ;
+
+    int taps;
+    float *coef;                // taps, symmetric
+    float *histI, *histQ;       // 2 x taps, each sample stored twice so the last taps are contiguous
+    int histPos, firPhase;
+
+    Complex *ring;              // fftSize decimated samples
+    int ringPos, filled, sinceHop;
+    float *powAcc;              // fftSize, sum of |X|^2
+    int frames;                 // FFTs in powAcc
+
+    int half;                   // bins sent on each side of the centre
+    float binHz;
+    float *amp;                 // 2 x half + 1, kHz, of the last record
+    int ampFrames;              // FFTs behind amp, 0 = no new record
+} ZoomWindow;
+
+typedef struct {
+    int sr;
+    int count;                  // windows running
+    int fftSize, window;        // layout they were built for
+    int nSpec;
+    float centre[ZOOM_MAX_WINDOWS], span[ZOOM_MAX_WINDOWS];
+    ZoomWindow w[ZOOM_MAX_WINDOWS];
+    FftPlan *plan;              // 2 x fftSize real = fftSize complex points
+    float *windowTable;         // fftSize
+    float ampScale;             // sqrt(mean |X|^2) -> sine amplitude
+    float noiseBw;              // equivalent noise bandwidth of the window, in bins
+    Complex *work;              // fftSize
+    float mixI[BLOCK_FRAMES], mixQ[BLOCK_FRAMES];
+    int sinceRecord;            // samples
+    uint32_t seq;               // records taken
+} ZoomSpectrum;
+
+static void ZoomWindow_Free(ZoomWindow *w) {
+    free(w->coef);
+    free(w->histI);
+    free(w->histQ);
+    free(w->ring);
+    free(w->powAcc);
+    free(w->amp);
+    memset(w, 0, sizeof(ZoomWindow));
+}
+
+static void Zoom_Free(ZoomSpectrum *z) {
+    for (int i = 0; i < z->count; i++) ZoomWindow_Free(&z->w[i]);
+    FftPlan_Release(z->plan);
+    free(z->windowTable);
+    free(z->work);
+    memset(z, 0, sizeof(ZoomSpectrum));
+}
+
+// Decimation and filter for one window. 0 if the band does not fit
+// below sr/2 or out of memory.
+static int ZoomWindow_Init(ZoomWindow *w, int sr, int fftSize, float centre, float span) {
+    memset(w, 0, sizeof(ZoomWindow));
+    if (centre - 0.5f * span <= 0.0f || centre + 0.5f * span >= 0.5f * (float)sr) return 0;
+    w->centre = centre;
+    w->span = span;
+    w->phaseInc = Nco_PhaseInc((float)sr, centre);
+
+    w->R1 = (int)((float)sr / (ZOOM_CIC_MARGIN * span));
+    if (w->R1 > ZOOM_CIC_MAX_R) w->R1 = ZOOM_CIC_MAX_R;
+    if (w->R1 < 1) w->R1 = 1;
+    Cic_Init(&w->cicI, w->R1);
+    Cic_Init(&w->cicQ, w->R1);
+    const double fc = (double)sr / (double)w->R1;
+    w->R2 = (int)(fc / (2.0 * span));
+    if (w->R2 < 1) w->R2 = 1;
+    w->rate = (float)(fc / (double)w->R2);
+
+    // Cutoff at rate/2, transition rate - span wide
+    double dw = 2.0 * M_PI * ((double)w->rate - span) / fc;
+    int taps = (int)ceil((ZOOM_FIR_ATTEN - 7.95) / (2.285 * dw)) | 1;
+    if (taps < 3) taps = 3;
+    if (taps > ZOOM_MAX_TAPS) taps = ZOOM_MAX_TAPS;
+    w->taps = taps;
+
+    w->coef   = (float*)malloc(sizeof(float) * (size_t)taps);
+    w->histI  = (float*)calloc(2 * (size_t)taps, sizeof(float));
+    w->histQ  = (float*)calloc(2 * (size_t)taps, sizeof(float));
+    w->ring   = (Complex*)calloc((size_t)fftSize, sizeof(Complex));
+    w->powAcc = (float*)calloc((size_t)fftSize, sizeof(float));
+    w->binHz = w->rate / (float)fftSize;
+    w->half = (int)(0.5f * span / w->binHz);
+    w->amp    = (float*)calloc(2 * (size_t)w->half + 1, sizeof(float));
+    if (!w->coef || !w->histI || !w->histQ || !w->ring || !w->powAcc || !w->amp) {
+        ZoomWindow_Free(w);
+        return 0;
+    }
+
+    const double beta = 0.1102 * (ZOOM_FIR_ATTEN - 8.7);
+    const double cut = 0.5 * (double)w->rate / fc;     // cycles per input sample
+    const int mid = taps / 2;
+    double sum = 0.0;
+    for (int k = 0; k < taps; k++) {
+        double x = (double)(k - mid);
+        double sinc = (k == mid) ? 1.0 : sin(2.0 * M_PI * cut * x) / (2.0 * M_PI * cut * x);
+        double r = x / (double)mid;
+        double h = sinc * bessel_i0(beta * sqrt(fmax(0.0, 1.0 - r * r)));
+        w->coef[k] = (float)h;
+        sum += h;
+    }
+    for (int k = 0; k < taps; k++) w->coef[k] = (float)(w->coef[k] / sum);   // unity DC gain
+    return 1;
+}
+
+// (Re)builds the windows when the layout changed; returns 1 if it did.
+// Windows whose band does not fit are skipped with a log line.
+static int Zoom_Configure(ZoomSpectrum *z, int sr, int count, const float *centre, const float *span, int fftSize, int window) {
+    if (z->sr == sr && z->nSpec == count && z->fftSize == fftSize && z->window == window &&
+        memcmp(z->centre, centre, sizeof(float) * (size_t)count) == 0 &&
+        memcmp(z->span, span, sizeof(float) * (size_t)count) == 0) return 0;
+
+    Zoom_Free(z);
+    z->sr = sr;
+    z->nSpec = count;
+    z->fftSize = fftSize;
+    z->window = window;
+    memcpy(z->centre, centre, sizeof(float) * (size_t)count);
+    memcpy(z->span, span, sizeof(float) * (size_t)count);
+    if (count == 0) return 1;
+
+    float norm;
+    z->plan = FftPlan_Acquire(2 * fftSize);
+    z->windowTable = Window_Create(window, fftSize, &norm);
+    z->work = (Complex*)malloc(sizeof(Complex) * (size_t)fftSize);
+    if (!z->plan || !z->windowTable || !z->work) {
+        // No windows until the layout changes again
+        fprintf(stderr, "[MPX] Zoom spectrum: out of memory, off\n");
+        FftPlan_Release(z->plan);
+        free(z->windowTable);
+        free(z->work);
+        z->plan = NULL;
+        z->windowTable = NULL;
+        z->work = NULL;
+        return 1;
+    }
+    double sum = 0.0, sumSq = 0.0;
+    for (int i = 0; i < fftSize; i++) {
+        sum += z->windowTable[i];
+        sumSq += (double)z->windowTable[i] * z->windowTable[i];
+    }
+    // The mixer halves a real sine, the window sums to sum
+    z->ampScale = (float)(2.0 / sum);
+    z->noiseBw = (float)((double)fftSize * sumSq / (sum * sum));
+
+    for (int i = 0; i < count; i++) {
+        ZoomWindow *w = &z->w[z->count];
+        if (!ZoomWindow_Init(w, sr, fftSize, centre[i], span[i])) {
+            fprintf(stderr, "[MPX] Zoom %g +/- %g Hz: does not fit below %d Hz (or out of memory), skipped\n",
+                    centre[i], 0.5f * span[i], sr / 2);
+            continue;
+        }
+        w->id = i;
+        fprintf(stderr, "[MPX] Zoom %g +/- %g Hz: CIC /%d, FIR /%d (%d taps), %.1f Hz, %.3f Hz bins\n",
+                centre[i], 0.5f * span[i], w->R1, w->R2, w->taps, w->rate, w->binHz);
+        z->count++;
+    }
+    return 1;
+}
+
+static void ZoomWindow_Fft(ZoomSpectrum *z, ZoomWindow *w) {
+    const int n = z->fftSize;
+    const int *bitrev = z->plan->bitrev;
+    Complex *X = z->work;
+    for (int k = 0; k < n; k++) {
+        int j = bitrev[k];
+        const Complex *c = &w->ring[(w->ringPos + j) & (n - 1)];   // oldest first
+        X[k].r = c->r * z->windowTable[j];
+        X[k].i = c->i * z->windowTable[j];
+    }
+    FftPlan_ComplexStages(z->plan, X);
+    for (int k = 0; k < n; k++) w->powAcc[k] += X[k].r * X[k].r + X[k].i * X[k].i;
+    w->frames++;
+}
+
+// Feeds n samples to every window
+static void Zoom_Process(ZoomSpectrum *z, const float *x, int n) {
+    for (int i = 0; i < z->count; i++) {
+        ZoomWindow *w = &z->w[i];
+        uint32_t phase = w->phase;
+        for (int k = 0; k < n; k++) {
+            float s, c;
+            Nco_SinCos(phase, &s, &c);
+            z->mixI[k] = x[k] * c;
+            z->mixQ[k] = -x[k] * s;
+            phase += w->phaseInc;
+        }
+        w->phase = phase;
+        int m = Cic_DecimateBlock(&w->cicI, z->mixI, n, z->mixI);
+        Cic_DecimateBlock(&w->cicQ, z->mixQ, n, z->mixQ);
+
+        const int taps = w->taps, hop = z->fftSize / 2;
+        for (int k = 0; k < m; k++) {
+            w->histI[w->histPos] = w->histI[w->histPos + taps] = z->mixI[k];
+            w->histQ[w->histPos] = w->histQ[w->histPos + taps] = z->mixQ[k];
+            if (++w->histPos == taps) w->histPos = 0;
+            if (++w->firPhase < w->R2) continue;
+            w->firPhase = 0;
+
+            const float *hi = w->histI + w->histPos, *hq = w->histQ + w->histPos;
+            float yi = 0.0f, yq = 0.0f;
+            for (int t = 0; t < taps; t++) {
+                yi += w->coef[t] * hi[t];
+                yq += w->coef[t] * hq[t];
+            }
+            w->ring[w->ringPos].r = yi;
+            w->ring[w->ringPos].i = yq;
+            w->ringPos = (w->ringPos + 1) & (z->fftSize - 1);
+            if (w->filled < z->fftSize) w->filled++;
+            if (++w->sinceHop >= hop && w->filled == z->fftSize) {
+                ZoomWindow_Fft(z, w);
+                w->sinceHop = 0;
+            }
+        }
+    }
+    z->sinceRecord += n;
+}
+
+// Every ZOOM_RECORD_MS: averages each window's FFTs into amp (kHz, with
+// kHzPerUnit the kHz per unit of x). Returns 1 if any window has a new
+// record (ampFrames > 0).
+static int Zoom_TakeRecord(ZoomSpectrum *z, float kHzPerUnit) {
+    if ((long long)z->sinceRecord * 1000 < (long long)z->sr * ZOOM_RECORD_MS) return 0;
+    int any = 0;
+    for (int i = 0; i < z->count; i++) {
+        ZoomWindow *w = &z->w[i];
+        w->ampFrames = w->frames;
+        if (w->frames == 0) continue;
+        const float scale = z->ampScale * kHzPerUnit;
+        const float inv = 1.0f / (float)w->frames;
+        const int n = z->fftSize;
+        for (int j = 0; j <= 2 * w->half; j++) {
+            int k = (j - w->half + n) & (n - 1);    // negative offsets wrap to the top bins
+            w->amp[j] = sqrtf(w->powAcc[k] * inv) * scale;
+        }
+        memset(w->powAcc, 0, sizeof(float) * (size_t)n);
+        w->frames = 0;
+        any = 1;
+    }
+    if (!any) return 0;
+    z->sinceRecord = 0;
+    z->seq++;
+    return 1;
+}
+
+/* ============================================================
+   CONFIG SNAPSHOT (immutable, swapped at block boundaries)
+   ============================================================ */
+// The G_ settings are only written by the config side. Every change is
+// published as a new read-only snapshot with one atomic pointer store;
+// each MeterStage loads the pointer once per block and hands the
+// spectrum part on with the block (MeterBlock.settings), so a block is
+// always processed with one consistent set of values and the stages
+// never wait for a reload.
+//
+// A new fftSize or window has its FFT plan and window table built here,
+// before the snapshot goes out, so the output stage only swaps buffers.
+// Retired snapshots stay in the chain while a stage may still use one:
+// every SpectrumOutput reports the generation of the block it is on
+// (Config_Ack), and a block is metered with a snapshot no older than
+// the last one its output saw. Each publish frees the snapshots older
+// than all reports, and their tables unless a newer snapshot shares them.
+typedef struct {
+    float meterCalDB, spectrumCalDB;
+    float meterGain, spectrumGain;
+    float pilotScale, mpxScale, rdsScale;
+    float attack, decay;
+    int sendInterval, overlap;
+    int bins, binScale, binMode;
+    int truePeakFactor, mpxLpf;
+    int fftSize, window;
+    int historyRows, historyBins, historyInterval;
+    float holdTime;
+    int rdsDecoder;
+    int stereoMetrics;
+    int deviationHistogram;
+    float deviationLimit;
+    int zoomCount, zoomFftSize;
+    float zoomCentre[ZOOM_MAX_WINDOWS], zoomSpan[ZOOM_MAX_WINDOWS];   // unused entries stay zero
+} ConfigValues;
+
+typedef struct MpxConfig {
+    unsigned int generation;
+    ConfigValues v;
+    FftPlan *plan;              // one reference, keeps the plan cached
+    const float *windowTable;   // fftSize entries
+    float windowNorm;
+    int ownsTables;             // plan / windowTable were built for this snapshot
+    struct MpxConfig *older;
+} MpxConfig;
+
+static _Atomic(MpxConfig*) G_Config;
+
+#define CONFIG_MAX_READERS 16   // MAX_STREAMS
+static atomic_uint G_ConfigAcks[CONFIG_MAX_READERS];
+static int G_ConfigReaders;     // registered before the stages start
+static int G_ConfigUntracked;   // a reader did not fit: keep all snapshots
+
+static inline const MpxConfig* Config_Current(void) {
+    return atomic_load_explicit(&G_Config, memory_order_acquire);
+}
+
+// Returns the reader slot for Config_Ack, -1 if there is none left.
+static int Config_AddReader(void) {
+    if (G_ConfigReaders >= CONFIG_MAX_READERS) {
+        G_ConfigUntracked = 1;
+        return -1;
+    }
+    atomic_store(&G_ConfigAcks[G_ConfigReaders], Config_Current()->generation);
+    return G_ConfigReaders++;
+}
+
+// The reader no longer needs snapshots older than generation
+static inline void Config_Ack(int reader, unsigned int generation) {
+    if (reader >= 0) atomic_store_explicit(&G_ConfigAcks[reader], generation, memory_order_release);
+}
+
+static void config_values_from_globals(ConfigValues *v) {
+    memset(v, 0, sizeof(ConfigValues));
+    v->meterCalDB = G_MeterInputCalibrationDB;
+    v->spectrumCalDB = G_SpectrumInputCalibrationDB;
+    v->meterGain = G_MeterGain;
+    v->spectrumGain = G_SpectrumGain;
+    v->pilotScale = G_MeterPilotScale;
+    v->mpxScale = G_MeterMPXScale;
+    v->rdsScale = G_MeterRDSScale;
+    v->attack = G_SpectrumAttack;
+    v->decay = G_SpectrumDecay;
+    v->sendInterval = G_SpectrumSendInterval;
+    v->overlap = G_SpectrumOverlap;
+    v->bins = G_SpectrumBins;
+    v->binScale = G_SpectrumBinScale;
+    v->binMode = G_SpectrumBinMode;
+    v->truePeakFactor = G_TruePeakFactor;
+    v->mpxLpf = G_EnableMpxLpf;
+    v->fftSize = G_FftSize;
+    v->window = G_SpectrumWindow;
+    v->historyRows = G_HistoryRows;
+    v->historyBins = G_HistoryBins;
+    v->historyInterval = G_HistoryInterval;
+    v->holdTime = G_HoldTime;
+    v->rdsDecoder = G_RdsDecoder;
+    v->stereoMetrics = G_StereoMetrics;
+    v->deviationHistogram = G_DeviationHistogram;
+    v->deviationLimit = G_DeviationLimit;
+    v->zoomCount = G_ZoomCount;
+    v->zoomFftSize = G_ZoomFftSize;
+    for (int w = 0; w < G_ZoomCount; w++) {
+        v->zoomCentre[w] = G_ZoomCentre[w];
+        v->zoomSpan[w] = G_ZoomSpan[w];
+    }
+}
+
+// Frees the retired snapshots no stage can reach any more. Config side
+// only, like Config_Publish.
+static void Config_Reclaim(void) {
+    if (G_ConfigUntracked) return;
+    MpxConfig *newer = atomic_load_explicit(&G_Config, memory_order_relaxed);
+    unsigned int oldest = newer->generation;
+    for (int r = 0; r < G_ConfigReaders; r++) {
+        unsigned int gen = atomic_load_explicit(&G_ConfigAcks[r], memory_order_acquire);
+        if (gen < oldest) oldest = gen;
+    }
+    while (newer->older) {
+        MpxConfig *c = newer->older;
+        if (c->generation >= oldest) {
+            newer = c;
+            continue;
+        }
+        if (c->ownsTables) {
+            // Sharing is only ever with the next newer snapshots
+            if (newer->windowTable == c->windowTable) {
+                newer->ownsTables = 1;
+            } else {
+                FftPlan_Release(c->plan);
+                free((void*)c->windowTable);
+            }
+        }
+        newer->older = c->older;
+        free(c);
+    }
+}
+
+// Publishes the current G_ settings. Call from one thread at a time (the
+// config side). Returns the generation in effect, 0 if out of memory.
+static unsigned int Config_Publish(void) {
+    MpxConfig *prev = atomic_load_explicit(&G_Config, memory_order_relaxed);
+    ConfigValues v;
+    config_values_from_globals(&v);
+    if (prev && memcmp(&prev->v, &v, sizeof(ConfigValues)) == 0) return prev->generation;
+
+    MpxConfig *c = (MpxConfig*)calloc(1, sizeof(MpxConfig));
+    if (!c) return 0;
+    c->v = v;
+    if (prev && prev->v.fftSize == v.fftSize && prev->v.window == v.window) {
+        c->plan = prev->plan;
+        c->windowTable = prev->windowTable;
+        c->windowNorm = prev->windowNorm;
+    } else {
+        c->plan = FftPlan_Acquire(v.fftSize);
+        c->windowTable = Window_Create(v.window, v.fftSize, &c->windowNorm);
+        c->ownsTables = 1;
+        if (!c->plan || !c->windowTable) {
+            FftPlan_Release(c->plan);
+            free((void*)c->windowTable);
+            free(c);
+            return 0;
+        }
+    }
+    c->generation = atomic_fetch_add(&G_ConfigGeneration, 1) + 1;
+    c->older = prev;
+    atomic_store_explicit(&G_Config, c, memory_order_release);
+    Config_Reclaim();
+    return c->generation;
+}
+
+// At exit, after the stages are gone.
+static void Config_FreeAll(void) {
+    MpxConfig *c = atomic_exchange(&G_Config, NULL);
+    while (c) {
+        MpxConfig *older = c->older;
+        if (c->ownsTables) {
+            FftPlan_Release(c->plan);
+            free((void*)c->windowTable);
+        }
+        free(c);
+        c = older;
+    }
+}
+
+/* ============================================================
+   STATS (hot-path counters, --stats=MS)
+   ============================================================ */
+// Every stream keeps cumulative counters, updated with relaxed atomics by
+// whichever thread does the work:
+//   stageNs   time inside each processing stage (meter and output side)
+//   readNs    time blocked in the InputSource read (first stream of an input)
+//   writeNs   time blocked writing output (lock + write, also counted in
+//             the output stage)
+//   drops     blocks dropped on full rings (input side / spectrum side)
+//   late      frames written more than STATS_LATE_MS behind the input
+// The clock is only read when G_StageTiming is set (--stats or --bench);
+// otherwise a mark costs one branch. With --stats=MS each stream emits a
+// stats record (see OUTPUT) every MS milliseconds of audio.
+enum { STAGE_CONVERT = 0, STAGE_DCBLOCK, STAGE_BS412, STAGE_TRUEPEAK, STAGE_DEMOD, STAGE_FFT, STAGE_OUTPUT, STAGE_COUNT };
+
+static const char *G_StageNames[STAGE_COUNT] = {
+    "convert", "dcblock", "bs412", "truepeak", "demod", "fft", "output"
+};
+
+#define STATS_LATE_MS 250
+
+typedef struct {
+    atomic_ullong stageNs[STAGE_COUNT];
+    atomic_ullong readNs;
+    atomic_ullong writeNs;
+    atomic_uint dropsIn;
+    atomic_uint dropsBlk;
+    atomic_uint late;
+} StreamStats;
+
+int G_StageTiming = 0;              // read the clock around stages
+int G_StatsInterval = 0;            // ms of audio between stats records, 0 = off
+
+static inline uint64_t stats_clock_ns(void) {
+    if (!G_StageTiming) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void stats_add(atomic_ullong *c, uint64_t ns) {
+    atomic_fetch_add_explicit(c, ns, memory_order_relaxed);
+}
+
+// Plain copy of the counters; records carry the difference of two
+typedef struct {
+    uint64_t stageNs[STAGE_COUNT];
+    uint64_t readNs, writeNs;
+    unsigned int dropsIn, dropsBlk, late;
+} StatsSnapshot;
+
+static void StreamStats_Init(StreamStats *st) {
+    for (int k = 0; k < STAGE_COUNT; k++) atomic_init(&st->stageNs[k], 0);
+    atomic_init(&st->readNs, 0);
+    atomic_init(&st->writeNs, 0);
+    atomic_init(&st->dropsIn, 0);
+    atomic_init(&st->dropsBlk, 0);
+    atomic_init(&st->late, 0);
+}
+
+static void StreamStats_Take(StreamStats *st, StatsSnapshot *s) {
+    for (int k = 0; k < STAGE_COUNT; k++) s->stageNs[k] = atomic_load_explicit(&st->stageNs[k], memory_order_relaxed);
+    s->readNs = atomic_load_explicit(&st->readNs, memory_order_relaxed);
+    s->writeNs = atomic_load_explicit(&st->writeNs, memory_order_relaxed);
+    s->dropsIn = atomic_load_explicit(&st->dropsIn, memory_order_relaxed);
+    s->dropsBlk = atomic_load_explicit(&st->dropsBlk, memory_order_relaxed);
+    s->late = atomic_load_explicit(&st->late, memory_order_relaxed);
+}
+
+// Charges the time since t to stage and restarts t
+#define STAGE_MARK(stats, t, stage) do { \
+        if (G_StageTiming && (stats)) { \
+            uint64_t now_ = stats_clock_ns(); \
+            stats_add(&(stats)->stageNs[stage], now_ - (t)); \
+            (t) = now_; \
+        } \
+    } while (0)
+
+/* ============================================================
+   OUTPUT (frame serialization to stdout)
+   ============================================================ */
+// JSON lines (default), a binary framed format or shared memory (see
+// SHARED-MEMORY OUTPUT) selected with --output=.
+// Each frame is assembled in the buffer of its stream and written with a
+// single write() under G_OutLock, so frames of several streams never
+// interleave. With more than one stream, JSON frames carry "src".
+//
+// Binary frame, little-endian:
+//   0  u32 magic 'MPXF'      4  u8 version      5  u8 type (1 = spectrum,
+//      2 = stats, 3 = history, see SPECTRUM HISTORY)
+//   6  u16 header bytes      8  u32 payload bytes
+//   12 u32 sequence          16 f64 timestamp (ms since Unix epoch)
+//   24 f32 p  28 f32 r  32 f32 m  36 f32 b
+//   40 u16 bins  42 u8 encoding (0 f32, 1 u16 dB, 2 u8 dB)  43 u8 source
+//   44 f32 dB min  48 f32 dB max (quantization range for u16/u8)
+//   52 u8 bin scale (0 linear, 1 log, 2 mpx)  53 u8 bin reduction
+//      (0 none, 1 peak, 2 rms)  54 u8 stereo flags (1 measured, 2 pilot)
+//   55 u8 reserved
+//   56 f32 scale fLow  60 f32 scale fHigh (Hz, see DISPLAY BINS)
+//   64 f32 max b over 10 min  68 f32 max b over 60 min (see BS.412)
+//   72 f32 L  76 f32 R  80 f32 M  84 f32 S (RMS kHz)  88 f32 separation dB
+//   92 f32 L/R correlation  96 f32 38 kHz residual  100 f32 pilot ppm
+//      (see STEREO METER; zero unless flag 1)
+//   104 f32 noise floor (kHz RMS in 1 kHz)  108 f32 pilot SNR dB
+//   112 f32 RDS SNR dB (see NOISE FLOOR; all zero without an estimate)
+//   116 payload: bins values (linear amplitude for f32, else quantized dB)
+// Readers must use the header length to find the payload, so fields can
+// be appended to the header later.
+// JSON frames carry the stereo fields as "st" (0/1 pilot), "sl", "sr",
+// "sm", "ss", "sep", "cor", "c38", "ppm" while StereoMetrics is on, and
+// the noise floor as "nf", "psnr", "rsnr" once it has an estimate.
+//
+// Stats records (--stats=MS, see STATS) are {"stats":{...}} lines in
+// JSON and shm mode (shm: on stdout, between the heartbeats). In binary
+// mode they are frames of type 2 with the same bytes 0..23 and 43
+// (source), all other header bytes zero, and the payload:
+//   0  f32 audio ms covered   4  f32 wall ms   8  f32 realtime factor
+//   12 f32 read wait ms       16 f32 write ms
+//   20 u32 frames   24 u32 dropped input blocks   28 u32 dropped spectrum blocks
+//   32 u32 late frames   36 u32 config generation
+//   40 u8 stage count n   44 f32 ms per stage x n (STATS order)
+// Times and counts are deltas over the interval.
+//
+// RDS records (see RDS DECODER) go out when the decoded data changes and
+// at least every RDS_RECORD_MS of audio:
+//   {"rds":{"src":0,"sync":1,"pi":"C0DE","pty":10,"tp":1,"ta":0,"ms":1,
+//    "ps":"STATION ","rt":"Text","bler":0.0200,"groups":1234}}
+// in JSON and shm mode ("pi" is "" until received; characters outside
+// printable ASCII become '?'). In binary mode they are frames of type 4
+// with bytes 0..23 and 43 as for stats, and the payload:
+//   0  u16 PI   2 u8 flags (1 sync, 2 PI valid, 4 TP, 8 TA, 16 MS)   3 u8 PTY
+//   4  f32 block error rate   8 u32 groups decoded
+//   12 PS (8 bytes)   20 RadioText (64 bytes), raw RDS characters, NUL-padded
+//
+// Deviation records (see DEVIATION HISTOGRAM) go out every
+// DEV_RECORD_MS of audio while DeviationHistogram is on:
+//   {"dev":{"src":0,"limit":75.0000,"1m":{"s":60.0000,"p50":41.2000,
+//    "p90":..,"p99":..,"p999":..,"p9999":..,"max":76.3000,"over":0.0021,
+//    "events":2},"1h":{...},"24h":{...}}}
+// in JSON and shm mode ("s" and "over" in seconds, the rest in kHz). In
+// binary mode they are frames of type 5 with bytes 0..23 and 43 as for
+// stats, and the payload:
+//   0  f32 limit kHz   4 u8 windows n (1 min, 1 h, 24 h)   5 u8 percentiles k
+//      (50, 90, 99, 99.9, 99.99)   6 u16 reserved
+//   8  per window, 4 * (k + 4) bytes: f32 seconds, f32 x k percentiles,
+//      f32 max, f32 seconds over the limit, u32 events
+//
+// Zoom records (see ZOOM SPECTRUM) go out every ZOOM_RECORD_MS of audio,
+// one per zoom window, while ZoomSpectrum is set:
+//   {"zoom":{"src":0,"id":0,"seq":12,"fc":19000.0000,"span":1000.0000,
+//    "df":0.9766,"f0":18500.0977,"ffts":1,"bins":1023,"db":[...]}}
+// in JSON and shm mode: id is the index in ZoomSpectrum, f0 the frequency
+// of the first bin, df the bin spacing (Hz), db the bins in dB relative
+// to 1 kHz deviation (floored at the u16/u8 dB min). In binary mode they
+// are frames of type 6 with bytes 0..23 (12 = seq) and 43 as for stats,
+// plus 24 f32 centre  28 f32 span  32 f32 bin spacing  36 f32 first bin
+// (Hz)  40 u16 bins  44 u8 id  48 u32 FFTs averaged, and the payload
+// bins x f32 dB.
+enum { OUT_JSON = 0, OUT_F32, OUT_U16, OUT_U8, OUT_SHM };
+
+#define FRAME_MAGIC        0x4658504Du   /* "MPXF" */
+#define FRAME_VERSION      1
+#define FRAME_TYPE_SPECTRUM 1
+#define FRAME_TYPE_STATS    2
+#define FRAME_TYPE_RDS      4
+#define FRAME_TYPE_DEVIATION 5
+#define FRAME_TYPE_ZOOM     6
+#define FRAME_HEADER_BYTES 116
+#define FRAME_DB_MIN       (-140.0f)
+#define FRAME_DB_MAX       (20.0f)
+
+int G_OutputFormat = OUT_JSON;
+int G_TagSources = 0;       // add "src" to JSON frames (multi-source)
+int G_OutputFd = 1;         // -1: serialize but discard (--bench)
+
+#ifndef MPX_NO_THREADS
+static pthread_mutex_t G_OutLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+typedef struct {
+    unsigned char *data;
+    size_t len, cap;
+    StreamStats *stats;     // write time accounting, may be NULL
+} OutBuf;
+
+static int OutBuf_Reserve(OutBuf *b, size_t extra) {
+    if (b->len + extra <= b->cap) return 1;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra) cap *= 2;
+    unsigned char *d = (unsigned char*)realloc(b->data, cap);
+    if (!d) return 0;
+    b->data = d;
+    b->cap = cap;
+    return 1;
+}
+
+static void OutBuf_Append(OutBuf *b, const char *str, size_t n) {
+    if (!OutBuf_Reserve(b, n)) return;
+    memcpy(b->data + b->len, str, n);
+    b->len += n;
+}
+
+// Same text as printf("%.4f") without going through stdio
+static void OutBuf_AppendFixed4(OutBuf *b, float v) {
+    if (!OutBuf_Reserve(b, 24)) return;
+    char *p = (char*)b->data + b->len;
+    char *start = p;
+
+    if (!isfinite(v)) v = 0.0f;
+    long long q = llround((double)v * 10000.0);
+    if (q < 0) { *p++ = '-'; q = -q; }
+
+    long long ip = q / 10000;
+    int fp = (int)(q % 10000);
+
+    char tmp[24];
+    int t = 0;
+    do { tmp[t++] = (char)('0' + (ip % 10)); ip /= 10; } while (ip > 0);
+    while (t > 0) *p++ = tmp[--t];
+
+    *p++ = '.';
+    p[3] = (char)('0' + fp % 10); fp /= 10;
+    p[2] = (char)('0' + fp % 10); fp /= 10;
+    p[1] = (char)('0' + fp % 10); fp /= 10;
+    p[0] = (char)('0' + fp);
+    p += 4;
+
+    b->len += (size_t)(p - start);
+}
+
+static void OutBuf_AppendInt(OutBuf *o, const char *key, long long v) {
+    char tmp[48];
+    int n = snprintf(tmp, sizeof(tmp), ",\"%s\":%lld", key, v);
+    OutBuf_Append(o, tmp, (size_t)n);
+}
+
+static void put_u16le(unsigned char *p, uint16_t v) { p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8); }
+static void put_u32le(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;         p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16); p[3] = (unsigned char)(v >> 24);
+}
+static uint32_t get_u32le(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static uint16_t get_u16le(const unsigned char *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static void put_f32le(unsigned char *p, float f) { uint32_t v; memcpy(&v, &f, 4); put_u32le(p, v); }
+static float get_f32le(const unsigned char *p) { uint32_t v = get_u32le(p); float f; memcpy(&f, &v, 4); return f; }
+static void put_f64le(unsigned char *p, double d) {
+    uint64_t v; memcpy(&v, &d, 8);
+    put_u32le(p, (uint32_t)v);
+    put_u32le(p + 4, (uint32_t)(v >> 32));
+}
+
+static double now_epoch_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char*)data;
+    while (len > 0) {
+#ifdef _WIN32
+        int w = _write(fd, p, (unsigned int)len);
+#else
+        ssize_t w = write(fd, p, len);
+#endif
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        p += w;
+        len -= (size_t)w;
+    }
+    return 1;
+}
+
+static int Output_Flush(OutBuf *o) {
+    if (G_OutputFd < 0) { o->len = 0; return 1; }
+    uint64_t t = stats_clock_ns();
+#ifndef MPX_NO_THREADS
+    pthread_mutex_lock(&G_OutLock);
+#endif
+    int ok = write_all(G_OutputFd, o->data, o->len);
+#ifndef MPX_NO_THREADS
+    pthread_mutex_unlock(&G_OutLock);
+#endif
+    if (G_StageTiming && o->stats) stats_add(&o->stats->writeNs, stats_clock_ns() - t);
+    o->len = 0;
+    return ok;
+}
+
+typedef struct {
+    uint32_t seq;
+    int source;
+    float p, r, m, b;
+    float b10, b60;
+    const StereoInfo *st;
+    const NoiseInfo *nf;
+    const float *spectrum;   // display values
+    int bins;
+    const BinMap *binMap;    // layout of spectrum
+} OutputFrame;
+
+static const char *binScaleNames[] = { "linear", "log", "mpx" };
+
+static void Output_JsonFrame(OutBuf *o, const OutputFrame *f) {
+    OutBuf_Append(o, "{\"p\":", 5);  OutBuf_AppendFixed4(o, f->p);
+    OutBuf_Append(o, ",\"r\":", 5);  OutBuf_AppendFixed4(o, f->r);
+    OutBuf_Append(o, ",\"m\":", 5);  OutBuf_AppendFixed4(o, f->m);
+    OutBuf_Append(o, ",\"b\":", 5);  OutBuf_AppendFixed4(o, f->b);
+    OutBuf_Append(o, ",\"b10\":", 7);  OutBuf_AppendFixed4(o, f->b10);
+    OutBuf_Append(o, ",\"b60\":", 7);  OutBuf_AppendFixed4(o, f->b60);
+    if (f->st->on) {
+        const StereoInfo *st = f->st;
+        OutBuf_AppendInt(o, "st", st->pilot);
+        OutBuf_Append(o, ",\"sl\":", 6);  OutBuf_AppendFixed4(o, st->l);
+        OutBuf_Append(o, ",\"sr\":", 6);  OutBuf_AppendFixed4(o, st->r);
+        OutBuf_Append(o, ",\"sm\":", 6);  OutBuf_AppendFixed4(o, st->m);
+        OutBuf_Append(o, ",\"ss\":", 6);  OutBuf_AppendFixed4(o, st->s);
+        OutBuf_Append(o, ",\"sep\":", 7);  OutBuf_AppendFixed4(o, st->sep);
+        OutBuf_Append(o, ",\"cor\":", 7);  OutBuf_AppendFixed4(o, st->cor);
+        OutBuf_Append(o, ",\"c38\":", 7);  OutBuf_AppendFixed4(o, st->c38);
+        OutBuf_Append(o, ",\"ppm\":", 7);  OutBuf_AppendFixed4(o, st->ppm);
+    }
+    if (f->nf->nf > 0.0f) {
+        OutBuf_Append(o, ",\"nf\":", 6);  OutBuf_AppendFixed4(o, f->nf->nf);
+        OutBuf_Append(o, ",\"psnr\":", 8);  OutBuf_AppendFixed4(o, f->nf->pilotSnr);
+        OutBuf_Append(o, ",\"rsnr\":", 8);  OutBuf_AppendFixed4(o, f->nf->rdsSnr);
+    }
+    if (G_TagSources) {
+        char tmp[24];
+        int n = snprintf(tmp, sizeof(tmp), ",\"src\":%d", f->source);
+        OutBuf_Append(o, tmp, (size_t)n);
+    }
+    if (f->binMap->scale != BINSCALE_LINEAR) {
+        // Non-linear display bins: tell the reader where they are
+        const char *name = binScaleNames[f->binMap->scale];
+        OutBuf_Append(o, ",\"sc\":\"", 7);  OutBuf_Append(o, name, strlen(name));
+        OutBuf_Append(o, "\",\"fl\":", 7); OutBuf_AppendFixed4(o, f->binMap->fLow);
+        OutBuf_Append(o, ",\"fh\":", 6); OutBuf_AppendFixed4(o, f->binMap->fHigh);
+    }
+    OutBuf_Append(o, ",\"s\":[", 6);
+    for (int k = 0; k < f->bins; k++) {
+        if (k) OutBuf_Append(o, ",", 1);
+        OutBuf_AppendFixed4(o, f->spectrum[k]);
+    }
+    OutBuf_Append(o, "]}\n", 3);
+}
+
+static size_t binary_frame_payload(const OutputFrame *f, int format) {
+    int bytesPerBin = (format == OUT_F32) ? 4 : (format == OUT_U16) ? 2 : 1;
+    return (size_t)f->bins * (size_t)bytesPerBin;
+}
+
+// Writes header + payload to h (binary_frame_payload() + FRAME_HEADER_BYTES)
+static void Output_EncodeBinary(unsigned char *h, const OutputFrame *f, int format) {
+    size_t payload = binary_frame_payload(f, format);
+    memset(h, 0, FRAME_HEADER_BYTES);
+    put_u32le(h + 0, FRAME_MAGIC);
+    h[4] = FRAME_VERSION;
+    h[5] = FRAME_TYPE_SPECTRUM;
+    put_u16le(h + 6, FRAME_HEADER_BYTES);
+    put_u32le(h + 8, (uint32_t)payload);
+    put_u32le(h + 12, f->seq);
+    put_f64le(h + 16, now_epoch_ms());
+    put_f32le(h + 24, f->p);
+    put_f32le(h + 28, f->r);
+    put_f32le(h + 32, f->m);
+    put_f32le(h + 36, f->b);
+    put_u16le(h + 40, (uint16_t)f->bins);
+    h[42] = (unsigned char)(format - OUT_F32);
+    h[43] = (unsigned char)f->source;
+    put_f32le(h + 44, FRAME_DB_MIN);
+    put_f32le(h + 48, FRAME_DB_MAX);
+    h[52] = (unsigned char)f->binMap->scale;
+    h[53] = (unsigned char)(f->binMap->bins ? 1 + f->binMap->mode : 0);
+    put_f32le(h + 56, f->binMap->fLow);
+    put_f32le(h + 60, f->binMap->fHigh);
+    put_f32le(h + 64, f->b10);
+    put_f32le(h + 68, f->b60);
+    if (f->st->on) {
+        const StereoInfo *st = f->st;
+        h[54] = (unsigned char)(1 | (st->pilot ? 2 : 0));
+        put_f32le(h + 72, st->l);
+        put_f32le(h + 76, st->r);
+        put_f32le(h + 80, st->m);
+        put_f32le(h + 84, st->s);
+        put_f32le(h + 88, st->sep);
+        put_f32le(h + 92, st->cor);
+        put_f32le(h + 96, st->c38);
+        put_f32le(h + 100, st->ppm);
+    }
+    put_f32le(h + 104, f->nf->nf);
+    put_f32le(h + 108, f->nf->pilotSnr);
+    put_f32le(h + 112, f->nf->rdsSnr);
+
+    unsigned char *pl = h + FRAME_HEADER_BYTES;
+    if (format == OUT_F32) {
+        for (int k = 0; k < f->bins; k++) put_f32le(pl + 4 * k, f->spectrum[k]);
+    } else {
+        const float qmax = (format == OUT_U16) ? 65535.0f : 255.0f;
+        const float qscale = qmax / (FRAME_DB_MAX - FRAME_DB_MIN);
+        for (int k = 0; k < f->bins; k++) {
+            float db = 20.0f * log10f(f->spectrum[k] + 1e-12f);
+            float q = (db - FRAME_DB_MIN) * qscale + 0.5f;
+            q = clampf(q, 0.0f, qmax);
+            if (format == OUT_U16) put_u16le(pl + 2 * k, (uint16_t)q);
+            else pl[k] = (unsigned char)q;
+        }
+    }
+}
+
+static void Output_BinaryFrame(OutBuf *o, const OutputFrame *f, int format) {
+    size_t payload = binary_frame_payload(f, format);
+    if (!OutBuf_Reserve(o, FRAME_HEADER_BYTES + payload)) return;
+    Output_EncodeBinary(o->data + o->len, f, format);
+    o->len += FRAME_HEADER_BYTES + payload;
+}
+
+typedef struct {
+    uint32_t seq;
+    int source;
+    float audioMs, wallMs, rt;
+    float readMs, writeMs;
+    float stageMs[STAGE_COUNT];
+    uint32_t frames, dropsIn, dropsBlk, late, configGen;
+} StatsRecord;
+
+#define STATS_PAYLOAD_BYTES (44 + 4 * STAGE_COUNT)
+
+static void Output_JsonStats(OutBuf *o, const StatsRecord *r) {
+    char tmp[48];
+    int n = snprintf(tmp, sizeof(tmp), "{\"stats\":{\"src\":%d", r->source);
+    OutBuf_Append(o, tmp, (size_t)n);
+    OutBuf_Append(o, ",\"t\":", 5);      OutBuf_AppendFixed4(o, r->audioMs);
+    OutBuf_Append(o, ",\"wall\":", 8);   OutBuf_AppendFixed4(o, r->wallMs);
+    OutBuf_Append(o, ",\"rt\":", 6);     OutBuf_AppendFixed4(o, r->rt);
+    OutBuf_Append(o, ",\"read\":", 8);   OutBuf_AppendFixed4(o, r->readMs);
+    OutBuf_Append(o, ",\"write\":", 9);  OutBuf_AppendFixed4(o, r->writeMs);
+    OutBuf_Append(o, ",\"stage\":{", 10);
+    for (int k = 0; k < STAGE_COUNT; k++) {
+        n = snprintf(tmp, sizeof(tmp), "%s\"%s\":", k ? "," : "", G_StageNames[k]);
+        OutBuf_Append(o, tmp, (size_t)n);
+        OutBuf_AppendFixed4(o, r->stageMs[k]);
+    }
+    OutBuf_Append(o, "}", 1);
+    OutBuf_AppendInt(o, "frames", r->frames);
+    OutBuf_AppendInt(o, "dropIn", r->dropsIn);
+    OutBuf_AppendInt(o, "dropBlk", r->dropsBlk);
+    OutBuf_AppendInt(o, "late", r->late);
+    OutBuf_AppendInt(o, "cfg", r->configGen);
+    OutBuf_Append(o, "}}\n", 3);
+}
+
+static void Output_BinaryStats(OutBuf *o, const StatsRecord *r) {
+    if (!OutBuf_Reserve(o, FRAME_HEADER_BYTES + STATS_PAYLOAD_BYTES)) return;
+    unsigned char *h = o->data + o->len;
+    memset(h, 0, FRAME_HEADER_BYTES + STATS_PAYLOAD_BYTES);
+    put_u32le(h + 0, FRAME_MAGIC);
+    h[4] = FRAME_VERSION;
+    h[5] = FRAME_TYPE_STATS;
+    put_u16le(h + 6, FRAME_HEADER_BYTES);
+    put_u32le(h + 8, STATS_PAYLOAD_BYTES);
+    put_u32le(h + 12, r->seq);
+    put_f64le(h + 16, now_epoch_ms());
+    h[43] = (unsigned char)r->source;
+
+    unsigned char *pl = h + FRAME_HEADER_BYTES;
+    put_f32le(pl + 0, r->audioMs);
+    put_f32le(pl + 4, r->wallMs);
+    put_f32le(pl + 8, r->rt);
+    put_f32le(pl + 12, r->readMs);
+    put_f32le(pl + 16, r->writeMs);
+    put_u32le(pl + 20, r->frames);
+    put_u32le(pl + 24, r->dropsIn);
+    put_u32le(pl + 28, r->dropsBlk);
+    put_u32le(pl + 32, r->late);
+    put_u32le(pl + 36, r->configGen);
+    pl[40] = STAGE_COUNT;
+    for (int k = 0; k < STAGE_COUNT; k++) put_f32le(pl + 44 + 4 * k, r->stageMs[k]);
+    o->len += FRAME_HEADER_BYTES + STATS_PAYLOAD_BYTES;
+}
+
+/* ============================================================
+   SHARED-MEMORY OUTPUT (--output=shm)
+   ============================================================ */
+// Frames are written in place into a file in /dev/shm (POSIX shared
+// memory, --shm=PATH) instead of being piped. The reader takes the
+// newest complete frame whenever it likes; nothing is parsed.
+//
+// Header, little-endian:
+//   0  u32 magic 'MPXS'   4 u8 version   5 u8 sources   6 u16 header bytes
+//   8  u32 slot bytes     12 u32 slots per source
+//   16 u32 max bins       20 u32 writer pid
+//   64 u32 frames written, one per source (up to SHM_MAX_SOURCES)
+// Slot k of source s starts at header + (s * slots + k) * slot bytes and
+// frame n goes to slot n % slots:
+//   0  u32 lead sequence   4 u32 reserved
+//   8  binary frame as --output=binary (116-byte header, f32 payload)
+//   slot bytes - 4: u32 trail sequence
+// Seqlock: the writer sets trail to an odd value, writes the frame, then
+// sets lead and trail to the next even value. A reader copies the whole
+// slot front to back and keeps it only if lead == trail and it is even.
+//
+// stdout only gets one byte per SHM_HEARTBEAT_FRAMES frames, so the
+// process still notices when the server has gone away.
+#define SHM_MAGIC            0x5358504Du   /* "MPXS" */
+#define SHM_VERSION          1
+#define SHM_HEADER_BYTES     128
+#define SHM_MAX_SOURCES      16
+#define SHM_SLOTS            8
+#define SHM_SLOT_PREFIX      8
+#define SHM_HEARTBEAT_FRAMES 32
+
+static const char *G_ShmPath = "/dev/shm/metricsmonitor-mpx";
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t slotBytes;
+    int sources;
+    int maxBins;
+} ShmRing;
+
+static ShmRing G_Shm;
+
+static int Shm_Open(int sources, int maxBins) {
+    if (sources > SHM_MAX_SOURCES) sources = SHM_MAX_SOURCES;
+    size_t slotBytes = SHM_SLOT_PREFIX + FRAME_HEADER_BYTES + (size_t)maxBins * 4 + 4;
+    slotBytes = (slotBytes + 63) & ~(size_t)63;
+    size_t size = SHM_HEADER_BYTES + (size_t)sources * SHM_SLOTS * slotBytes;
+
+    int fd = open(G_ShmPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+        fprintf(stderr, "[MPX] shm: cannot create '%s': %s\n", G_ShmPath, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "[MPX] shm: mmap failed: %s\n", strerror(errno));
+        unlink(G_ShmPath);
+        return 0;
+    }
+
+    G_Shm.base = (unsigned char*)p;
+    G_Shm.size = size;
+    G_Shm.slotBytes = slotBytes;
+    G_Shm.sources = sources;
+    G_Shm.maxBins = maxBins;
+
+    // The file is zero-filled; the magic goes in last
+    unsigned char *h = G_Shm.base;
+    h[4] = SHM_VERSION;
+    h[5] = (unsigned char)sources;
+    put_u16le(h + 6, SHM_HEADER_BYTES);
+    put_u32le(h + 8, (uint32_t)slotBytes);
+    put_u32le(h + 12, SHM_SLOTS);
+    put_u32le(h + 16, (uint32_t)maxBins);
+    put_u32le(h + 20, (uint32_t)getpid());
+    atomic_thread_fence(memory_order_release);
+    put_u32le(h, SHM_MAGIC);
+
+    fprintf(stderr, "[MPX] shm: '%s', %d sources x %d slots x %zu bytes\n", G_ShmPath, sources, SHM_SLOTS, slotBytes);
+    return 1;
+}
+
+static void Shm_Close(void) {
+    if (!G_Shm.base) return;
+    munmap(G_Shm.base, G_Shm.size);
+    unlink(G_ShmPath);
+    memset(&G_Shm, 0, sizeof(G_Shm));
+}
+
+static inline _Atomic uint32_t* shm_u32(unsigned char *p) { return (_Atomic uint32_t*)(void*)p; }
+
+// Each source has exactly one writer thread.
+static void Shm_WriteFrame(const OutputFrame *f) {
+    if (f->source >= G_Shm.sources || f->bins > G_Shm.maxBins) return;
+
+    _Atomic uint32_t *written = shm_u32(G_Shm.base + 64 + 4 * f->source);
+    uint32_t n = atomic_load_explicit(written, memory_order_relaxed);
+    unsigned char *slot = G_Shm.base + SHM_HEADER_BYTES
+                        + ((size_t)f->source * SHM_SLOTS + n % SHM_SLOTS) * G_Shm.slotBytes;
+    _Atomic uint32_t *lead = shm_u32(slot);
+    _Atomic uint32_t *trail = shm_u32(slot + G_Shm.slotBytes - 4);
+
+    uint32_t seq = atomic_load_explicit(lead, memory_order_relaxed);
+    atomic_store_explicit(trail, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    Output_EncodeBinary(slot + SHM_SLOT_PREFIX, f, OUT_F32);
+
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(lead, seq + 2, memory_order_relaxed);
+    atomic_store_explicit(trail, seq + 2, memory_order_relaxed);
+    atomic_store_explicit(written, n + 1, memory_order_release);
+}
+#else
+static int Shm_Open(int sources, int maxBins) {
+    (void)sources; (void)maxBins;
+    fprintf(stderr, "[MPX] shm output is not available on Windows\n");
+    return 0;
+}
+static void Shm_Close(void) { }
+static void Shm_WriteFrame(const OutputFrame *f) { (void)f; }
+#endif
+
+static int Output_WriteFrame(OutBuf *o, const OutputFrame *f) {
+    if (G_OutputFormat == OUT_SHM) {
+        Shm_WriteFrame(f);
+        if (f->seq % SHM_HEARTBEAT_FRAMES != 0) return 1;
+        OutBuf_Append(o, "\n", 1);
+    } else if (G_OutputFormat == OUT_JSON) {
+        Output_JsonFrame(o, f);
+    } else {
+        Output_BinaryFrame(o, f, G_OutputFormat);
+    }
+    return Output_Flush(o);
+}
+
+static int Output_WriteStats(OutBuf *o, const StatsRecord *r) {
+    if (G_OutputFormat == OUT_JSON || G_OutputFormat == OUT_SHM) Output_JsonStats(o, r);
+    else Output_BinaryStats(o, r);
+    return Output_Flush(o);
+}
+
+#define RDS_PAYLOAD_BYTES 84
+#define RDS_RECORD_MS     1000
+
+// RDS characters as a JSON string body
+static void OutBuf_AppendRdsText(OutBuf *o, const char *text) {
+    char tmp[2 * RDS_RT_LEN];
+    size_t n = 0;
+    for (; *text && n < sizeof(tmp) - 1; text++) {
+        unsigned char c = (unsigned char)*text;
+        if (c == '"' || c == '\\') tmp[n++] = '\\';
+        tmp[n++] = (c >= 0x20 && c < 0x7F) ? (char)c : '?';
+    }
+    OutBuf_Append(o, tmp, n);
+}
+
+static void Output_JsonRds(OutBuf *o, const RdsInfo *r, int source) {
+    char tmp[96];
+    int n = snprintf(tmp, sizeof(tmp), "{\"rds\":{\"src\":%d,\"sync\":%d,\"pi\":\"", source, r->sync);
+    if (r->pi >= 0) n += snprintf(tmp + n, sizeof(tmp) - (size_t)n, "%04X", r->pi);
+    n += snprintf(tmp + n, sizeof(tmp) - (size_t)n, "\",\"pty\":%d,\"tp\":%d,\"ta\":%d,\"ms\":%d,\"ps\":\"",
+                  r->pty, r->tp, r->ta, r->ms);
+    OutBuf_Append(o, tmp, (size_t)n);
+    OutBuf_AppendRdsText(o, r->ps);
+    OutBuf_Append(o, "\",\"rt\":\"", 8);
+    OutBuf_AppendRdsText(o, r->rt);
+    OutBuf_Append(o, "\",\"bler\":", 9);  OutBuf_AppendFixed4(o, r->bler);
+    OutBuf_AppendInt(o, "groups", r->groups);
+    OutBuf_Append(o, "}}\n", 3);
+}
+
+static void Output_BinaryRds(OutBuf *o, const RdsInfo *r, int source, uint32_t seq) {
+    if (!OutBuf_Reserve(o, FRAME_HEADER_BYTES + RDS_PAYLOAD_BYTES)) return;
+    unsigned char *h = o->data + o->len;
+    memset(h, 0, FRAME_HEADER_BYTES + RDS_PAYLOAD_BYTES);
+    put_u32le(h + 0, FRAME_MAGIC);
+    h[4] = FRAME_VERSION;
+    h[5] = FRAME_TYPE_RDS;
+    put_u16le(h + 6, FRAME_HEADER_BYTES);
+    put_u32le(h + 8, RDS_PAYLOAD_BYTES);
+    put_u32le(h + 12, seq);
+    put_f64le(h + 16, now_epoch_ms());
+    h[43] = (unsigned char)source;
+
+    unsigned char *pl = h + FRAME_HEADER_BYTES;
+    put_u16le(pl + 0, (uint16_t)(r->pi >= 0 ? r->pi : 0));
+    pl[2] = (unsigned char)((r->sync ? 1 : 0) | (r->pi >= 0 ? 2 : 0) | (r->tp ? 4 : 0) | (r->ta ? 8 : 0) | (r->ms ? 16 : 0));
+    pl[3] = (unsigned char)r->pty;
+    put_f32le(pl + 4, r->bler);
+    put_u32le(pl + 8, r->groups);
+    memcpy(pl + 12, r->ps, strlen(r->ps));
+    memcpy(pl + 20, r->rt, strlen(r->rt));
+    o->len += FRAME_HEADER_BYTES + RDS_PAYLOAD_BYTES;
+}
+
+static int Output_WriteRds(OutBuf *o, const RdsInfo *r, int source, uint32_t seq) {
+    if (G_OutputFormat == OUT_JSON || G_OutputFormat == OUT_SHM) Output_JsonRds(o, r, source);
+    else Output_BinaryRds(o, r, source, seq);
+    return Output_Flush(o);
+}
+
+#define DEV_WINDOW_BYTES  (4 * (4 + DEV_PERCENTILES))
+#define DEV_PAYLOAD_BYTES (8 + DEV_WINDOWS * DEV_WINDOW_BYTES)
+
+static void Output_JsonDeviation(OutBuf *o, const DeviationInfo *d, int source) {
+    char tmp[48];
+    int n = snprintf(tmp, sizeof(tmp), "{\"dev\":{\"src\":%d,\"limit\":", source);
+    OutBuf_Append(o, tmp, (size_t)n);
+    OutBuf_AppendFixed4(o, d->limit);
+    for (int w = 0; w < DEV_WINDOWS; w++) {
+        const DevWindowInfo *wi = &d->w[w];
+        n = snprintf(tmp, sizeof(tmp), ",\"%s\":{\"s\":", G_DevWindowNames[w]);
+        OutBuf_Append(o, tmp, (size_t)n);
+        OutBuf_AppendFixed4(o, wi->seconds);
+        for (int p = 0; p < DEV_PERCENTILES; p++) {
+            n = snprintf(tmp, sizeof(tmp), ",\"%s\":", G_DevPercentileNames[p]);
+            OutBuf_Append(o, tmp, (size_t)n);
+            OutBuf_AppendFixed4(o, wi->pct[p]);
+        }
+        OutBuf_Append(o, ",\"max\":", 7);  OutBuf_AppendFixed4(o, wi->max);
+        OutBuf_Append(o, ",\"over\":", 8);  OutBuf_AppendFixed4(o, wi->over);
+        OutBuf_AppendInt(o, "events", wi->events);
+        OutBuf_Append(o, "}", 1);
+    }
+    OutBuf_Append(o, "}}\n", 3);
+}
+
+static void Output_BinaryDeviation(OutBuf *o, const DeviationInfo *d, int source, uint32_t seq) {
+    if (!OutBuf_Reserve(o, FRAME_HEADER_BYTES + DEV_PAYLOAD_BYTES)) return;
+    unsigned char *h = o->data + o->len;
+    memset(h, 0, FRAME_HEADER_BYTES + DEV_PAYLOAD_BYTES);
+    put_u32le(h + 0, FRAME_MAGIC);
+    h[4] = FRAME_VERSION;
+    h[5] = FRAME_TYPE_DEVIATION;
+    put_u16le(h + 6, FRAME_HEADER_BYTES);
+    put_u32le(h + 8, DEV_PAYLOAD_BYTES);
+    put_u32le(h + 12, seq);
+    put_f64le(h + 16, now_epoch_ms());
+    h[43] = (unsigned char)source;
+
+    unsigned char *pl = h + FRAME_HEADER_BYTES;
+    put_f32le(pl + 0, d->limit);
+    pl[4] = DEV_WINDOWS;
+    pl[5] = DEV_PERCENTILES;
+    for (int w = 0; w < DEV_WINDOWS; w++) {
+        const DevWindowInfo *wi = &d->w[w];
+        unsigned char *q = pl + 8 + w * DEV_WINDOW_BYTES;
+        put_f32le(q + 0, wi->seconds);
+        for (int p = 0; p < DEV_PERCENTILES; p++) put_f32le(q + 4 + 4 * p, wi->pct[p]);
+        q += 4 + 4 * DEV_PERCENTILES;
+        put_f32le(q + 0, wi->max);
+        put_f32le(q + 4, wi->over);
+        put_u32le(q + 8, wi->events);
+    }
+    o->len += FRAME_HEADER_BYTES + DEV_PAYLOAD_BYTES;
+}
+
+static int Output_WriteDeviation(OutBuf *o, const DeviationInfo *d, int source, uint32_t seq) {
+    if (G_OutputFormat == OUT_JSON || G_OutputFormat == OUT_SHM) Output_JsonDeviation(o, d, source);
+    else Output_BinaryDeviation(o, d, source, seq);
+    return Output_Flush(o);
+}
+
+static float zoom_db(float kHz) {
+    return (kHz > 0.0f) ? fmaxf(20.0f * log10f(kHz), FRAME_DB_MIN) : FRAME_DB_MIN;
+}
+
+static void Output_JsonZoom(OutBuf *o, const ZoomWindow *w, int source, uint32_t seq) {
+    const int bins = 2 * w->half + 1;
+    char tmp[96];
+    int n = snprintf(tmp, sizeof(tmp), "{\"zoom\":{\"src\":%d,\"id\":%d,\"seq\":%u,\"fc\":", source, w->id, seq);
+    OutBuf_Append(o, tmp, (size_t)n);
+    OutBuf_AppendFixed4(o, w->centre);
+    OutBuf_Append(o, ",\"span\":", 8);  OutBuf_AppendFixed4(o, w->span);
+    OutBuf_Append(o, ",\"df\":", 6);  OutBuf_AppendFixed4(o, w->binHz);
+    OutBuf_Append(o, ",\"f0\":", 6);  OutBuf_AppendFixed4(o, w->centre - (float)w->half * w->binHz);
+    OutBuf_AppendInt(o, "ffts", w->ampFrames);
+    OutBuf_AppendInt(o, "bins", bins);
+    OutBuf_Append(o, ",\"db\":[", 7);
+    for (int k = 0; k < bins; k++) {
+        if (k) OutBuf_Append(o, ",", 1);
+        OutBuf_AppendFixed4(o, zoom_db(w->amp[k]));
+    }
+    OutBuf_Append(o, "]}}\n", 4);
+}
+
+static void Output_BinaryZoom(OutBuf *o, const ZoomWindow *w, int source, uint32_t seq) {
+    const int bins = 2 * w->half + 1;
+    const size_t payload = 4 * (size_t)bins;
+    if (!OutBuf_Reserve(o, FRAME_HEADER_BYTES + payload)) return;
+    unsigned char *h = o->data + o->len;
+    memset(h, 0, FRAME_HEADER_BYTES);
+    put_u32le(h + 0, FRAME_MAGIC);
+    h[4] = FRAME_VERSION;
+    h[5] = FRAME_TYPE_ZOOM;
+    put_u16le(h + 6, FRAME_HEADER_BYTES);
+    put_u32le(h + 8, (uint32_t)payload);
+    put_u32le(h + 12, seq);
+    put_f64le(h + 16, now_epoch_ms());
+    put_f32le(h + 24, w->centre);
+    put_f32le(h + 28, w->span);
+    put_f32le(h + 32, w->binHz);
+    put_f32le(h + 36, w->centre - (float)w->half * w->binHz);
+    put_u16le(h + 40, (uint16_t)bins);
+    h[43] = (unsigned char)source;
+    h[44] = (unsigned char)w->id;
+    put_u32le(h + 48, (uint32_t)w->ampFrames);
+
+    unsigned char *pl = h + FRAME_HEADER_BYTES;
+    for (int k = 0; k < bins; k++) put_f32le(pl + 4 * k, zoom_db(w->amp[k]));
+    o->len += FRAME_HEADER_BYTES + payload;
+}
+
+// One record per window with a new average (Zoom_TakeRecord)
+static int Output_WriteZoom(OutBuf *o, const ZoomSpectrum *z, int source) {
+    for (int i = 0; i < z->count; i++) {
+        const ZoomWindow *w = &z->w[i];
+        if (w->ampFrames == 0) continue;
+        if (G_OutputFormat == OUT_JSON || G_OutputFormat == OUT_SHM) Output_JsonZoom(o, w, source, z->seq - 1);
+        else Output_BinaryZoom(o, w, source, z->seq - 1);
+    }
+    return Output_Flush(o);
+}
+
+static int parse_output_format(const char *v) {
+    if (strcmp(v, "json") == 0) return OUT_JSON;
+    if (strcmp(v, "f32") == 0 || strcmp(v, "binary") == 0) return OUT_F32;
+    if (strcmp(v, "u16") == 0 || strcmp(v, "binary16") == 0) return OUT_U16;
+    if (strcmp(v, "u8") == 0 || strcmp(v, "binary8") == 0) return OUT_U8;
+    if (strcmp(v, "shm") == 0) return OUT_SHM;
+    return -1;
+}
+
+/* ============================================================
+   SPECTRUM HISTORY (max/min hold, waterfall ring)
+   ============================================================ */
+// Kept per stream so a client gets traces and a waterfall without
+// rebuilding them from the full-resolution frames:
+//   - every frame's Welch average (before display smoothing) is reduced
+//     to SpectrumHistoryBins bins (peak per bucket, same scale as the
+//     display bins) and folded into max/min hold traces and into the
+//     waterfall row being built;
+//   - a row is closed every SpectrumHistoryInterval ms (in whole frames)
+//     as its per-bin maximum, quantized to u8 dB like --output=u8, and
+//     goes into a ring of SpectrumHistoryRows rows;
+//   - the hold traces restart every SpectrumHoldTime s (0 = only on a
+//     "reset-hold" control command) and when the layout changes.
+// Each new row is sent as a history record with rows = 1 together with
+// the current hold traces; a "history" control command makes every
+// stream send its whole ring once (full = 1), oldest row first.
+//
+// JSON (also in shm mode, on stdout like the stats records):
+//   {"hist":{"src":0,"seq":N,"full":0,"rows":1,"bins":256,"sc":"linear",
+//    "fl":0,"fh":96000,"dbMin":-140,"dbMax":20,"data":"<base64 rows x bins>",
+//    "max":"<base64>","min":"<base64>"}}
+// seq numbers rows; it is the sequence of the newest row in data. Bytes
+// are dB levels from dbMin (0) to dbMax (255), as in --output=u8.
+// Binary: frame type 3 with the spectrum header fields 0..23 (12 = seq),
+// 40 (bins), 43, 44, 48, 52, 56 and 60, plus 24 u32 rows and 28 u8 full;
+// payload rows x bins row bytes, then bins max-hold and bins min-hold.
+#define FRAME_TYPE_HISTORY 3
+
+atomic_uint G_HistoryRequests;  // "history" control commands
+atomic_uint G_HoldResets;       // "reset-hold" control commands
+
+typedef struct {
+    int rows, bins;             // 0 = off
+    int fftSize, scale;         // layout the ring was built for
+    BinMap map;                 // FFT bins -> history bins
+    float *cur;                 // bins, this frame
+    float *rowMax;              // bins, row being built
+    float *maxHold, *minHold;   // bins, linear amplitude
+    int rowFrames, framesPerRow;
+    int holdFrames, holdLimit;  // frames in the hold traces / reset period (0 = none)
+    unsigned int holdResets, requests;
+    unsigned char *ring;        // rows x bins, u8 dB
+    unsigned char *scratch;     // (rows + 2) x bins, record payload
+    int head, count;            // next row, rows stored
+    uint32_t seq;               // rows produced
+} SpectrumHistory;
+
+static void History_Free(SpectrumHistory *h) {
+    BinMap_Free(&h->map);
+    free(h->cur);
+    free(h->rowMax);
+    free(h->maxHold);
+    free(h->minHold);
+    free(h->ring);
+    free(h->scratch);
+    memset(h, 0, sizeof(SpectrumHistory));
+}
+
+// (Re)builds the history for a layout; rows = 0 turns it off. A new
+// layout starts an empty ring. Returns 0 if out of memory (history off).
+static int History_Configure(SpectrumHistory *h, int sr, int fftSize, int rows, int bins, int scale) {
+    if (bins >= fftSize / 2) bins = fftSize / 2 - 1;    // BinMap passes fftSize/2 through
+    if (rows == 0) bins = 0;
+    if (h->rows == rows && h->bins == bins && h->fftSize == fftSize && h->scale == scale) return 1;
+
+    uint32_t seq = h->seq;
+    History_Free(h);
+    h->seq = seq;           // rows keep counting; readers reset on a new bins / scale
+    h->fftSize = fftSize;
+    h->scale = scale;
+    h->holdResets = atomic_load(&G_HoldResets);
+    h->requests = atomic_load(&G_HistoryRequests);
+    if (rows == 0) return 1;
+
+    BinMap_Configure(&h->map, sr, fftSize, bins, scale, BINMODE_PEAK);
+    h->cur     = (float*)malloc(sizeof(float) * (size_t)bins);
+    h->rowMax  = (float*)calloc((size_t)bins, sizeof(float));
+    h->maxHold = (float*)malloc(sizeof(float) * (size_t)bins);
+    h->minHold = (float*)malloc(sizeof(float) * (size_t)bins);
+    h->ring    = (unsigned char*)calloc((size_t)rows * (size_t)bins, 1);
+    h->scratch = (unsigned char*)malloc((size_t)(rows + 2) * (size_t)bins);
+    if (!h->map.lo || !h->cur || !h->rowMax || !h->maxHold || !h->minHold || !h->ring || !h->scratch) {
+        History_Free(h);
+        h->seq = seq;
+        fprintf(stderr, "[MPX] History: out of memory, disabled\n");
+        return 0;
+    }
+    h->rows = rows;
+    h->bins = bins;
+    return 1;
+}
+
+static void History_SetTiming(SpectrumHistory *h, int sendIntervalMs, int rowMs, float holdSeconds) {
+    if (sendIntervalMs < 1) sendIntervalMs = 1;
+    h->framesPerRow = (rowMs + sendIntervalMs / 2) / sendIntervalMs;
+    if (h->framesPerRow < 1) h->framesPerRow = 1;
+    h->holdLimit = (int)lroundf(holdSeconds * 1000.0f / (float)sendIntervalMs);
+}
+
+static inline unsigned char history_db_u8(float amp) {
+    float db = 20.0f * log10f(amp * SPECTRUM_DISPLAY_GAIN + 1e-12f);
+    float q = (db - FRAME_DB_MIN) * (255.0f / (FRAME_DB_MAX - FRAME_DB_MIN)) + 0.5f;
+    return (unsigned char)clampf(q, 0.0f, 255.0f);
+}
+
+// amp: fftSize/2 Welch amplitudes of one frame. Returns 1 if a row was
+// completed.
+static int History_Push(SpectrumHistory *h, const float *amp) {
+    if (h->rows == 0) return 0;
+    const int bins = h->bins;
+    BinMap_Reduce(&h->map, amp, h->cur);
+
+    unsigned int resets = atomic_load_explicit(&G_HoldResets, memory_order_relaxed);
+    if (resets != h->holdResets || (h->holdLimit > 0 && h->holdFrames >= h->holdLimit)) {
+        h->holdResets = resets;
+        h->holdFrames = 0;
+    }
+    if (h->holdFrames++ == 0) {
+        memcpy(h->maxHold, h->cur, sizeof(float) * (size_t)bins);
+        memcpy(h->minHold, h->cur, sizeof(float) * (size_t)bins);
+    } else {
+        for (int j = 0; j < bins; j++) {
+            if (h->cur[j] > h->maxHold[j]) h->maxHold[j] = h->cur[j];
+            if (h->cur[j] < h->minHold[j]) h->minHold[j] = h->cur[j];
+        }
+    }
+
+    for (int j = 0; j < bins; j++) if (h->cur[j] > h->rowMax[j]) h->rowMax[j] = h->cur[j];
+    if (++h->rowFrames < h->framesPerRow) return 0;
+
+    unsigned char *row = h->ring + (size_t)h->head * (size_t)bins;
+    for (int j = 0; j < bins; j++) row[j] = history_db_u8(h->rowMax[j]);
+    memset(h->rowMax, 0, sizeof(float) * (size_t)bins);
+    h->rowFrames = 0;
+    h->head = (h->head + 1) % h->rows;
+    if (h->count < h->rows) h->count++;
+    h->seq++;
+    return 1;
+}
+
+static const char G_Base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void OutBuf_AppendBase64(OutBuf *o, const unsigned char *p, size_t n) {
+    if (!OutBuf_Reserve(o, (n + 2) / 3 * 4)) return;
+    char *d = (char*)o->data + o->len;
+    size_t i = 0;
+    for (; i + 2 < n; i += 3) {
+        uint32_t v = ((uint32_t)p[i] << 16) | ((uint32_t)p[i + 1] << 8) | p[i + 2];
+        *d++ = G_Base64[v >> 18];        *d++ = G_Base64[(v >> 12) & 63];
+        *d++ = G_Base64[(v >> 6) & 63];  *d++ = G_Base64[v & 63];
+    }
+    if (i < n) {
+        uint32_t v = (uint32_t)p[i] << 16;
+        if (i + 1 < n) v |= (uint32_t)p[i + 1] << 8;
+        *d++ = G_Base64[v >> 18];
+        *d++ = G_Base64[(v >> 12) & 63];
+        *d++ = (i + 1 < n) ? G_Base64[(v >> 6) & 63] : '=';
+        *d++ = '=';
+    }
+    o->len = (size_t)((unsigned char*)d - o->data);
+}
+
+// Lays out rows (oldest first), max and min hold in h->scratch.
+// full = 0: the newest row only. Returns the number of rows.
+static int History_Snapshot(SpectrumHistory *h, int full) {
+    const int bins = h->bins;
+    int rows = full ? h->count : 1;
+    unsigned char *d = h->scratch;
+    for (int k = 0; k < rows; k++) {
+        int r = (h->head - rows + k + h->rows) % h->rows;
+        memcpy(d, h->ring + (size_t)r * (size_t)bins, (size_t)bins);
+        d += bins;
+    }
+    for (int j = 0; j < bins; j++) d[j] = history_db_u8(h->maxHold[j]);
+    d += bins;
+    for (int j = 0; j < bins; j++) d[j] = history_db_u8(h->minHold[j]);
+    return rows;
+}
+
+static void Output_JsonHistory(OutBuf *o, const SpectrumHistory *h, int source, int full, int rows) {
+    char tmp[128];
+    const size_t bins = (size_t)h->bins;
+    int n = snprintf(tmp, sizeof(tmp), "{\"hist\":{\"src\":%d,\"seq\":%u,\"full\":%d,\"rows\":%d,\"bins\":%d,\"sc\":\"%s\"",
+                     source, h->seq - 1, full, rows, h->bins, binScaleNames[h->map.scale]);
+    OutBuf_Append(o, tmp, (size_t)n);
+    OutBuf_Append(o, ",\"fl\":", 6);  OutBuf_AppendFixed4(o, h->map.fLow);
+    OutBuf_Append(o, ",\"fh\":", 6);  OutBuf_AppendFixed4(o, h->map.fHigh);
+    OutBuf_Append(o, ",\"dbMin\":", 9);  OutBuf_AppendFixed4(o, FRAME_DB_MIN);
+    OutBuf_Append(o, ",\"dbMax\":", 9);  OutBuf_AppendFixed4(o, FRAME_DB_MAX);
+    OutBuf_Append(o, ",\"data\":\"", 9);  OutBuf_AppendBase64(o, h->scratch, (size_t)rows * bins);
+    OutBuf_Append(o, "\",\"max\":\"", 9); OutBuf_AppendBase64(o, h->scratch + (size_t)rows * bins, bins);
+    OutBuf_Append(o, "\",\"min\":\"", 9); OutBuf_AppendBase64(o, h->scratch + (size_t)(rows + 1) * bins, bins);
+    OutBuf_Append(o, "\"}}\n", 4);
+}
+
+static void Output_BinaryHistory(OutBuf *o, const SpectrumHistory *h, int source, int full, int rows) {
+    size_t payload = (size_t)(rows + 2) * (size_t)h->bins;
+    if (!OutBuf_Reserve(o, FRAME_HEADER_BYTES + payload)) return;
+    unsigned char *b = o->data + o->len;
+    memset(b, 0, FRAME_HEADER_BYTES);
+    put_u32le(b + 0, FRAME_MAGIC);
+    b[4] = FRAME_VERSION;
+    b[5] = FRAME_TYPE_HISTORY;
+    put_u16le(b + 6, FRAME_HEADER_BYTES);
+    put_u32le(b + 8, (uint32_t)payload);
+    put_u32le(b + 12, h->seq - 1);
+    put_f64le(b + 16, now_epoch_ms());
+    put_u32le(b + 24, (uint32_t)rows);
+    b[28] = (unsigned char)full;
+    put_u16le(b + 40, (uint16_t)h->bins);
+    b[42] = 2;      // u8 dB
+    b[43] = (unsigned char)source;
+    put_f32le(b + 44, FRAME_DB_MIN);
+    put_f32le(b + 48, FRAME_DB_MAX);
+    b[52] = (unsigned char)h->map.scale;
+    b[53] = 1;      // peak
+    put_f32le(b + 56, h->map.fLow);
+    put_f32le(b + 60, h->map.fHigh);
+    memcpy(b + FRAME_HEADER_BYTES, h->scratch, payload);
+    o->len += FRAME_HEADER_BYTES + payload;
+}
+
+// full = 0: the row History_Push() just completed.
+static int Output_WriteHistory(OutBuf *o, SpectrumHistory *h, int source, int full) {
+    if (h->rows == 0 || h->count == 0) return 1;
+    int rows = History_Snapshot(h, full);
+    if (G_OutputFormat == OUT_JSON || G_OutputFormat == OUT_SHM) Output_JsonHistory(o, h, source, full, rows);
+    else Output_BinaryHistory(o, h, source, full, rows);
+    return Output_Flush(o);
+}
+
+/* ============================================================
+   METRICS ARCHIVE (--archive=PATH, memory-mapped ring file)
+   ============================================================ */
+// Per-second aggregates of the meter readings of one source
+// (--archive-source=N) go into a file that survives restarts, with a
+// 1-minute rollup tier next to them. Each tier is a ring of fixed-size
+// records in time order, so a reader finds the start of a range by
+// binary search over the record times and then reads sequentially. The
+// file is mmap'd and written back by the kernel; nothing on the output
+// path waits for the disk. Times are wall clock.
+//
+// Header, little-endian:
+//   0  u32 magic 'MPXA'   4 u8 version   5 u8 tiers   6 u16 header bytes
+//   8  u32 record bytes   12 u32 source
+//   16 per tier (1 s, 1 min), 24 bytes: u32 seconds per record,
+//      u32 capacity, u32 records written, u32 reserved, u64 ring offset
+// Record n of a tier is at ring offset + (n % capacity) * record bytes:
+//   0  u32 time (Unix seconds, start of the interval)
+//   4  u16 readings (frames aggregated, saturating)
+//   6  u8 flags (1 noise floor valid)   7 u8 reserved
+//   8  p, r, m, b, nf (as in OUTPUT), each f32 min, f32 max, f32 mean
+// "Records written" is stored after the record is complete. A reader
+// uses at most capacity - 1 records ending at written - 1, so the slot
+// being overwritten is never among them. Times never decrease: if the
+// clock steps back, readings fold into the open interval until the
+// clock has passed it. A file with another layout (--archive-days,
+// source) is reset. After a restart, a newest record whose interval is
+// still open is taken back and rewritten in place, so no time appears
+// twice.
+#define ARCHIVE_MAGIC        0x4158504Du   /* "MPXA" */
+#define ARCHIVE_VERSION      1
+#define ARCHIVE_HEADER_BYTES 4096
+#define ARCHIVE_TIERS        2
+#define ARCHIVE_METRICS      5
+#define ARCHIVE_RECORD_BYTES (8 + ARCHIVE_METRICS * 12)
+#define ARCHIVE_MAX_DAYS     366
+
+static const char *G_ArchivePath = NULL;
+static int G_ArchiveSource = 0;
+static int G_ArchiveDays[ARCHIVE_TIERS] = { 7, 90 };
+static const int G_ArchiveInterval[ARCHIVE_TIERS] = { 1, 60 };
+
+#ifndef _WIN32
+typedef struct {
+    uint32_t time;                      // interval start
+    uint32_t readings, nfReadings;
+    float min[ARCHIVE_METRICS], max[ARCHIVE_METRICS];
+    double sum[ARCHIVE_METRICS];
+} ArchiveAcc;
+
+static void ArchiveAcc_Start(ArchiveAcc *a, uint32_t time) {
+    memset(a, 0, sizeof(ArchiveAcc));
+    a->time = time;
+    for (int k = 0; k < ARCHIVE_METRICS; k++) {
+        a->min[k] = INFINITY;
+        a->max[k] = -INFINITY;
+    }
+}
+
+// Folds `n` readings (nf: nfN of them) with the given min / max / sum into a
+static void ArchiveAcc_Merge(ArchiveAcc *a, const float *mn, const float *mx, const double *sum,
+                             uint32_t n, uint32_t nfN) {
+    for (int k = 0; k < ARCHIVE_METRICS; k++) {
+        if (k == ARCHIVE_METRICS - 1 && nfN == 0) break;
+        if (mn[k] < a->min[k]) a->min[k] = mn[k];
+        if (mx[k] > a->max[k]) a->max[k] = mx[k];
+        a->sum[k] += sum[k];
+    }
+    a->readings += n;
+    a->nfReadings += nfN;
+}
+
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    uint32_t capacity[ARCHIVE_TIERS];
+    uint64_t offset[ARCHIVE_TIERS];
+    uint32_t written[ARCHIVE_TIERS];
+    ArchiveAcc acc[ARCHIVE_TIERS];      // open interval per tier
+} MetricsArchive;
+
+static MetricsArchive G_Archive;
+
+static unsigned char* Archive_Tier(int t) { return G_Archive.base + 16 + 24 * t; }
+
+static unsigned char* Archive_Record(int t, uint32_t n) {
+    return G_Archive.base + G_Archive.offset[t] + (size_t)(n % G_Archive.capacity[t]) * ARCHIVE_RECORD_BYTES;
+}
+
+static int Archive_HeaderMatches(void) {
+    const unsigned char *h = G_Archive.base;
+    if (get_u32le(h) != ARCHIVE_MAGIC || h[4] != ARCHIVE_VERSION || h[5] != ARCHIVE_TIERS ||
+        get_u32le(h + 8) != ARCHIVE_RECORD_BYTES || get_u32le(h + 12) != (uint32_t)G_ArchiveSource) return 0;
+    for (int t = 0; t < ARCHIVE_TIERS; t++) {
+        const unsigned char *th = Archive_Tier(t);
+        if (get_u32le(th) != (uint32_t)G_ArchiveInterval[t] || get_u32le(th + 4) != G_Archive.capacity[t]) return 0;
+    }
+    return 1;
+}
+
+// Record n of tier t as an open interval. The file keeps means and
+// only a flag for nf, so nf counts as read with every reading.
+static void Archive_Load(int t, uint32_t n, ArchiveAcc *a) {
+    const unsigned char *r = Archive_Record(t, n);
+    uint32_t readings = get_u16le(r + 4), nfReadings = (r[6] & 1) ? readings : 0;
+    ArchiveAcc_Start(a, get_u32le(r));
+    for (int k = 0; k < ARCHIVE_METRICS; k++) {
+        uint32_t cnt = (k == ARCHIVE_METRICS - 1) ? nfReadings : readings;
+        const unsigned char *q = r + 8 + 12 * k;
+        if (cnt == 0) continue;
+        a->min[k] = get_f32le(q + 0);
+        a->max[k] = get_f32le(q + 4);
+        a->sum[k] = (double)get_f32le(q + 8) * cnt;
+    }
+    a->readings = readings;
+    a->nfReadings = nfReadings;
+}
+
+// Takes the newest record of tier t back; the next Archive_Write
+// replaces it
+static void Archive_Unwrite(int t) {
+    uint32_t n = --G_Archive.written[t];
+    atomic_store_explicit(shm_u32(Archive_Tier(t) + 8), n, memory_order_release);
+}
+
+// Continues after the newest record of each tier. A record whose
+// interval has not ended yet (restart within the same second / minute,
+// or the clock stepped back) is reopened instead, so that the readings
+// still to come merge into it rather than follow it with the same time.
+static void Archive_Resume(void) {
+    ArchiveAcc *s = &G_Archive.acc[0], *m = &G_Archive.acc[1];
+    uint32_t now = (uint32_t)(now_epoch_ms() / 1000.0);
+    for (int t = 0; t < ARCHIVE_TIERS; t++) {
+        uint32_t n = get_u32le(Archive_Tier(t) + 8);
+        G_Archive.written[t] = n;
+        ArchiveAcc_Start(&G_Archive.acc[t], n > 0 ? get_u32le(Archive_Record(t, n - 1)) : 0);
+    }
+    if (G_Archive.written[0] > 0 && s->time >= now) {
+        Archive_Load(0, G_Archive.written[0] - 1, s);
+        Archive_Unwrite(0);
+    }
+    if (G_Archive.written[1] > 0 && m->time >= now - now % 60) {
+        // Rebuilt from its seconds still in the file: the one reopened
+        // above is folded in again when it closes
+        Archive_Unwrite(1);
+        for (uint32_t k = 1; k < G_Archive.capacity[0] && k <= G_Archive.written[0]; k++) {
+            ArchiveAcc a;
+            Archive_Load(0, G_Archive.written[0] - k, &a);
+            if (a.time < m->time) break;
+            ArchiveAcc_Merge(m, a.min, a.max, a.sum, a.readings, a.nfReadings);
+        }
+    }
+}
+
+static int Archive_Open(void) {
+    size_t size = ARCHIVE_HEADER_BYTES;
+    for (int t = 0; t < ARCHIVE_TIERS; t++) {
+        int days = G_ArchiveDays[t];
+        if (days < 1) days = 1;
+        if (days > ARCHIVE_MAX_DAYS) days = ARCHIVE_MAX_DAYS;
+        G_Archive.capacity[t] = (uint32_t)(days * 86400 / G_ArchiveInterval[t]);
+        G_Archive.offset[t] = size;
+        size += (size_t)G_Archive.capacity[t] * ARCHIVE_RECORD_BYTES;
+    }
+
+    int fd = open(G_ArchivePath, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "[MPX] archive: cannot open '%s': %s\n", G_ArchivePath, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    // Other size: start over with an empty (sparse) file
+    int sameSize = (size_t)st.st_size == size;
+    if (!sameSize && (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0)) {
+        fprintf(stderr, "[MPX] archive: cannot size '%s': %s\n", G_ArchivePath, strerror(errno));
+        close(fd);
+        return 0;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "[MPX] archive: mmap failed: %s\n", strerror(errno));
+        return 0;
+    }
+    G_Archive.base = (unsigned char*)p;
+    G_Archive.size = size;
+
+    unsigned char *h = G_Archive.base;
+    if (sameSize && Archive_HeaderMatches()) {
+        Archive_Resume();
+    } else {
+        memset(h, 0, ARCHIVE_HEADER_BYTES);
+        h[4] = ARCHIVE_VERSION;
+        h[5] = ARCHIVE_TIERS;
+        put_u16le(h + 6, ARCHIVE_HEADER_BYTES);
+        put_u32le(h + 8, ARCHIVE_RECORD_BYTES);
+        put_u32le(h + 12, (uint32_t)G_ArchiveSource);
+        for (int t = 0; t < ARCHIVE_TIERS; t++) {
+            unsigned char *th = Archive_Tier(t);
+            put_u32le(th, (uint32_t)G_ArchiveInterval[t]);
+            put_u32le(th + 4, G_Archive.capacity[t]);
+            put_u32le(th + 16, (uint32_t)G_Archive.offset[t]);
+            put_u32le(th + 20, (uint32_t)(G_Archive.offset[t] >> 32));
+            ArchiveAcc_Start(&G_Archive.acc[t], 0);
+        }
+        atomic_thread_fence(memory_order_release);
+        put_u32le(h, ARCHIVE_MAGIC);
+    }
+    fprintf(stderr, "[MPX] archive: '%s', source %d, %u s records (%u in file), %u min records (%u in file)\n",
+            G_ArchivePath, G_ArchiveSource, G_Archive.capacity[0], G_Archive.written[0],
+            G_Archive.capacity[1], G_Archive.written[1]);
+    return 1;
+}
+
+static void Archive_Write(int t) {
+    const ArchiveAcc *a = &G_Archive.acc[t];
+    uint32_t n = G_Archive.written[t];
+    unsigned char *r = Archive_Record(t, n);
+    put_u32le(r + 0, a->time);
+    put_u16le(r + 4, (uint16_t)(a->readings < 65535 ? a->readings : 65535));
+    r[6] = a->nfReadings > 0 ? 1 : 0;
+    r[7] = 0;
+    for (int k = 0; k < ARCHIVE_METRICS; k++) {
+        uint32_t cnt = (k == ARCHIVE_METRICS - 1) ? a->nfReadings : a->readings;
+        unsigned char *q = r + 8 + 12 * k;
+        put_f32le(q + 0, cnt ? a->min[k] : 0.0f);
+        put_f32le(q + 4, cnt ? a->max[k] : 0.0f);
+        put_f32le(q + 8, cnt ? (float)(a->sum[k] / (double)cnt) : 0.0f);
+    }
+    G_Archive.written[t] = n + 1;
+    atomic_store_explicit(shm_u32(Archive_Tier(t) + 8), n + 1, memory_order_release);
+}
+
+// Writes the open second and folds it into the open minute
+static void Archive_CloseSecond(void) {
+    ArchiveAcc *s = &G_Archive.acc[0], *m = &G_Archive.acc[1];
+    uint32_t minute = s->time - s->time % 60;
+    Archive_Write(0);
+    if (minute > m->time) {
+        if (m->readings > 0) Archive_Write(1);
+        ArchiveAcc_Start(m, minute);
+    }
+    ArchiveAcc_Merge(m, s->min, s->max, s->sum, s->readings, s->nfReadings);
+    ArchiveAcc_Start(s, s->time);
+}
+
+// One reading per output frame: p, r, m, b, nf (nf only if nfValid)
+static void Archive_Add(const float *v, int nfValid) {
+    if (!G_Archive.base) return;
+    ArchiveAcc *s = &G_Archive.acc[0];
+    uint32_t now = (uint32_t)(now_epoch_ms() / 1000.0);
+    if (now > s->time) {
+        if (s->readings > 0) Archive_CloseSecond();
+        ArchiveAcc_Start(s, now);
+    }
+    double sum[ARCHIVE_METRICS];
+    for (int k = 0; k < ARCHIVE_METRICS; k++) sum[k] = v[k];
+    ArchiveAcc_Merge(s, v, v, sum, 1, nfValid ? 1 : 0);
+}
+
+// Keeps what is open, then unmaps (the file stays)
+static void Archive_Close(void) {
+    if (!G_Archive.base) return;
+    if (G_Archive.acc[0].readings > 0) Archive_CloseSecond();
+    if (G_Archive.acc[1].readings > 0) Archive_Write(1);
+    munmap(G_Archive.base, G_Archive.size);
+    memset(&G_Archive, 0, sizeof(G_Archive));
+}
+#else
+static int Archive_Open(void) {
+    fprintf(stderr, "[MPX] archive is not available on Windows\n");
+    return 0;
+}
+static void Archive_Add(const float *v, int nfValid) { (void)v; (void)nfValid; }
+static void Archive_Close(void) { }
+#endif
+
+/* ============================================================
+   SAMPLE FORMATS
+   ============================================================ */
+// Raw input blocks stay in the capture format (S16_LE at 192 kHz stereo
+// is half the pipe bandwidth of FLOAT_LE). Once the channel is locked,
+// only that channel is converted, with BASE_PREAMP and the meter gain
+// folded into the integer full-scale factor: one pass per block.
+enum { SAMPLE_FLOAT_LE = 0, SAMPLE_S16_LE = 1, SAMPLE_S24_3LE = 2, SAMPLE_S32_LE = 3 };
+
+static const char *G_SampleFormatNames[] = { "FLOAT_LE", "S16_LE", "S24_3LE", "S32_LE" };
+static const int G_SampleBytes[] = { 4, 2, 3, 4 };
+static const float G_SampleFullScale[] = { 1.0f, 1.0f / 32768.0f, 1.0f / 2147483648.0f, 1.0f / 2147483648.0f };
+
+#define MAX_FRAME_BYTES 8   // 2 channels x 4 bytes
+#define BLOCK_MAX_BYTES (BLOCK_FRAMES * MAX_FRAME_BYTES)
+
+static int parse_sample_format(const char *v) {
+    char up[16];
+    size_t n = 0;
+    for (; v[n] && n < sizeof(up) - 1; n++) up[n] = (char)toupper((unsigned char)v[n]);
+    up[n] = 0;
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(up, G_SampleFormatNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// Sample idx (already multiplied by the channel stride) as float, unscaled
+static inline float sample_at(const void *in, int format, int idx) {
+    switch (format) {
+        case SAMPLE_S16_LE: return (float)((const int16_t*)in)[idx];
+        case SAMPLE_S32_LE: return (float)((const int32_t*)in)[idx];
+        case SAMPLE_S24_3LE: {
+            const uint8_t *p = (const uint8_t*)in + (size_t)idx * 3;
+            return (float)(int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+        }
+        default: return ((const float*)in)[idx];
+    }
+}
+
+// out[i] = channel ch of frame i * gain. Each format is a plain strided
+// loop so the compiler vectorizes it.
+static void convert_channel(const void *in, int format, int channels, int ch, float gain, float *out, int n) {
+    const float g = gain * G_SampleFullScale[format];
+    switch (format) {
+        case SAMPLE_S16_LE: {
+            const int16_t *s = (const int16_t*)in + ch;
+            for (int i = 0; i < n; i++) out[i] = (float)s[i * channels] * g;
+            break;
+        }
+        case SAMPLE_S32_LE: {
+            const int32_t *s = (const int32_t*)in + ch;
+            for (int i = 0; i < n; i++) out[i] = (float)s[i * channels] * g;
+            break;
+        }
+        case SAMPLE_S24_3LE: {
+            const uint8_t *s = (const uint8_t*)in + ch * 3;
+            const int stride = channels * 3;
+            for (int i = 0; i < n; i++) {
+                const uint8_t *p = s + i * stride;
+                int32_t v = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+                out[i] = (float)v * g;
+            }
+            break;
+        }
+        default: {
+            const float *s = (const float*)in + ch;
+            for (int i = 0; i < n; i++) out[i] = s[i * channels] * g;
+            break;
+        }
+    }
+}
+
+/* ============================================================
+   PROCESSING STAGES
+   ============================================================ */
+// The work per input block is split in two stages so that they can run
+// on separate threads (see PIPELINE):
+//   MeterStage     channel select, DC blocker, BS.412, true peak, demod.
+//                  Produces the DC-blocked samples plus an OutputMark for
+//                  every output point, snapshotting the meter values.
+//   SpectrumOutput STFT, display bins, smoothing and frame output, driven
+//                  by the samples and marks of each MeterBlock.
+// Run back to back they give exactly the single-loop results.
+#define BLOCK_MAX_MARKS 64
+#define MIN_OUTPUT_SAMPLES (BLOCK_FRAMES / BLOCK_MAX_MARKS)
+
+typedef struct {
+    int pos;                // samples into the block
+    float p, r, m, b;
+    float b10, b60;         // max BS.412 dBr over the last 10 / 60 minutes
+    StereoInfo st;
+} OutputMark;
+
+// Spectrum settings of the config snapshot the block was metered with
+// (see CONFIG SNAPSHOT). windowTable belongs to the snapshot.
+typedef struct {
+    unsigned int generation;
+    float gain, attack, decay;
+    float mpxScale;         // kHz per unit of the metered samples (noise floor)
+    int overlap;
+    int bins, binScale, binMode;
+    int fftSize, window;
+    const float *windowTable;
+    float windowNorm;
+    int sendInterval;
+    int historyRows, historyBins, historyInterval;
+    float holdTime;
+    int zoomCount, zoomFftSize;
+    float zoomCentre[ZOOM_MAX_WINDOWS], zoomSpan[ZOOM_MAX_WINDOWS];
+} SpectrumSettings;
+
+typedef struct {
+    float x[BLOCK_FRAMES];  // DC-blocked, x MeterGain (settings.gain is relative to it)
+    int nMarks;
+    OutputMark marks[BLOCK_MAX_MARKS];
+    SpectrumSettings settings;
+    int rdsOn;              // RdsDecoder on: rds is its state after the block
+    RdsInfo rds;
+    int devOn;              // DeviationHistogram on: dev is its last summary
+    DeviationInfo dev;
+} MeterBlock;
+
+typedef struct {
+    int sr;
+    int format;             // SAMPLE_*
+    int channels;           // 1 or 2
+    int frameBytes;
+
+    // Channel lock
+    int active_channel;
+    int channel_locked;
+    double energyL, energyR;
+    int energy_samples;
+
+    DCBlocker dcBlocker;
+
+    // BS.412: exact 60-second window
+    Bs412Meter bs412;
+
+    MpxDemodulator demod;
+    RdsDecoder rds;         // demod.rds while RdsDecoder is on
+    StereoMeter stereo;     // demod.stereo while StereoMetrics is on
+    BiQuadFilter mpxPeakLpf;
+    TruePeakN tpN;
+    PeakHoldRelease mpxEnv;
+    DevHistogram dev;       // while DeviationHistogram is on
+    int devOn;
+
+    // Display smoothing
+    float smoothP;
+    float smoothR;
+
+    int counter;
+    int pollConfig;         // this stage reloads the config (one per process, only without a config thread)
+    StreamStats *stats;     // of the stream (owned by its SpectrumOutput), may be NULL
+    int configCheckCounter;
+    unsigned int configGen; // snapshot the threshold was computed for
+    int outputSampleThreshold;
+
+    // Per-block work buffers
+    float peakBuf[BLOCK_FRAMES];   // peak path (LPF) -> per-sample true peak
+} MeterStage;
+
+typedef struct {
+    int sr, fftSize, maxBin;
+    SpectrumStage spec;
+    BinMap binMap;
+    SpectrumSettings applied;
+    int configReader;               // Config_Ack slot
+    unsigned int resizeFailedGen;   // generation whose fftSize did not fit, not retried
+    float *specAmp;
+    float *smoothBuf;
+    float *binBuf;
+    uint32_t frameSeq;
+    int sourceId;
+    OutBuf out;
+    SpectrumHistory hist;
+    NoiseTracker noise;
+    NoiseInfo noiseInfo;    // of the last frame
+    uint32_t rdsSeq, rdsRecords;    // RdsInfo.seq of the last RDS record
+    long long rdsBlocks;            // blocks since
+    uint32_t devSeq, devRecords;    // DeviationInfo.seq of the last deviation record
+    ZoomSpectrum zoom;              // while ZoomSpectrum is set
+
+    // Stats (--stats=MS)
+    StreamStats stats;
+    StatsSnapshot statsPrev;
+    long long blocksSeen;
+    double statsAudioMs;    // audio position of the last record
+    uint64_t statsWallNs;   // and its wall clock
+    uint32_t statsFrames, statsSeq;
+    double lateAudioMs;     // audio / wall reference for late frames
+    uint64_t lateWallNs;
+} SpectrumOutput;
+
+static int output_threshold_samples(int sr, int intervalMs) {
+    int t = (sr * intervalMs) / 1000;
+    return (t < MIN_OUTPUT_SAMPLES) ? MIN_OUTPUT_SAMPLES : t;
+}
+
+static void MeterStage_Init(MeterStage *ms, int sr, int format, int channels) {
+    memset(ms, 0, sizeof(MeterStage));
+    ms->sr = sr;
+    ms->format = format;
+    ms->channels = channels;
+    ms->frameBytes = G_SampleBytes[format] * channels;
+
+    // --- DC BLOCKER INIT ---
+    DCBlocker_Init(&ms->dcBlocker);
+
+    // --- BS.412 INIT ---
+    Bs412_Init(&ms->bs412, sr);
+
+    // Demod
+    MpxDemod_Init(&ms->demod, sr);
+    Rds_Init(&ms->rds, ms->demod.decimRate);
+    Stereo_Init(&ms->stereo, ms->demod.decim, ms->demod.decimRate);
+
+    // Peak-path LPF (~100kHz, clamped)
+    BiQuad_Init(&ms->mpxPeakLpf);
+    float cutoff = 100000.0f;
+    float maxSafe = 0.45f * (float)sr;
+    if (cutoff > maxSafe) cutoff = maxSafe;
+    BiQuad_LowPass(&ms->mpxPeakLpf, (float)sr, cutoff, 0.707f);
+    fprintf(stderr, "[MPX] Peak-path LPF cutoff: %.1f Hz (requested 100kHz, clamped if needed)\n", cutoff);
+
+    // MPX TruePeak + Envelope
+    TruePeakN_Init(&ms->tpN);
+    PeakHoldRelease_Init(&ms->mpxEnv, sr, 200.0f, 1500.0f);
+
+    const MpxConfig *cfg = Config_Current();
+    Dev_Init(&ms->dev, sr, cfg->v.deviationLimit);
+    ms->outputSampleThreshold = output_threshold_samples(sr, cfg->v.sendInterval);
+    ms->configGen = cfg->generation;
+    ms->pollConfig = 1;
+}
+
+// Analyse a fixed channel instead of locking onto the louder one
+static void MeterStage_FixChannel(MeterStage *ms, int channel) {
+    ms->active_channel = channel;
+    ms->channel_locked = 1;
+}
+
+static void snapshot_spectrum_settings(SpectrumSettings *s, const MpxConfig *cfg) {
+    s->generation = cfg->generation;
+    s->gain = cfg->v.spectrumGain;
+    s->mpxScale = cfg->v.mpxScale;
+    s->attack = cfg->v.attack;
+    s->decay = cfg->v.decay;
+    s->overlap = cfg->v.overlap;
+    s->bins = cfg->v.bins;
+    s->binScale = cfg->v.binScale;
+    s->binMode = cfg->v.binMode;
+    s->fftSize = cfg->v.fftSize;
+    s->window = cfg->v.window;
+    s->windowTable = cfg->windowTable;
+    s->windowNorm = cfg->windowNorm;
+    s->sendInterval = cfg->v.sendInterval;
+    s->historyRows = cfg->v.historyRows;
+    s->historyBins = cfg->v.historyBins;
+    s->historyInterval = cfg->v.historyInterval;
+    s->holdTime = cfg->v.holdTime;
+    s->zoomCount = cfg->v.zoomCount;
+    s->zoomFftSize = cfg->v.zoomFftSize;
+    memcpy(s->zoomCentre, cfg->v.zoomCentre, sizeof(s->zoomCentre));
+    memcpy(s->zoomSpan, cfg->v.zoomSpan, sizeof(s->zoomSpan));
+}
+
+// in: BLOCK_FRAMES raw frames in ms->format / ms->channels
+static void MeterStage_ProcessBlock(MeterStage *ms, const void *in, MeterBlock *blk) {
+    if (ms->pollConfig && ++ms->configCheckCounter > 50) {
+        if (update_config(0)) Config_Publish();
+        ms->configCheckCounter = 0;
+    }
+    const MpxConfig *cfg = Config_Current();
+    if (cfg->generation != ms->configGen) {
+        ms->outputSampleThreshold = output_threshold_samples(ms->sr, cfg->v.sendInterval);
+        ms->configGen = cfg->generation;
+    }
+    if (cfg->v.rdsDecoder != (ms->demod.rds != NULL)) {
+        // Switched on: start from scratch rather than from stale sync
+        if (cfg->v.rdsDecoder) Rds_Reset(&ms->rds);
+        ms->demod.rds = cfg->v.rdsDecoder ? &ms->rds : NULL;
+    }
+    if (cfg->v.stereoMetrics != (ms->demod.stereo != NULL)) {
+        if (cfg->v.stereoMetrics) Stereo_Init(&ms->stereo, ms->demod.decim, ms->demod.decimRate);
+        ms->demod.stereo = cfg->v.stereoMetrics ? &ms->stereo : NULL;
+    }
+    if (cfg->v.deviationHistogram != ms->devOn) {
+        if (cfg->v.deviationHistogram) Dev_Reset(&ms->dev);
+        ms->devOn = cfg->v.deviationHistogram;
+    }
+    ms->dev.limit = cfg->v.deviationLimit;
+    snapshot_spectrum_settings(&blk->settings, cfg);
+    blk->nMarks = 0;
+
+    uint64_t t = stats_clock_ns();
+    float *xBuf = blk->x;
+    const float meterGain = cfg->v.meterGain;
+    blk->settings.gain /= meterGain;   // x already carries the meter gain
+
+    // --- CHANNEL SELECT (with auto-lock) ---
+    int start = 0;
+    if (!ms->channel_locked && ms->channels == 1) {
+        ms->channel_locked = 1;
+    } else if (!ms->channel_locked) {
+        const float fs = G_SampleFullScale[ms->format];
+        for (; start < BLOCK_FRAMES && !ms->channel_locked; start++) {
+            float vL = sample_at(in, ms->format, start * 2) * fs;
+            float vR = sample_at(in, ms->format, start * 2 + 1) * fs;
+            ms->energyL += (double)vL * (double)vL;
+            ms->energyR += (double)vR * (double)vR;
+            ms->energy_samples++;
+            if (ms->energy_samples >= 4096) {
+                ms->active_channel = (ms->energyR > ms->energyL * 1.2) ? 1 : 0;
+                ms->channel_locked = 1;
+                fprintf(stderr, "[MPX] Channel locked: %s\n", ms->active_channel ? "RIGHT" : "LEFT");
+            }
+            xBuf[start] = (ms->active_channel == 0 ? vL : vR) * (BASE_PREAMP * meterGain);
+        }
+    }
+    // Locked: deinterleave + convert + preamp + meter gain in one pass
+    convert_channel((const uint8_t*)in + (size_t)start * (size_t)ms->frameBytes, ms->format, ms->channels,
+                    ms->active_channel, BASE_PREAMP * meterGain, xBuf + start, BLOCK_FRAMES - start);
+    STAGE_MARK(ms->stats, t, STAGE_CONVERT);
+
+    // --- DC BLOCKER (linear, so the folded-in gain makes no difference) ---
+    DCBlocker_ProcessBlock(&ms->dcBlocker, xBuf, xBuf, BLOCK_FRAMES);
+    STAGE_MARK(ms->stats, t, STAGE_DCBLOCK);
+
+    // The block is split at output points so that the values snapshotted
+    // for each frame are taken at exactly the same sample as before.
+    int pos = 0;
+    while (pos < BLOCK_FRAMES) {
+        int n = BLOCK_FRAMES - pos;
+        int untilOutput = ms->outputSampleThreshold - ms->counter;
+        if (untilOutput < 1) untilOutput = 1;
+        if (n > untilOutput) n = untilOutput;
+
+        float *vMeters = xBuf + pos;
+        float *vPeak = ms->peakBuf + pos;
+
+        // --- BS.412 MPX POWER MEASUREMENT ---
+        // Calculate using the SCALED value (assuming MeterMPXScale maps 1.0 to 100 kHz)
+        // If the signal is not scaled to kHz, the result will be wrong.
+        Bs412_Process(&ms->bs412, vMeters, n, cfg->v.mpxScale);
+        STAGE_MARK(ms->stats, t, STAGE_BS412);
+
+        // --- MPX PEAK PATH ONLY ---
+        if (cfg->v.mpxLpf) BiQuad_ProcessBlock(&ms->mpxPeakLpf, vMeters, vPeak, n);
+        else memcpy(vPeak, vMeters, sizeof(float) * (size_t)n);
+
+        TruePeakN_ProcessBlock(&ms->tpN, vPeak, vPeak, n, cfg->v.truePeakFactor);
+        float envPeak = PeakHoldRelease_ProcessBlock(&ms->mpxEnv, vPeak, n);
+        if (ms->devOn) Dev_Process(&ms->dev, vPeak, n, cfg->v.mpxScale);
+        STAGE_MARK(ms->stats, t, STAGE_TRUEPEAK);
+
+        // Demod (Pilot+RDS)
+        MpxDemod_ProcessBlock(&ms->demod, vMeters, n);
+        STAGE_MARK(ms->stats, t, STAGE_DEMOD);
+
+        ms->counter += n;
+        pos += n;
+
+        if (ms->counter >= ms->outputSampleThreshold) {
+
+            float pScaled = ms->demod.pilotMag * cfg->v.pilotScale;
+            float rScaled = ms->demod.rdsMag   * cfg->v.rdsScale;
+
+            if (ms->smoothP == 0.0f) ms->smoothP = pScaled; else ms->smoothP = ms->smoothP * 0.90f + pScaled * 0.10f;
+            if (ms->smoothR == 0.0f) ms->smoothR = rScaled; else ms->smoothR = ms->smoothR * 0.90f + rScaled * 0.10f;
+
+            OutputMark *mk = &blk->marks[blk->nMarks++];
+            mk->pos = pos;
+            mk->p = ms->smoothP;
+            mk->r = ms->smoothR;
+            mk->m = envPeak * cfg->v.mpxScale;
+            // BS.412 dBr (relative to 19kHz sine power); the window moves
+            // in 100 ms steps, so no display smoothing
+            mk->b = Bs412_dBr(ms->bs412.power);
+            mk->b10 = Bs412_dBr(Bs412_MaxPower(&ms->bs412, 10));
+            mk->b60 = Bs412_dBr(Bs412_MaxPower(&ms->bs412, 60));
+
+            memset(&mk->st, 0, sizeof(StereoInfo));
+            if (ms->demod.stereo) {
+                Stereo_Read(&ms->stereo, cfg->v.mpxScale, cfg->v.pilotScale, &mk->st);
+                mk->st.on = 1;
+                mk->st.pilot = ms->demod.pilotPresent;
+                mk->st.ppm = MpxDemod_PilotPpm(&ms->demod);
+            }
+
+            ms->counter = 0;
+        }
+    }
+
+    blk->rdsOn = ms->demod.rds != NULL;
+    if (blk->rdsOn) blk->rds = ms->rds.info;
+    blk->devOn = ms->devOn;
+    if (blk->devOn) blk->dev = ms->dev.info;
+}
+
+static void SpectrumOutput_Free(SpectrumOutput *so) {
+    Spectrum_Free(&so->spec);
+    BinMap_Free(&so->binMap);
+    History_Free(&so->hist);
+    Noise_Free(&so->noise);
+    Zoom_Free(&so->zoom);
+    free(so->specAmp);
+    free(so->smoothBuf);
+    free(so->binBuf);
+    free(so->out.data);
+    memset(so, 0, sizeof(SpectrumOutput));
+}
+
+// FFT size and window come from the current config snapshot.
+static int SpectrumOutput_Init(SpectrumOutput *so, int sr, int sourceId) {
+    memset(so, 0, sizeof(SpectrumOutput));
+    so->sr = sr;
+    so->sourceId = sourceId;
+    StreamStats_Init(&so->stats);
+    so->out.stats = &so->stats;
+
+    snapshot_spectrum_settings(&so->applied, Config_Current());
+    so->configReader = Config_AddReader();
+    so->fftSize = so->applied.fftSize;
+    so->maxBin = so->fftSize / 2;
+
+    so->specAmp   = (float*)malloc(sizeof(float) * (size_t)so->maxBin);
+    so->smoothBuf = (float*)calloc((size_t)so->maxBin, sizeof(float));
+    so->binBuf    = (float*)malloc(sizeof(float) * (size_t)so->maxBin);
+
+    if (!Spectrum_Init(&so->spec, so->fftSize, so->applied.overlap, so->applied.windowTable, so->applied.windowNorm) ||
+        !so->specAmp || !so->smoothBuf || !so->binBuf) {
+        SpectrumOutput_Free(so);
+        return 0;
+    }
+    fprintf(stderr, "[MPX] Spectrum: Welch STFT, overlap %d%% (hop %d samples), %s window\n",
+            so->applied.overlap, so->spec.hop, G_WindowNames[so->applied.window]);
+
+    // Display-bin reduction (pass-through unless SpectrumBins is set)
+    BinMap_Configure(&so->binMap, sr, so->fftSize, so->applied.bins, so->applied.binScale, so->applied.binMode);
+    Noise_SetTiming(&so->noise, so->applied.sendInterval);
+    Noise_Configure(&so->noise, sr, so->fftSize);
+    return 1;
+}
+
+// Live FFT size change. All buffers are allocated before anything is
+// swapped, so on failure the stream keeps running at the old size.
+static int SpectrumOutput_Resize(SpectrumOutput *so, const SpectrumSettings *s) {
+    int maxBin = s->fftSize / 2;
+    float *specAmp   = (float*)malloc(sizeof(float) * (size_t)maxBin);
+    float *smoothBuf = (float*)calloc((size_t)maxBin, sizeof(float));
+    float *binBuf    = (float*)malloc(sizeof(float) * (size_t)maxBin);
+
+    if (!specAmp || !smoothBuf || !binBuf ||
+        !Spectrum_Resize(&so->spec, s->fftSize, s->overlap, s->windowTable, s->windowNorm)) {
+        free(specAmp);
+        free(smoothBuf);
+        free(binBuf);
+        fprintf(stderr, "[MPX] FFT size %d: out of memory, staying at %d\n", s->fftSize, so->fftSize);
+        return 0;
+    }
+    free(so->specAmp);
+    free(so->smoothBuf);
+    free(so->binBuf);
+    so->specAmp = specAmp;
+    so->smoothBuf = smoothBuf;
+    so->binBuf = binBuf;
+    so->fftSize = s->fftSize;
+    so->maxBin = maxBin;
+
+    // The bin ranges depend on the bin width; rebuilt by the caller
+    BinMap_Free(&so->binMap);
+    Noise_Configure(&so->noise, so->sr, so->fftSize);
+    fprintf(stderr, "[MPX] Source %d: FFT %d, %s window\n", so->sourceId, so->fftSize, G_WindowNames[s->window]);
+    return 1;
+}
+
+static int SpectrumOutput_Emit(SpectrumOutput *so, const OutputMark *mk) {
+    const SpectrumSettings *cfg = &so->applied;
+    int ffts = so->spec.frames;
+    if (!Spectrum_TakeAverage(&so->spec, so->specAmp)) return 1;
+    int newRow = History_Push(&so->hist, so->specAmp);
+
+    Noise_Process(&so->noise, so->specAmp, ffts, cfg->mpxScale / (cfg->gain * so->spec.sineGain),
+                  so->spec.noiseBw, &so->noiseInfo);
+
+    float *amp = so->specAmp;
+    int outBins = so->maxBin;
+    if (so->binMap.bins > 0) {
+        BinMap_Reduce(&so->binMap, so->specAmp, so->binBuf);
+        amp = so->binBuf;
+        outBins = so->binMap.bins;
+    }
+
+    float *smoothBuf = so->smoothBuf;
+    for (int k = 0; k < outBins; k++) {
+        float linearAmp = amp[k];
+
+        if (linearAmp > smoothBuf[k]) {
+            smoothBuf[k] = smoothBuf[k] * (1.0f - cfg->attack) + linearAmp * cfg->attack;
+        } else {
+            smoothBuf[k] = smoothBuf[k] * (1.0f - cfg->decay)  + linearAmp * cfg->decay;
+        }
+        amp[k] = smoothBuf[k] * SPECTRUM_DISPLAY_GAIN;
+    }
+
+    OutputFrame frame;
+    frame.seq = so->frameSeq++;
+    frame.source = so->sourceId;
+    frame.p = mk->p;
+    frame.r = mk->r;
+    frame.m = mk->m;
+    frame.b = mk->b;
+    frame.b10 = mk->b10;
+    frame.b60 = mk->b60;
+    frame.st = &mk->st;
+    frame.nf = &so->noiseInfo;
+    frame.spectrum = amp;
+    frame.bins = outBins;
+    frame.binMap = &so->binMap;
+    if (!Output_WriteFrame(&so->out, &frame)) return 0;
+    return !newRow || Output_WriteHistory(&so->out, &so->hist, so->sourceId, 0);
+}
+
+// Late-frame check and periodic stats record, once per block. The audio
+// position counts dropped blocks too, so it tracks the input clock.
+static int SpectrumOutput_Stats(SpectrumOutput *so, int framesInBlock) {
+    so->blocksSeen++;
+    if (G_StatsInterval <= 0) return 1;
+
+    uint64_t now = stats_clock_ns();
+    StatsSnapshot cur;
+    StreamStats_Take(&so->stats, &cur);
+    double audioMs = (double)(so->blocksSeen + cur.dropsIn + cur.dropsBlk) * BLOCK_FRAMES * 1000.0 / (double)so->sr;
+
+    if (so->statsWallNs == 0) {
+        so->statsWallNs = so->lateWallNs = now;
+        so->statsAudioMs = so->lateAudioMs = audioMs;
+        so->statsFrames = so->frameSeq;
+        so->statsPrev = cur;
+        return 1;
+    }
+
+    // Behind the input by more than STATS_LATE_MS: count, then rebase
+    if ((double)(now - so->lateWallNs) / 1e6 > audioMs - so->lateAudioMs + STATS_LATE_MS) {
+        atomic_fetch_add_explicit(&so->stats.late, (unsigned int)framesInBlock, memory_order_relaxed);
+        cur.late += (unsigned int)framesInBlock;
+        so->lateWallNs = now;
+        so->lateAudioMs = audioMs;
+    }
+
+    if (audioMs - so->statsAudioMs < (double)G_StatsInterval) return 1;
+
+    StatsRecord r;
+    const StatsSnapshot *prev = &so->statsPrev;
+    double busyMs = 0.0;
+    r.seq = so->statsSeq++;
+    r.source = so->sourceId;
+    r.audioMs = (float)(audioMs - so->statsAudioMs);
+    r.wallMs = (float)((double)(now - so->statsWallNs) / 1e6);
+    for (int k = 0; k < STAGE_COUNT; k++) {
+        double ms = (double)(cur.stageNs[k] - prev->stageNs[k]) / 1e6;
+        r.stageMs[k] = (float)ms;
+        busyMs += ms;
+    }
+    r.dropsIn = cur.dropsIn - prev->dropsIn;
+    double analysedMs = (double)r.audioMs - (double)r.dropsIn * BLOCK_FRAMES * 1000.0 / (double)so->sr;
+    r.rt = (busyMs > 0.0) ? (float)(analysedMs / busyMs) : 0.0f;
+    r.readMs = (float)((double)(cur.readNs - prev->readNs) / 1e6);
+    r.writeMs = (float)((double)(cur.writeNs - prev->writeNs) / 1e6);
+    r.frames = so->frameSeq - so->statsFrames;
+    r.dropsBlk = cur.dropsBlk - prev->dropsBlk;
+    r.late = cur.late - prev->late;
+    r.configGen = atomic_load(&G_ConfigGeneration);
+
+    so->statsPrev = cur;
+    so->statsAudioMs = audioMs;
+    so->statsWallNs = now;
+    so->statsFrames = so->frameSeq;
+    return Output_WriteStats(&so->out, &r);
+}
+
+// RDS record when the decoded data changed, else every RDS_RECORD_MS
+static int SpectrumOutput_Rds(SpectrumOutput *so, const RdsInfo *r) {
+    long long every = (long long)so->sr * RDS_RECORD_MS / (1000LL * BLOCK_FRAMES);
+    if (so->rdsRecords > 0 && r->seq == so->rdsSeq && ++so->rdsBlocks < every) return 1;
+    so->rdsSeq = r->seq;
+    so->rdsBlocks = 0;
+    return Output_WriteRds(&so->out, r, so->sourceId, so->rdsRecords++);
+}
+
+static void SpectrumOutput_Archive(const SpectrumOutput *so, const OutputMark *mk) {
+    float v[ARCHIVE_METRICS] = { mk->p, mk->r, mk->m, mk->b, so->noiseInfo.nf };
+    Archive_Add(v, so->noiseInfo.nf > 0.0f);
+}
+
+// Deviation record for every new summary (DEV_RECORD_MS)
+static int SpectrumOutput_Deviation(SpectrumOutput *so, const DeviationInfo *d) {
+    if (d->seq == so->devSeq) return 1;
+    so->devSeq = d->seq;
+    return Output_WriteDeviation(&so->out, d, so->sourceId, so->devRecords++);
+}
+
+// Returns 0 once stdout is gone.
+static int SpectrumOutput_ProcessBlock(SpectrumOutput *so, const MeterBlock *blk) {
+    const SpectrumSettings *s = &blk->settings;
+
+    Config_Ack(so->configReader, s->generation);
+    if (s->fftSize != so->fftSize) {
+        // Out of memory: logged once, retried with the next snapshot
+        if (s->generation != so->resizeFailedGen && !SpectrumOutput_Resize(so, s))
+            so->resizeFailedGen = s->generation;
+    } else if (s->window != so->applied.window) {
+        Spectrum_SetWindow(&so->spec, s->windowTable, s->windowNorm);
+    }
+    if (s->overlap != so->applied.overlap) Spectrum_SetOverlap(&so->spec, s->overlap);
+    if (BinMap_Configure(&so->binMap, so->sr, so->fftSize, s->bins, s->binScale, s->binMode)) {
+        // Smoothing state belongs to the old layout
+        memset(so->smoothBuf, 0, sizeof(float) * (size_t)so->maxBin);
+    }
+    History_Configure(&so->hist, so->sr, so->fftSize, s->historyRows, s->historyBins, s->binScale);
+    History_SetTiming(&so->hist, s->sendInterval, s->historyInterval, s->holdTime);
+    Noise_SetTiming(&so->noise, s->sendInterval);
+    Zoom_Configure(&so->zoom, so->sr, s->zoomCount, s->zoomCentre, s->zoomSpan, s->zoomFftSize, s->window);
+    so->applied = *s;
+
+    unsigned int requests = atomic_load_explicit(&G_HistoryRequests, memory_order_relaxed);
+    if (requests != so->hist.requests) {
+        so->hist.requests = requests;
+        if (!Output_WriteHistory(&so->out, &so->hist, so->sourceId, 1)) return 0;
+    }
+
+    uint64_t t = stats_clock_ns();
+    int pos = 0;
+    for (int k = 0; k < blk->nMarks; k++) {
+        const OutputMark *mk = &blk->marks[k];
+        Spectrum_Push(&so->spec, blk->x + pos, mk->pos - pos, s->gain);
+        pos = mk->pos;
+        STAGE_MARK(&so->stats, t, STAGE_FFT);
+        if (!SpectrumOutput_Emit(so, mk)) return 0;
+        if (so->sourceId == G_ArchiveSource) SpectrumOutput_Archive(so, mk);
+        STAGE_MARK(&so->stats, t, STAGE_OUTPUT);
+    }
+    Spectrum_Push(&so->spec, blk->x + pos, BLOCK_FRAMES - pos, s->gain);
+    STAGE_MARK(&so->stats, t, STAGE_FFT);
+    if (so->zoom.count > 0) {
+        Zoom_Process(&so->zoom, blk->x, BLOCK_FRAMES);
+        STAGE_MARK(&so->stats, t, STAGE_FFT);
+        if (Zoom_TakeRecord(&so->zoom, s->mpxScale) && !Output_WriteZoom(&so->out, &so->zoom, so->sourceId)) return 0;
+    }
+    if (blk->rdsOn && !SpectrumOutput_Rds(so, &blk->rds)) return 0;
+    if (blk->devOn && !SpectrumOutput_Deviation(so, &blk->dev)) return 0;
+    return SpectrumOutput_Stats(so, blk->nMarks);
+}
+
+/* ============================================================
+   INPUT SOURCES (stdin, raw/WAV file, ALSA)
+   ============================================================ */
+// Every source delivers raw interleaved frames (src->format, 1 or 2
+// channels) into the buffer it is given, which with threads is a slot of
+// the input ring; conversion happens in MeterStage (see SAMPLE FORMATS):
+//   stdin          raw --format stereo (arecord pipe), the default
+//   file:PATH      raw --format stereo or a WAV file (16/24/32-bit PCM or
+//                  float32, mono or stereo; the WAV header overrides
+//                  <sampleRate> and --format)
+//   alsa[:DEVICE]  direct ALSA capture, mmap access, copied from the DMA
+//                  buffer straight into the ring. Needs -DMPX_WITH_ALSA
+//                  and -lasound. Over-runs are recovered and counted.
+typedef struct InputSource InputSource;
+struct InputSource {
+    const char *kind;
+    int realtime;       // live input: drop blocks rather than wait when behind
+    int sampleRate;     // actual rate, 0 = as requested
+    int format;         // SAMPLE_*
+    int channels;       // 1 or 2
+    // Reads up to frames frames; fewer means end of input
+    int (*read)(InputSource *src, void *dst, int frames);
+    void (*close)(InputSource *src);
+    void *state;
+};
+
+typedef struct {
+    int format;         // SAMPLE_* for stdin, raw files and ALSA
+    int periodFrames;   // ALSA period (0 = 25 ms)
+    int bufferFrames;   // ALSA buffer (0 = 4 periods)
+} InputOptions;
+
+// --- stdin / raw file ---
+typedef struct {
+    FILE *f;
+    size_t frameBytes;
+    long long remaining;    // frames left in the WAV data chunk, -1 = until EOF
+} FileInput;
+
+static int FileInput_Read(InputSource *src, void *dst, int frames) {
+    FileInput *fi = (FileInput*)src->state;
+    if (fi->remaining >= 0 && fi->remaining < frames) frames = (int)fi->remaining;
+    if (frames <= 0) return 0;
+
+    int got = (int)fread(dst, fi->frameBytes, (size_t)frames, fi->f);
+    if (fi->remaining >= 0) fi->remaining -= got;
+    return got;
+}
+
+static void FileInput_Close(InputSource *src) {
+    FileInput *fi = (FileInput*)src->state;
+    if (fi->f && fi->f != stdin) fclose(fi->f);
+    free(fi);
+}
+
+// Positions f at the start of the data chunk. Returns 0 if not a usable WAV.
+static int Wav_ReadHeader(FILE *f, InputSource *src, FileInput *fi, int *rate) {
+    unsigned char h[12];
+    if (fread(h, 1, 12, f) != 12 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) return 0;
+
+    int haveFmt = 0, format = 0, channels = 0, bits = 0;
+    for (;;) {
+        unsigned char ch[8];
+        if (fread(ch, 1, 8, f) != 8) return 0;
+        uint32_t size = get_u32le(ch + 4);
+
+        if (memcmp(ch, "fmt ", 4) == 0) {
+            unsigned char fmt[40];
+            size_t n = size < sizeof(fmt) ? size : sizeof(fmt);
+            if (size < 16 || fread(fmt, 1, n, f) != n) return 0;
+            if (size > n) fseek(f, (long)(size - n), SEEK_CUR);
+            format = get_u16le(fmt);
+            channels = get_u16le(fmt + 2);
+            *rate = (int)get_u32le(fmt + 4);
+            bits = get_u16le(fmt + 14);
+            if (format == 0xFFFE && n >= 26) format = get_u16le(fmt + 24);   // WAVE_FORMAT_EXTENSIBLE subformat
+            haveFmt = 1;
+        } else if (memcmp(ch, "data", 4) == 0) {
+            if (!haveFmt) return 0;
+            int sf = -1;
+            if (format == 3 && bits == 32) sf = SAMPLE_FLOAT_LE;
+            else if (format == 1 && bits == 16) sf = SAMPLE_S16_LE;
+            else if (format == 1 && bits == 24) sf = SAMPLE_S24_3LE;
+            else if (format == 1 && bits == 32) sf = SAMPLE_S32_LE;
+            if (sf < 0 || (channels != 1 && channels != 2)) {
+                fprintf(stderr, "[MPX] WAV: unsupported format %d/%d bit/%d ch (need PCM 16/24/32 or float32, mono or stereo)\n",
+                        format, bits, channels);
+                return 0;
+            }
+            src->format = sf;
+            src->channels = channels;
+            fi->frameBytes = (size_t)(G_SampleBytes[sf] * channels);
+            fi->remaining = (long long)size / (long long)fi->frameBytes;
+            return 1;
+        } else {
+            fseek(f, (long)(size + (size & 1)), SEEK_CUR);
+        }
+    }
+}
+
+static int Input_OpenFile(InputSource *src, const char *path, int format) {
+    FileInput *fi = (FileInput*)calloc(1, sizeof(FileInput));
+    if (!fi) return 0;
+    src->format = format;
+    src->channels = 2;
+    fi->frameBytes = (size_t)(G_SampleBytes[format] * 2);
+    fi->remaining = -1;
+
+    if (!path) {
+        fi->f = stdin;
+        src->kind = "stdin";
+        src->realtime = 1;
+    } else {
+        fi->f = fopen(path, "rb");
+        if (!fi->f) {
+            fprintf(stderr, "[MPX] Cannot open input file '%s': %s\n", path, strerror(errno));
+            free(fi);
+            return 0;
+        }
+        src->kind = "file";
+        src->realtime = 0;
+
+        int rate = 0;
+        if (Wav_ReadHeader(fi->f, src, fi, &rate)) {
+            src->sampleRate = rate;
+            fprintf(stderr, "[MPX] Input: WAV '%s', %d Hz, %s, %d ch\n",
+                    path, rate, G_SampleFormatNames[src->format], src->channels);
+        } else {
+            // Not a (supported) WAV: raw stereo from the start
+            rewind(fi->f);
+            src->format = format;
+            src->channels = 2;
+            fi->frameBytes = (size_t)(G_SampleBytes[format] * 2);
+            fi->remaining = -1;
+            fprintf(stderr, "[MPX] Input: raw %s stereo '%s'\n", G_SampleFormatNames[format], path);
+        }
+    }
+
+    src->read = FileInput_Read;
+    src->close = FileInput_Close;
+    src->state = fi;
+    return 1;
+}
+
+// --- ALSA (mmap) ---
+#ifdef MPX_WITH_ALSA
+#include <alsa/asoundlib.h>
+
+typedef struct {
+    snd_pcm_t *pcm;
+    size_t frameBytes;
+    unsigned int xruns;
+} AlsaInput;
+
+// Over-run / suspend recovery. Returns 0 if capture can continue.
+static int AlsaInput_Recover(AlsaInput *ai, int err) {
+    if (err == -EPIPE) {
+        ai->xruns++;
+        fprintf(stderr, "[MPX] ALSA overrun (xrun #%u), restarting capture\n", ai->xruns);
+    } else if (err == -ESTRPIPE) {
+        while ((err = snd_pcm_resume(ai->pcm)) == -EAGAIN) sleep_ms(10);
+        if (err == 0) return 0;
+    } else {
+        fprintf(stderr, "[MPX] ALSA error: %s\n", snd_strerror(err));
+        return err;
+    }
+    if ((err = snd_pcm_prepare(ai->pcm)) < 0 || (err = snd_pcm_start(ai->pcm)) < 0) {
+        fprintf(stderr, "[MPX] ALSA restart failed: %s\n", snd_strerror(err));
+        return err;
+    }
+    return 0;
+}
+
+static int AlsaInput_Read(InputSource *src, void *dst, int frames) {
+    AlsaInput *ai = (AlsaInput*)src->state;
+    int got = 0;
+
+    while (got < frames) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(ai->pcm);
+        if (avail < 0) {
+            if (AlsaInput_Recover(ai, (int)avail) < 0) return got;
+            continue;
+        }
+        if (avail == 0) {
+            int err = snd_pcm_wait(ai->pcm, 1000);
+            if (err < 0 && AlsaInput_Recover(ai, err) < 0) return got;
+            continue;
+        }
+
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t n = (snd_pcm_uframes_t)(frames - got);
+        if (n > (snd_pcm_uframes_t)avail) n = (snd_pcm_uframes_t)avail;
 
-        d->r_integrator += d->r_ki * re;
+        int err = snd_pcm_mmap_begin(ai->pcm, &areas, &offset, &n);
+        if (err < 0) {
+            if (AlsaInput_Recover(ai, err) < 0) return got;
+            continue;
+        }
 
-        float radPerHz = (2.0f * (float)M_PI) / (float)d->sampleRate;
-        float maxPull = 100.0f * radPerHz; // a bit wider because 57k is higher
-        d->r_integrator = clampf(d->r_integrator, -maxPull, +maxPull);
+        // Interleaved: one area describes both channels
+        const unsigned char *base = (const unsigned char*)areas[0].addr
+                                  + areas[0].first / 8 + (size_t)offset * (areas[0].step / 8);
+        memcpy((uint8_t*)dst + (size_t)got * ai->frameBytes, base, (size_t)n * ai->frameBytes);
 
-        float freqOffset = d->r_kp * re + d->r_integrator;
-        d->r_phaseRad += d->r_w0Rad + freqOffset;
-    } else {
-        // lock it to pilot-derived phase while pilot is present (prevents jump at switchover)
-        d->r_phaseRad = phase57_pilot;
-        d->r_integrator = 0.0f;
-        d->r_errLP = 0.0f;
+        snd_pcm_sframes_t done = snd_pcm_mmap_commit(ai->pcm, offset, n);
+        if (done < 0 || (snd_pcm_uframes_t)done != n) {
+            if (AlsaInput_Recover(ai, done < 0 ? (int)done : -EPIPE) < 0) return got;
+            continue;
+        }
+        got += (int)n;
     }
+    return got;
+}
 
-    if (d->r_phaseRad >= twoPi) d->r_phaseRad -= twoPi;
-    if (d->r_phaseRad < 0.0f)  d->r_phaseRad += twoPi;
+static void AlsaInput_Close(InputSource *src) {
+    AlsaInput *ai = (AlsaInput*)src->state;
+    if (ai->xruns) fprintf(stderr, "[MPX] ALSA: %u overruns in total\n", ai->xruns);
+    snd_pcm_close(ai->pcm);
+    free(ai);
+}
 
-    float c57_r = cosf(d->r_phaseRad);
-    float s57_r = sinf(d->r_phaseRad);
+static int Input_OpenAlsa(InputSource *src, const char *device, int sr, const InputOptions *opt) {
+    static const snd_pcm_format_t alsaFormats[] = {
+        SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S32_LE
+    };
+    AlsaInput *ai = (AlsaInput*)calloc(1, sizeof(AlsaInput));
+    if (!ai) return 0;
+    ai->frameBytes = (size_t)(G_SampleBytes[opt->format] * 2);
+
+    int err = snd_pcm_open(&ai->pcm, device, SND_PCM_STREAM_CAPTURE, 0);
+    if (err < 0) {
+        fprintf(stderr, "[MPX] ALSA: cannot open '%s': %s\n", device, snd_strerror(err));
+        free(ai);
+        return 0;
+    }
 
-    // Blend carrier (smooth switching)
-    float b = d->rdsRefBlend;
-    float c57 = b * c57_p + (1.0f - b) * c57_r;
-    float s57 = b * s57_p + (1.0f - b) * s57_r;
+    unsigned int rate = (unsigned int)sr;
+    snd_pcm_uframes_t period = (snd_pcm_uframes_t)(opt->periodFrames > 0 ? opt->periodFrames : sr / 40);
+    snd_pcm_uframes_t buffer = (snd_pcm_uframes_t)(opt->bufferFrames > 0 ? opt->bufferFrames : (int)period * 4);
+
+    snd_pcm_hw_params_t *hw = NULL;
+    snd_pcm_sw_params_t *sw = NULL;
+    const char *step = "hw params";
+    if ((err = snd_pcm_hw_params_malloc(&hw)) < 0 ||
+        (err = snd_pcm_hw_params_any(ai->pcm, hw)) < 0 ||
+        (step = "mmap interleaved access", err = snd_pcm_hw_params_set_access(ai->pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0 ||
+        (step = G_SampleFormatNames[opt->format], err = snd_pcm_hw_params_set_format(ai->pcm, hw, alsaFormats[opt->format])) < 0 ||
+        (step = "2 channels", err = snd_pcm_hw_params_set_channels(ai->pcm, hw, 2)) < 0 ||
+        (step = "rate", err = snd_pcm_hw_params_set_rate_near(ai->pcm, hw, &rate, NULL)) < 0 ||
+        (step = "period size", err = snd_pcm_hw_params_set_period_size_near(ai->pcm, hw, &period, NULL)) < 0 ||
+        (step = "buffer size", err = snd_pcm_hw_params_set_buffer_size_near(ai->pcm, hw, &buffer)) < 0 ||
+        (step = "hw params", err = snd_pcm_hw_params(ai->pcm, hw)) < 0 ||
+        (step = "sw params", err = snd_pcm_sw_params_malloc(&sw)) < 0 ||
+        (err = snd_pcm_sw_params_current(ai->pcm, sw)) < 0 ||
+        (err = snd_pcm_sw_params_set_avail_min(ai->pcm, sw, period)) < 0 ||
+        (err = snd_pcm_sw_params(ai->pcm, sw)) < 0 ||
+        (step = "start", err = snd_pcm_prepare(ai->pcm)) < 0 ||
+        (err = snd_pcm_start(ai->pcm)) < 0) {
+        fprintf(stderr, "[MPX] ALSA: setting %s on '%s' failed: %s\n", step, device, snd_strerror(err));
+        if (hw) snd_pcm_hw_params_free(hw);
+        if (sw) snd_pcm_sw_params_free(sw);
+        snd_pcm_close(ai->pcm);
+        free(ai);
+        return 0;
+    }
+    snd_pcm_hw_params_free(hw);
+    snd_pcm_sw_params_free(sw);
+
+    if ((int)rate != sr) fprintf(stderr, "[MPX] ALSA: %d Hz not available, using %u Hz\n", sr, rate);
+    fprintf(stderr, "[MPX] Input: ALSA '%s' mmap, %s, %u Hz, period %lu, buffer %lu frames\n",
+            device, G_SampleFormatNames[opt->format], rate, (unsigned long)period, (unsigned long)buffer);
+
+    src->kind = "alsa";
+    src->realtime = 1;
+    src->sampleRate = (int)rate;
+    src->format = opt->format;
+    src->channels = 2;
+    src->read = AlsaInput_Read;
+    src->close = AlsaInput_Close;
+    src->state = ai;
+    return 1;
+}
+#endif
 
-    // --- RDS IQ demodulation ---
-    // Use RAW MPX for consistent calibration, or use rdsFiltered57 if you want extra cleanliness.
-    float rdsIn = rawSample;
+// spec: "stdin", "file:PATH" or "alsa[:DEVICE]" (device defaults to devName)
+static int Input_Open(InputSource *src, const char *spec, const char *devName, int sr, const InputOptions *opt) {
+    memset(src, 0, sizeof(InputSource));
+    if (!spec || strcmp(spec, "stdin") == 0) return Input_OpenFile(src, NULL, opt->format);
+    if (strncmp(spec, "file:", 5) == 0) return Input_OpenFile(src, spec + 5, opt->format);
+    if (strncmp(spec, "alsa", 4) == 0 && (spec[4] == 0 || spec[4] == ':')) {
+#ifdef MPX_WITH_ALSA
+        const char *device = spec[4] ? spec + 5 : devName;
+        if (!device || !*device || strcmp(device, "Default") == 0) device = "default";
+        return Input_OpenAlsa(src, device, sr, opt);
+#else
+        (void)devName; (void)sr; (void)opt;
+        fprintf(stderr, "[MPX] ALSA input not available (build with -DMPX_WITH_ALSA -lasound)\n");
+        return 0;
+#endif
+    }
+    fprintf(stderr, "[MPX] Unknown input '%s'\n", spec);
+    return 0;
+}
 
-    float I_R = BiQuad_Process(&d->lpfI_Rds, rdsIn * c57);
-    float Q_R = BiQuad_Process(&d->lpfQ_Rds, rdsIn * s57);
+// One block; the time spent waiting for it is charged to stats (may be NULL)
+static int Input_ReadBlock(InputSource *src, void *dst, StreamStats *stats) {
+    uint64_t t = stats_clock_ns();
+    int n = src->read(src, dst, BLOCK_FRAMES);
+    if (G_StageTiming && stats) stats_add(&stats->readNs, stats_clock_ns() - t);
+    return n;
+}
 
-    float magSqRds = (I_R * I_R + Q_R * Q_R);
-    d->meanSqRds += (magSqRds - d->meanSqRds) * d->rmsAlpha;
-    d->rdsMag = sqrtf(fmaxf(d->meanSqRds, 0.0f));
+/* ============================================================
+   PIPELINE (reader / meter / spectrum+output threads)
+   ============================================================ */
+// Three threads joined by single-producer/single-consumer rings:
+//   main     InputSource read       -> inRing
+//   meter    MeterStage             -> blkRing
+//   output   SpectrumOutput (FFT, serialization, stdout)
+// Producers never wait on a full ring by default: the block is dropped
+// and counted instead, so a slow stdout reader cannot back up into the
+// capture pipe. A dropped input block is skipped entirely; a dropped
+// meter block only loses spectrum samples and the frames marked in it.
+// --overflow=wait makes producers wait instead (for file input).
+// --threads=0 (or building with -DMPX_NO_THREADS) runs everything in
+// the reading thread.
+#ifndef MPX_NO_THREADS
+
+#define IN_RING_BLOCKS  16     // ~170 ms at 192 kHz
+#define BLK_RING_BLOCKS 8
 
-    // If you *want* to force RDS=0 when pilot is absent, uncomment:
-    // if (!d->pilotPresent) d->rdsMag = 0.0f;
+typedef struct {
+    unsigned char *slots;
+    size_t slotSize;
+    unsigned int mask;                  // slot count - 1 (power of two)
+    _Alignas(64) atomic_uint head;      // written by the producer
+    _Alignas(64) atomic_uint tail;      // written by the consumer
+    _Alignas(64) atomic_uint drops;
+    atomic_int closed;
+    sem_t ready;                        // one post per published slot (+1 on close)
+    sem_t *notify;                      // posted instead of ready if set (worker pool)
+} SpscRing;
+
+static int Ring_Init(SpscRing *r, unsigned int count, size_t slotSize) {
+    r->slots = (unsigned char*)malloc(slotSize * count);
+    if (!r->slots) return 0;
+    r->slotSize = slotSize;
+    r->mask = count - 1;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->drops, 0);
+    atomic_init(&r->closed, 0);
+    sem_init(&r->ready, 0, 0);
+    r->notify = NULL;
+    return 1;
+}
+
+static void Ring_Free(SpscRing *r) {
+    sem_destroy(&r->ready);
+    free(r->slots);
+    r->slots = NULL;
+}
+
+// Producer: next free slot, or NULL if the ring is full
+static void* Ring_WriteSlot(SpscRing *r) {
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head - tail > r->mask) return NULL;
+    return r->slots + (size_t)(head & r->mask) * r->slotSize;
+}
+
+static void Ring_Publish(SpscRing *r) {
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    sem_post(r->notify ? r->notify : &r->ready);
+}
+
+static void Ring_Close(SpscRing *r) {
+    atomic_store_explicit(&r->closed, 1, memory_order_release);
+    sem_post(r->notify ? r->notify : &r->ready);
+}
+
+// Consumer: blocks until a slot is available; NULL once closed and drained
+static void* Ring_ReadSlot(SpscRing *r) {
+    for (;;) {
+        unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (head != tail) return r->slots + (size_t)(tail & r->mask) * r->slotSize;
+        if (atomic_load_explicit(&r->closed, memory_order_acquire)) return NULL;
+        while (sem_wait(&r->ready) != 0 && errno == EINTR) { }
+    }
+}
+
+// Consumer, non-blocking: next slot or NULL; *done is set once the ring
+// is closed and drained
+static void* Ring_TryReadSlot(SpscRing *r, int *done) {
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    int closed = atomic_load_explicit(&r->closed, memory_order_acquire);
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_acquire);
+    *done = 0;
+    if (head != tail) return r->slots + (size_t)(tail & r->mask) * r->slotSize;
+    *done = closed;
+    return NULL;
+}
+
+static void Ring_Release(SpscRing *r) {
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+typedef struct {
+    SpscRing inRing;        // raw frames, BLOCK_MAX_BYTES
+    SpscRing blkRing;       // MeterBlock
+    MeterStage *meter;
+    SpectrumOutput *output;
+    MeterBlock scratch;     // meter output while blkRing is full
+    int waitWhenFull;
+    atomic_int stop;        // set by the output thread when stdout is gone
+} Pipeline;
+
+static void* meter_thread(void *arg) {
+    Pipeline *pl = (Pipeline*)arg;
+    const void *in;
+    while ((in = Ring_ReadSlot(&pl->inRing)) != NULL) {
+        MeterBlock *blk = (MeterBlock*)Ring_WriteSlot(&pl->blkRing);
+        while (!blk && pl->waitWhenFull && !atomic_load(&pl->stop)) {
+            sleep_ms(1);
+            blk = (MeterBlock*)Ring_WriteSlot(&pl->blkRing);
+        }
+
+        // Metering never stops; only the spectrum side loses the block
+        MeterStage_ProcessBlock(pl->meter, in, blk ? blk : &pl->scratch);
+        Ring_Release(&pl->inRing);
+
+        if (blk) Ring_Publish(&pl->blkRing);
+        else {
+            atomic_fetch_add(&pl->blkRing.drops, 1);
+            atomic_fetch_add(&pl->output->stats.dropsBlk, 1);
+        }
+    }
+    Ring_Close(&pl->blkRing);
+    return NULL;
+}
+
+static void* output_thread(void *arg) {
+    Pipeline *pl = (Pipeline*)arg;
+    const MeterBlock *blk;
+    while ((blk = (const MeterBlock*)Ring_ReadSlot(&pl->blkRing)) != NULL) {
+        if (!atomic_load(&pl->stop) && !SpectrumOutput_ProcessBlock(pl->output, blk)) {
+            fprintf(stderr, "[MPX] stdout closed, exiting\n");
+            atomic_store(&pl->stop, 1);
+        }
+        // Keep draining after a stop so the meter thread never waits on us
+        Ring_Release(&pl->blkRing);
+    }
+    return NULL;
+}
+
+static void Pipeline_ReportDrops(Pipeline *pl, unsigned int *lastIn, unsigned int *lastBlk) {
+    unsigned int dIn = atomic_load(&pl->inRing.drops);
+    unsigned int dBlk = atomic_load(&pl->blkRing.drops);
+    if (dIn != *lastIn || dBlk != *lastBlk) {
+        fprintf(stderr, "[MPX] Pipeline drops: input=%u blocks, spectrum=%u blocks\n", dIn, dBlk);
+        *lastIn = dIn;
+        *lastBlk = dBlk;
+    }
+}
+
+static int Pipeline_Run(InputSource *src, MeterStage *meter, SpectrumOutput *output, int waitWhenFull) {
+    Pipeline *pl = (Pipeline*)calloc(1, sizeof(Pipeline));
+    if (!pl) return 0;
+    pl->meter = meter;
+    pl->output = output;
+    pl->waitWhenFull = waitWhenFull;
+    atomic_init(&pl->stop, 0);
+
+    if (!Ring_Init(&pl->inRing, IN_RING_BLOCKS, BLOCK_MAX_BYTES)) { free(pl); return 0; }
+    if (!Ring_Init(&pl->blkRing, BLK_RING_BLOCKS, sizeof(MeterBlock))) { Ring_Free(&pl->inRing); free(pl); return 0; }
+
+    pthread_t meterTid, outputTid;
+    if (pthread_create(&meterTid, NULL, meter_thread, pl) != 0) {
+        Ring_Free(&pl->inRing); Ring_Free(&pl->blkRing); free(pl);
+        return 0;
+    }
+    if (pthread_create(&outputTid, NULL, output_thread, pl) != 0) {
+        Ring_Close(&pl->inRing);
+        pthread_join(meterTid, NULL);
+        Ring_Free(&pl->inRing); Ring_Free(&pl->blkRing); free(pl);
+        return 0;
+    }
+    fprintf(stderr, "[MPX] Pipeline: reader / meter / spectrum threads (on full ring: %s)\n",
+            waitWhenFull ? "wait" : "drop");
+
+    static uint8_t dropBuf[BLOCK_MAX_BYTES];
+    unsigned int lastIn = 0, lastBlk = 0;
+    int blocks = 0;
+
+    while (!atomic_load(&pl->stop)) {
+        void *slot = Ring_WriteSlot(&pl->inRing);
+        if (!slot && waitWhenFull) { sleep_ms(1); continue; }
+
+        void *dst = slot ? slot : dropBuf;
+        if (Input_ReadBlock(src, dst, &output->stats) != BLOCK_FRAMES) break;
+
+        if (slot) Ring_Publish(&pl->inRing);
+        else {
+            atomic_fetch_add(&pl->inRing.drops, 1);
+            atomic_fetch_add(&output->stats.dropsIn, 1);
+        }
+
+        if (++blocks >= 500) {   // ~5 s at 192 kHz
+            blocks = 0;
+            Pipeline_ReportDrops(pl, &lastIn, &lastBlk);
+        }
+    }
+
+    Ring_Close(&pl->inRing);
+    pthread_join(meterTid, NULL);
+    pthread_join(outputTid, NULL);
+    Pipeline_ReportDrops(pl, &lastIn, &lastBlk);
+
+    Ring_Free(&pl->inRing);
+    Ring_Free(&pl->blkRing);
+    free(pl);
+    return 1;
 }
+#endif
 
 /* ============================================================
-   FFT (Spectrum)
+   MULTI-SOURCE (one analysis chain per stream, worker pool)
    ============================================================ */
-typedef struct { float r, i; } Complex;
+// Several inputs (--input= given more than once) and/or both channels of
+// a stereo input (--channels=both) are analysed in one process. Every
+// stream has its own MeterStage and SpectrumOutput; frames carry the
+// stream number as source id (in input order, L before R). FFT plans and
+// the NCO table are shared, and only stream 0 polls the config file.
+//   reader   one thread per input   InputSource read -> ring of each stream
+//   worker   --workers=N threads    stream k always runs on worker k % N,
+//                                   so its state is never shared
+// Full rings drop blocks (or wait) exactly as in the single-stream
+// pipeline; without threads the streams run round-robin in one loop.
+#define MAX_INPUTS  8
+#define MAX_STREAMS (MAX_INPUTS * 2)
 
-static void QuickFFT(Complex *data, int n) {
-    int i, j, k, n1, n2;
-    Complex c, t;
+typedef struct {
+    int input;              // index of the InputSource
+    MeterStage *meter;
+    SpectrumOutput *output;
+    MeterBlock blk;
+#ifndef MPX_NO_THREADS
+    SpscRing ring;          // raw input blocks, BLOCK_MAX_BYTES
+#endif
+} Stream;
 
-    j = 0;
-    n2 = n / 2;
+// Returns 0 once stdout is gone.
+static int Stream_ProcessBlock(Stream *st, const void *in) {
+    MeterStage_ProcessBlock(st->meter, in, &st->blk);
+    return SpectrumOutput_ProcessBlock(st->output, &st->blk);
+}
 
-    for (i = 1; i < n - 1; i++) {
-        n1 = n2;
-        while (j >= n1) { j -= n1; n1 >>= 1; }
-        j += n1;
-        if (i < j) { t = data[i]; data[i] = data[j]; data[j] = t; }
+static void Streams_RunSingle(InputSource *inputs, int nInputs, Stream *streams, int nStreams) {
+    static uint8_t in[BLOCK_MAX_BYTES];
+    int ended[MAX_INPUTS] = { 0 };
+    int live = nInputs;
+
+    // Read waits go to the first stream of each input
+    StreamStats *firstStats[MAX_INPUTS] = { NULL };
+    for (int k = nStreams - 1; k >= 0; k--) firstStats[streams[k].input] = &streams[k].output->stats;
+
+    while (live > 0) {
+        for (int i = 0; i < nInputs; i++) {
+            if (ended[i]) continue;
+            if (Input_ReadBlock(&inputs[i], in, firstStats[i]) != BLOCK_FRAMES) {
+                ended[i] = 1;
+                live--;
+                continue;
+            }
+            for (int k = 0; k < nStreams; k++) {
+                if (streams[k].input == i && !Stream_ProcessBlock(&streams[k], in)) {
+                    fprintf(stderr, "[MPX] stdout closed, exiting\n");
+                    return;
+                }
+            }
+        }
     }
+}
 
-    n1 = 0; n2 = 1;
-    int stages = (int)log2((double)n);
-    for (i = 0; i < stages; i++) {
-        n1 = n2;
-        n2 <<= 1;
-        double a = 0.0;
-        double step = -M_PI / (double)n1;
+#ifndef MPX_NO_THREADS
+typedef struct MultiPipeline MultiPipeline;
 
-        for (j = 0; j < n1; j++) {
-            c.r = (float)cos(a);
-            c.i = (float)sin(a);
-            a += step;
+typedef struct {
+    MultiPipeline *mp;
+    pthread_t tid;
+    sem_t wake;             // posted by every ring of this worker
+    int nStreams;
+    Stream *streams[MAX_STREAMS];
+} Worker;
 
-            for (k = j; k < n; k += n2) {
-                t.r = c.r * data[k + n1].r - c.i * data[k + n1].i;
-                t.i = c.r * data[k + n1].i + c.i * data[k + n1].r;
+typedef struct {
+    MultiPipeline *mp;
+    pthread_t tid;
+    InputSource *src;
+    int nStreams;
+    Stream *streams[2];
+} Reader;
+
+struct MultiPipeline {
+    Reader readers[MAX_INPUTS];
+    Worker workers[MAX_STREAMS];
+    int nReaders, nWorkers;
+    int waitWhenFull;
+    atomic_int stop;
+};
+
+// Waits for a free slot when asked to; NULL means drop the block
+static void* MultiPipeline_WriteSlot(MultiPipeline *mp, SpscRing *r) {
+    void *slot = Ring_WriteSlot(r);
+    while (!slot && mp->waitWhenFull && !atomic_load(&mp->stop)) {
+        sleep_ms(1);
+        slot = Ring_WriteSlot(r);
+    }
+    return slot;
+}
 
-                data[k + n1].r = data[k].r - t.r;
-                data[k + n1].i = data[k].i - t.i;
+static void* reader_thread(void *arg) {
+    Reader *rd = (Reader*)arg;
+    MultiPipeline *mp = rd->mp;
+    uint8_t dropBuf[BLOCK_MAX_BYTES];
+    unsigned int lastDrops = 0;
+    int blocks = 0;
+
+    while (!atomic_load(&mp->stop)) {
+        // The first stream's slot is the read buffer, the second gets a copy
+        void *first = MultiPipeline_WriteSlot(mp, &rd->streams[0]->ring);
+        void *dst = first ? first : dropBuf;
+        if (Input_ReadBlock(rd->src, dst, &rd->streams[0]->output->stats) != BLOCK_FRAMES) break;
+
+        if (rd->nStreams > 1) {
+            void *second = MultiPipeline_WriteSlot(mp, &rd->streams[1]->ring);
+            if (second) {
+                memcpy(second, dst, BLOCK_MAX_BYTES);
+                Ring_Publish(&rd->streams[1]->ring);
+            } else {
+                atomic_fetch_add(&rd->streams[1]->ring.drops, 1);
+                atomic_fetch_add(&rd->streams[1]->output->stats.dropsIn, 1);
+            }
+        }
+        if (first) Ring_Publish(&rd->streams[0]->ring);
+        else {
+            atomic_fetch_add(&rd->streams[0]->ring.drops, 1);
+            atomic_fetch_add(&rd->streams[0]->output->stats.dropsIn, 1);
+        }
 
-                data[k].r += t.r;
-                data[k].i += t.i;
+        if (++blocks >= 500) {
+            blocks = 0;
+            unsigned int drops = 0;
+            for (int k = 0; k < rd->nStreams; k++) drops += atomic_load(&rd->streams[k]->ring.drops);
+            if (drops != lastDrops) {
+                fprintf(stderr, "[MPX] Input %s: %u blocks dropped\n", rd->src->kind, drops);
+                lastDrops = drops;
             }
         }
     }
+    for (int k = 0; k < rd->nStreams; k++) Ring_Close(&rd->streams[k]->ring);
+    return NULL;
 }
 
-static int is_power_of_two(int x) { return x > 0 && ((x & (x - 1)) == 0); }
+static void* worker_thread(void *arg) {
+    Worker *w = (Worker*)arg;
+    MultiPipeline *mp = w->mp;
+
+    for (;;) {
+        int busy = 0, open = 0;
+        for (int k = 0; k < w->nStreams; k++) {
+            Stream *st = w->streams[k];
+            int done;
+            const void *in = Ring_TryReadSlot(&st->ring, &done);
+            if (!in) { open += !done; continue; }
+
+            // Keep draining after a stop so readers never wait on us
+            if (!atomic_load(&mp->stop) && !Stream_ProcessBlock(st, in)) {
+                fprintf(stderr, "[MPX] stdout closed, exiting\n");
+                atomic_store(&mp->stop, 1);
+            }
+            Ring_Release(&st->ring);
+            busy = 1;
+            open++;
+        }
+        if (!open) break;
+        if (!busy) while (sem_wait(&w->wake) != 0 && errno == EINTR) { }
+    }
+    return NULL;
+}
 
-/* ============================================================
-   MAIN
-   ============================================================ */
-int main(int argc, char **argv)
-{
-    int sr = 192000;
-    int fftSize = 4096;
+static int MultiPipeline_Run(InputSource *inputs, int nInputs, Stream *streams, int nStreams,
+                             int nWorkers, int waitWhenFull) {
+    MultiPipeline *mp = (MultiPipeline*)calloc(1, sizeof(MultiPipeline));
+    if (!mp) return 0;
+    mp->waitWhenFull = waitWhenFull;
+    mp->nWorkers = nWorkers;
+    mp->nReaders = nInputs;
+    atomic_init(&mp->stop, 0);
+
+    int nRings = 0;
+    for (int w = 0; w < nWorkers; w++) {
+        mp->workers[w].mp = mp;
+        sem_init(&mp->workers[w].wake, 0, 0);
+    }
+    for (int k = 0; k < nStreams; k++) {
+        Stream *st = &streams[k];
+        if (!Ring_Init(&st->ring, IN_RING_BLOCKS, BLOCK_MAX_BYTES)) break;
+        nRings++;
 
-    if (argc >= 2) sr = atoi(argv[1]);
+        Worker *w = &mp->workers[k % nWorkers];
+        st->ring.notify = &w->wake;
+        w->streams[w->nStreams++] = st;
 
-    const char *devName = "Default";
-    if (argc >= 3 && argv[2] && strlen(argv[2]) > 0) devName = argv[2];
+        Reader *rd = &mp->readers[st->input];
+        rd->streams[rd->nStreams++] = st;
+    }
 
-    if (argc >= 4) fftSize = atoi(argv[3]);
-    if (!is_power_of_two(fftSize) || fftSize < 512) fftSize = 4096;
+    int ok = (nRings == nStreams);
+    int nStarted = 0, nReadersStarted = 0;
+    for (int w = 0; ok && w < nWorkers; w++) {
+        if (pthread_create(&mp->workers[w].tid, NULL, worker_thread, &mp->workers[w]) != 0) ok = 0;
+        else nStarted++;
+    }
+    if (ok) {
+        fprintf(stderr, "[MPX] Multi-source: %d inputs, %d streams on %d workers (on full ring: %s)\n",
+                nInputs, nStreams, nWorkers, waitWhenFull ? "wait" : "drop");
+    }
+    for (int i = 0; ok && i < nInputs; i++) {
+        Reader *rd = &mp->readers[i];
+        rd->mp = mp;
+        rd->src = &inputs[i];
+        if (pthread_create(&rd->tid, NULL, reader_thread, rd) != 0) {
+            atomic_store(&mp->stop, 1);
+            ok = 0;
+        } else {
+            nReadersStarted++;
+        }
+    }
 
-    if (argc >= 5) {
-        strncpy(G_ConfigPath, argv[4], 1023);
-        G_ConfigPath[1023] = 0;
-        update_config();
+    // Readers close the rings of their streams; close the rest here
+    for (int i = 0; i < nReadersStarted; i++) pthread_join(mp->readers[i].tid, NULL);
+    for (int i = nReadersStarted; i < nInputs; i++) {
+        for (int k = 0; k < mp->readers[i].nStreams; k++) Ring_Close(&mp->readers[i].streams[k]->ring);
     }
+    for (int w = 0; w < nStarted; w++) pthread_join(mp->workers[w].tid, NULL);
 
-#ifdef _WIN32
-    _setmode(_fileno(stdin),  _O_BINARY);
-    _setmode(_fileno(stdout), _O_BINARY);
+    for (int k = 0; k < nRings; k++) Ring_Free(&streams[k].ring);
+    for (int w = 0; w < nWorkers; w++) sem_destroy(&mp->workers[w].wake);
+    free(mp);
+    return ok || nReadersStarted > 0;
+}
 #endif
-    setvbuf(stdout, NULL, _IONBF, 0);
 
-    fprintf(stderr, "[MPX] Init SR:%d FFT:%d Dev:'%s' | MODE: DEVA-DSP (PLL+IQ, RDS dual-ref, truepeak)\n", sr, fftSize, devName);
+/* ============================================================
+   CONFIG WATCHER / CONTROL SOCKET (--control=PATH)
+   ============================================================ */
+// With threads, one thread owns every config change while the analysis
+// runs, so the processing threads never read the file, never sleep on a
+// half-written one and never build an FFT plan. It waits in poll() on:
+//   - inotify for the config file's directory (the file is usually
+//     replaced, not rewritten in place); stat() every CONFIG_POLL_MS if
+//     inotify is not available;
+//   - the control socket, a UNIX stream socket (--control=PATH) taking
+//     one command per line:
+//       {"fftSize":8192,...}  apply these config keys -> "ok <generation>",
+//                             "unchanged <generation>" if nothing changed,
+//                             "error invalid <key>" for the first value out
+//                             of range (the valid keys are still applied)
+//       reload                re-read the config file -> "ok <generation>"
+//       get                   current snapshot as JSON (config key names)
+//       history               every stream sends its waterfall ring -> "ok"
+//       reset-hold            restart the max/min hold traces      -> "ok"
+//     anything else gets "error unknown command".
+// Each change is published as a new snapshot (see CONFIG SNAPSHOT) that
+// the stages pick up at their next block, FFT size and window included.
+// Without threads, stream 0 checks the file every 50 blocks instead
+// (MeterStage.pollConfig). The sample rate still needs a restart.
+#define CONFIG_POLL_MS      500
+#define CONTROL_MAX_CLIENTS 4
+#define CONTROL_LINE_MAX    4096
+
+static const char *G_ControlPath = NULL;
+
+#if !defined(MPX_NO_THREADS) && !defined(_WIN32)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
 
-    float   *window    = (float*)malloc(sizeof(float) * (size_t)fftSize);
-    Complex *fftBuf    = (Complex*)malloc(sizeof(Complex) * (size_t)fftSize);
-    float   *smoothBuf = (float*)calloc((size_t)fftSize / 2, sizeof(float));
+typedef struct {
+    int fd;
+    size_t len;
+    char line[CONTROL_LINE_MAX];
+} ControlClient;
 
-    if (!window || !fftBuf || !smoothBuf) {
-        fprintf(stderr, "[MPX] Memory allocation failed!\n");
-        return 1;
+typedef struct {
+    pthread_t thread;
+    int running;
+    int stopPipe[2];
+    int inotifyFd;
+    const char *configName;     // file name part of G_ConfigPath
+    int listenFd;
+    ControlClient clients[CONTROL_MAX_CLIENTS];
+} ConfigWatcher;
+
+static ConfigWatcher G_Watcher = { .inotifyFd = -1, .listenFd = -1, .stopPipe = { -1, -1 } };
+
+// The snapshot as a config-file JSON object (control socket "get").
+static int Config_Describe(const MpxConfig *c, char *buf, size_t size) {
+    const ConfigValues *v = &c->v;
+    char zoom[128];
+    config_format_zoom(v->zoomCount, v->zoomCentre, v->zoomSpan, zoom, sizeof(zoom));
+    return snprintf(buf, size,
+        "{\"generation\":%u,\"fftSize\":%d,\"SpectrumWindow\":\"%s\",\"SpectrumOverlap\":%d,"
+        "\"SpectrumSendInterval\":%d,\"SpectrumBins\":%d,\"SpectrumBinScale\":\"%s\",\"SpectrumBinMode\":\"%s\","
+        "\"SpectrumAttackLevel\":%g,\"SpectrumDecayLevel\":%g,\"SpectrumInputCalibration\":%g,"
+        "\"MeterInputCalibration\":%g,\"MeterPilotScale\":%g,\"MeterMPXScale\":%g,\"MeterRDSScale\":%g,"
+        "\"TruePeakFactor\":%d,\"MPX_LPF_100kHz\":%d,\"SpectrumHistoryRows\":%d,\"SpectrumHistoryBins\":%d,"
+        "\"SpectrumHistoryInterval\":%d,\"SpectrumHoldTime\":%g,\"RdsDecoder\":%d,\"StereoMetrics\":%d,"
+        "\"DeviationHistogram\":%d,\"DeviationLimit\":%g,\"ZoomSpectrum\":\"%s\",\"ZoomFftSize\":%d}",
+        c->generation, v->fftSize, G_WindowNames[v->window], v->overlap,
+        v->sendInterval, v->bins,
+        v->binScale == BINSCALE_LOG ? "log" : v->binScale == BINSCALE_MPX ? "mpx" : "linear",
+        v->binMode == BINMODE_RMS ? "rms" : "peak",
+        v->attack * 10.0f, v->decay * 100.0f, v->spectrumCalDB,
+        v->meterCalDB, v->pilotScale, v->mpxScale, v->rdsScale,
+        v->truePeakFactor, v->mpxLpf, v->historyRows, v->historyBins,
+        v->historyInterval, v->holdTime, v->rdsDecoder, v->stereoMetrics,
+        v->deviationHistogram, v->deviationLimit, zoom, v->zoomFftSize);
+}
+
+static void Control_Reply(int fd, const char *msg) {
+    // The client may be gone; never let that raise SIGPIPE or block
+    size_t len = strlen(msg);
+    if (send(fd, msg, len, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)len) send(fd, "\n", 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+// prevGen: the generation before the change
+static void Control_ReplyPublished(int fd, unsigned int prevGen, unsigned int gen) {
+    char msg[32];
+    if (gen == 0) { Control_Reply(fd, "error out of memory"); return; }
+    snprintf(msg, sizeof(msg), "%s %u", gen == prevGen ? "unchanged" : "ok", gen);
+    Control_Reply(fd, msg);
+}
+
+static void Control_Command(int fd, char *line) {
+    size_t len = strlen(line);
+    while (len > 0 && isspace((unsigned char)line[len - 1])) line[--len] = 0;
+    while (isspace((unsigned char)*line)) line++;
+    if (*line == 0) return;
+
+    const unsigned int prevGen = Config_Current()->generation;
+    if (*line == '{') {
+        const char *rejected = config_apply_json(line);
+        config_log("control socket");
+        unsigned int gen = Config_Publish();
+        if (rejected && gen) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "error invalid %s", rejected);
+            Control_Reply(fd, msg);
+        } else {
+            Control_ReplyPublished(fd, prevGen, gen);
+        }
+    } else if (strcmp(line, "reload") == 0) {
+        update_config(1);
+        Control_ReplyPublished(fd, prevGen, Config_Publish());
+    } else if (strcmp(line, "history") == 0) {
+        atomic_fetch_add(&G_HistoryRequests, 1);
+        Control_Reply(fd, "ok");
+    } else if (strcmp(line, "reset-hold") == 0) {
+        atomic_fetch_add(&G_HoldResets, 1);
+        Control_Reply(fd, "ok");
+    } else if (strcmp(line, "get") == 0) {
+        char msg[1024];
+        Config_Describe(Config_Current(), msg, sizeof(msg));
+        Control_Reply(fd, msg);
+    } else {
+        Control_Reply(fd, "error unknown command");
     }
+}
 
-    for (int i = 0; i < fftSize; i++) {
-        window[i] = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * (float)i / (float)(fftSize - 1)));
+// Returns 0 once the client has gone (or sent an over-long line).
+static int Control_Read(ControlClient *c) {
+    ssize_t n = recv(c->fd, c->line + c->len, sizeof(c->line) - 1 - c->len, 0);
+    if (n <= 0) return n < 0 && (errno == EINTR || errno == EAGAIN);
+    c->len += (size_t)n;
+    c->line[c->len] = 0;
+
+    char *start = c->line, *nl;
+    while ((nl = strchr(start, '\n')) != NULL) {
+        *nl = 0;
+        Control_Command(c->fd, start);
+        start = nl + 1;
+    }
+    c->len -= (size_t)(start - c->line);
+    memmove(c->line, start, c->len + 1);
+    if (c->len >= sizeof(c->line) - 1) {
+        Control_Reply(c->fd, "error line too long");
+        return 0;
     }
+    return 1;
+}
 
-    // --- DC BLOCKER INIT ---
-    DCBlocker dcBlocker;
-    DCBlocker_Init(&dcBlocker);
+static int Control_Listen(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "[MPX] control: path too long '%s'\n", path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);   // stale socket of an earlier run
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, CONTROL_MAX_CLIENTS) != 0) {
+        fprintf(stderr, "[MPX] control: cannot listen on '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-    // --- BS.412 INIT ---
-    // 60-second sliding window integration via 1-pole IIR
-    float bs412_power = 0.0f;
-    float bs412_alpha = exp_alpha_from_tau((float)sr, 60.0f);
-    
-    // Reference Power for 0 dBr:
-    // Defined as power of a sinusoidal tone with +/- 19 kHz deviation.
-    // This value (180.5) assumes that the input signal is scaled to kHz units before squaring.
-    // Power = (Amp/sqrt(2))^2 = (19^2)/2 = 361/2 = 180.5
-    const float BS412_REF_POWER = 180.5f;
+// Sets up inotify on the directory of the config file, -1 if unavailable.
+static int ConfigWatcher_Inotify(ConfigWatcher *w) {
+    char dir[1024];
+    const char *slash = strrchr(G_ConfigPath, '/');
+    if (slash) {
+        size_t n = (size_t)(slash - G_ConfigPath);
+        if (n == 0) n = 1;
+        memcpy(dir, G_ConfigPath, n);
+        dir[n] = 0;
+        w->configName = slash + 1;
+    } else {
+        strcpy(dir, ".");
+        w->configName = G_ConfigPath;
+    }
 
-    // Demod
-    MpxDemodulator demod;
-    MpxDemod_Init(&demod, sr);
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return -1;
+    if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-    // Peak-path LPF (~100kHz, clamped)
-    BiQuadFilter mpxPeakLpf;
-    BiQuad_Init(&mpxPeakLpf);
-    float cutoff = 100000.0f;
-    float maxSafe = 0.45f * (float)sr;
-    if (cutoff > maxSafe) cutoff = maxSafe;
-    BiQuad_LowPass(&mpxPeakLpf, (float)sr, cutoff, 0.707f);
-    fprintf(stderr, "[MPX] Peak-path LPF cutoff: %.1f Hz (requested 100kHz, clamped if needed)\n", cutoff);
+// Drains the inotify queue. Returns 1 if the config file was touched.
+static int ConfigWatcher_Events(ConfigWatcher *w) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int hit = 0;
+    ssize_t n;
+    while ((n = read(w->inotifyFd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event*)p;
+            if (ev->len > 0 && strcmp(ev->name, w->configName) == 0) hit = 1;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return hit;
+}
 
-    // MPX TruePeak + Envelope
-    TruePeakN tpN;
-    TruePeakN_Init(&tpN);
+static void* config_thread(void *arg) {
+    ConfigWatcher *w = (ConfigWatcher*)arg;
+    struct pollfd fds[3 + CONTROL_MAX_CLIENTS];
+
+    for (;;) {
+        int nfds = 0, inotifyAt = -1, listenAt = -1;
+        fds[nfds].fd = w->stopPipe[0]; fds[nfds++].events = POLLIN;
+        if (w->inotifyFd >= 0) { inotifyAt = nfds; fds[nfds].fd = w->inotifyFd; fds[nfds++].events = POLLIN; }
+        if (w->listenFd >= 0) { listenAt = nfds; fds[nfds].fd = w->listenFd; fds[nfds++].events = POLLIN; }
+        int clientsAt = nfds;
+        for (int k = 0; k < CONTROL_MAX_CLIENTS; k++) {
+            fds[nfds].fd = w->clients[k].fd;    // -1 is ignored by poll()
+            fds[nfds++].events = POLLIN;
+        }
 
-    PeakHoldRelease mpxEnv;
-    PeakHoldRelease_Init(&mpxEnv, sr, 200.0f, 1500.0f);
+        int timeout = (w->inotifyFd < 0 && G_ConfigPath[0]) ? CONFIG_POLL_MS : -1;
+        int r = poll(fds, (nfds_t)nfds, timeout);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[0].revents) break;      // stop pipe closed
 
-    int fftIndex = 0;
+        if (r == 0) {
+            if (update_config(0)) Config_Publish();
+            continue;
+        }
+        // The writer may still be busy; update_config() retries short reads
+        if (inotifyAt >= 0 && fds[inotifyAt].revents && ConfigWatcher_Events(w)) {
+            if (update_config(1)) Config_Publish();
+        }
+        if (listenAt >= 0 && (fds[listenAt].revents & POLLIN)) {
+            int fd = accept(w->listenFd, NULL, NULL);
+            int k = 0;
+            while (fd >= 0 && k < CONTROL_MAX_CLIENTS && w->clients[k].fd >= 0) k++;
+            if (fd >= 0 && k == CONTROL_MAX_CLIENTS) {
+                Control_Reply(fd, "error too many clients");
+                close(fd);
+            } else if (fd >= 0) {
+                w->clients[k].fd = fd;
+                w->clients[k].len = 0;
+            }
+        }
+        for (int k = 0; k < CONTROL_MAX_CLIENTS; k++) {
+            ControlClient *c = &w->clients[k];
+            if (c->fd < 0 || !fds[clientsAt + k].revents) continue;
+            if (!Control_Read(c)) {
+                close(c->fd);
+                c->fd = -1;
+            }
+        }
+    }
+    return NULL;
+}
 
-    // Channel lock
-    int active_channel = 0;
-    int channel_locked = 0;
-    double energyL = 0.0, energyR = 0.0;
-    int energy_samples = 0;
+// Returns 1 if the thread runs; the caller then leaves the config alone.
+static int ConfigWatcher_Start(void) {
+    ConfigWatcher *w = &G_Watcher;
+    for (int k = 0; k < CONTROL_MAX_CLIENTS; k++) w->clients[k].fd = -1;
 
-    // Display smoothing
-    float smoothP = 0.0f;
-    float smoothR = 0.0f;
-    float smoothB = -99.0f; // BS412 smooth display
+    if (G_ConfigPath[0]) {
+        w->inotifyFd = ConfigWatcher_Inotify(w);
+        if (w->inotifyFd < 0) fprintf(stderr, "[MPX] Config: inotify unavailable, checking every %d ms\n", CONFIG_POLL_MS);
+    }
+    if (G_ControlPath) {
+        w->listenFd = Control_Listen(G_ControlPath);
+        if (w->listenFd >= 0) fprintf(stderr, "[MPX] Control socket: '%s'\n", G_ControlPath);
+    }
+    if (!G_ConfigPath[0] && w->listenFd < 0) return 0;
+
+    if (pipe(w->stopPipe) != 0 || pthread_create(&w->thread, NULL, config_thread, w) != 0) {
+        if (w->stopPipe[0] >= 0) { close(w->stopPipe[0]); close(w->stopPipe[1]); }
+        if (w->inotifyFd >= 0) close(w->inotifyFd);
+        if (w->listenFd >= 0) { close(w->listenFd); unlink(G_ControlPath); }
+        w->inotifyFd = w->listenFd = w->stopPipe[0] = w->stopPipe[1] = -1;
+        return 0;
+    }
+    w->running = 1;
+    return 1;
+}
+
+static void ConfigWatcher_Stop(void) {
+    ConfigWatcher *w = &G_Watcher;
+    if (!w->running) return;
+    close(w->stopPipe[1]);     // wakes poll() with POLLHUP
+    pthread_join(w->thread, NULL);
+    close(w->stopPipe[0]);
+    if (w->inotifyFd >= 0) close(w->inotifyFd);
+    if (w->listenFd >= 0) { close(w->listenFd); unlink(G_ControlPath); }
+    for (int k = 0; k < CONTROL_MAX_CLIENTS; k++) if (w->clients[k].fd >= 0) close(w->clients[k].fd);
+    w->running = 0;
+}
+#else
+static int ConfigWatcher_Start(void) {
+    if (G_ControlPath) fprintf(stderr, "[MPX] --control needs a build with threads (not on Windows), ignored\n");
+    return 0;
+}
+static void ConfigWatcher_Stop(void) { }
+#endif
+
+/* ============================================================
+   BENCHMARK (--bench)
+   ============================================================ */
+// Runs the DSP chain on a deterministic synthetic MPX signal as fast as
+// possible, reports throughput and realtime factor per stage, and checks
+// the readings against the generator's ground truth:
+//   MPXCapture <sampleRate> x <fftSize> --bench[=SECONDS] [--gen-...=]
+// The composite (in kHz deviation) is
+//   M + S sin(2 th) + c38 cos(2 th) + pilot sin(th) + rds chip sin(3 th)
+//   + noise [+ burst]
+// with th the pilot phase (19 kHz + offset), M/S audio tones (the 1 kHz
+// tone louder on L, 440 Hz on S only), c38 a residual carrier, chip the
+// biphase-coded RDS groups 0A (PS) and 2A (RadioText) of BENCH_RDS_* at
+// 1187.5 bit/s as one sine period per bit (band-limited like an encoder's
+// output, so it leaves the noise gaps clean), noise Gaussian, and every
+// burstEvery seconds a 50 ms 1 kHz tone (on M) that over-deviates the
+// peak. The stereo readings are checked against L = M + S, R = M - S
+// averaged like the meter does (STEREO_TAU).
+// The readings are calibrated to kHz for the run (MeterGain 1, Pilot and
+// RDS scale 2 x MPX scale); the config file is not read. Frames are
+// serialized in the --output format (binary for shm) and discarded.
+// Exit status 1 if a reading is out of tolerance. Needs an MPX sample
+// rate (>= 128 kHz).
+typedef struct {
+    double pilotKHz, pilotOffsetHz, rdsKHz, programKHz, noiseKHz;
+    double burstKHz, burstEvery;
+    double carrierKHz;
+} GenParams;
 
-    int counter = 0;
-    int configCheckCounter = 0;
-    int outputSampleThreshold = (sr * G_SpectrumSendInterval) / 1000;
+typedef struct {
+    GenParams p;
+    int sr;
+    double kHzToInput;      // input amplitude per kHz deviation
+    long long n;            // samples generated
+    double pilotPhase;      // radians
+    double bitPhase;        // 0..1 within the RDS bit
+    uint32_t rng;
+    int bit;                // differentially coded
+    uint32_t groupBlocks[4];
+    int groupBit, groupIndex;
+    // Ground truth
+    double peakKHz;         // max |composite|, 4x oversampled
+    double sumSq;           // sum of composite^2 (kHz^2)
+    double *subSums;        // sumSq at every 100 ms (BS.412 sub-window) boundary
+    int subLen, nSub, maxSub;
+    double powL, powR, prodLR;  // L, R over STEREO_TAU (kHz^2)
+    double stereoAlpha;
+} MpxGenerator;
+
+#define BENCH_RDS_BITRATE  1187.5
+#define BENCH_BURST_MS     50.0
+// RMS of the biphase PRBS after the demodulator's 2.4 kHz LPF relative
+// to its peak injection (simulated); the RDS meter reads this fraction.
+#define BENCH_RDS_RMS_FACTOR 0.678
+// RDS power within NOISE_RDS_HALF_HZ of 57 kHz relative to a full
+// carrier of the peak injection: 0.5 for the sine symbols, 98.9% of
+// which fall inside (integrated spectrum).
+#define BENCH_RDS_BAND_FACTOR 0.4946
+#define BENCH_RDS_PI  0xC0DE
+#define BENCH_RDS_PTY 10
+#define BENCH_RDS_PS  "MPXBENCH"
+#define BENCH_RDS_RT  "MPXCapture synthetic RDS"
+
+static int MpxGen_Init(MpxGenerator *g, int sr, const GenParams *p, double seconds) {
+    memset(g, 0, sizeof(MpxGenerator));
+    g->subLen = sr / 10;
+    g->maxSub = (int)(seconds * 10.0) + 2;
+    g->subSums = (double*)calloc((size_t)g->maxSub, sizeof(double));
+    g->p = *p;
+    g->sr = sr;
+    g->kHzToInput = 1.0 / (BASE_PREAMP * G_MeterMPXScale);
+    g->pilotPhase = 0.3;
+    g->rng = 0x12345678u;
+    g->groupBit = 104;
+    g->stereoAlpha = 1.0 - exp(-1.0 / (STEREO_TAU * (double)sr));
+    return g->subSums != NULL;
+}
 
-    int maxBin = fftSize / 2;
+// Mean power (kHz^2) over the BS.412 window the meter has after n samples
+static double MpxGen_WindowPower(const MpxGenerator *g, long long n) {
+    int k = (int)(n / g->subLen);
+    if (k > g->nSub) k = g->nSub;
+    int w = (k < BS412_SUBWINDOWS) ? k : BS412_SUBWINDOWS;
+    if (w == 0) return 0.0;
+    double before = (k - w > 0) ? g->subSums[k - w - 1] : 0.0;
+    return (g->subSums[k - 1] - before) / ((double)w * (double)g->subLen);
+}
 
-    float in[2048 * 2];
+static double MpxGen_Uniform(MpxGenerator *g) {
+    g->rng ^= g->rng << 13; g->rng ^= g->rng >> 17; g->rng ^= g->rng << 5;
+    return ((double)g->rng + 1.0) / 4294967297.0;
+}
 
-    while (fread(in, sizeof(float), 2048 * 2, stdin) == (size_t)(2048 * 2)) {
+static double MpxGen_Gauss(MpxGenerator *g) {
+    double u1 = MpxGen_Uniform(g), u2 = MpxGen_Uniform(g);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
 
-        configCheckCounter++;
-        if (configCheckCounter > 50) {
-            update_config();
-            outputSampleThreshold = (sr * G_SpectrumSendInterval) / 1000;
-            configCheckCounter = 0;
+// Program M and S at time t (kHz)
+static void MpxGen_Program(const MpxGenerator *g, double t, double *mono, double *side) {
+    const GenParams *p = &g->p;
+    double tone = sin(2.0 * M_PI * 1000.0 * t);
+    *mono = p->programKHz * 0.5 * (0.6 * tone + 0.4 * sin(2.0 * M_PI * 3100.0 * t));
+    *side = p->programKHz * 0.5 * (0.3 * tone + 0.5 * sin(2.0 * M_PI * 440.0 * t));
+
+    if (p->burstEvery > 0.0 && p->burstKHz > p->programKHz) {
+        double tb = fmod(t, p->burstEvery);
+        if (tb >= p->burstEvery * 0.5 && tb < p->burstEvery * 0.5 + BENCH_BURST_MS / 1000.0) {
+            *mono += (p->burstKHz - p->programKHz) * tone;
         }
+    }
+}
+
+// Deterministic part of the composite at time t (kHz); chip is the RDS
+// biphase level for this sample.
+static double MpxGen_Composite(const MpxGenerator *g, double t, double th, double chip) {
+    const GenParams *p = &g->p;
+    double mono, side;
+    MpxGen_Program(g, t, &mono, &side);
+    return mono + side * sin(2.0 * th) + p->carrierKHz * cos(2.0 * th)
+         + p->pilotKHz * sin(th) + p->rdsKHz * chip * sin(3.0 * th);
+}
 
-        for (int i = 0; i < 2048; i++) {
+// Alternates 0A groups (PS) and 2A groups (RadioText, ended by CR)
+static void MpxGen_NextGroup(MpxGenerator *g) {
+    static const char ps[] = BENCH_RDS_PS;
+    static const char rt[] = BENCH_RDS_RT "\r   ";     // whole 4-character segments
+    const int rtSegs = (int)(sizeof(rt) - 1) / 4;
+    const uint16_t common = (1 << 10) | (BENCH_RDS_PTY << 5);   // TP
+    uint16_t b[4];
+    int k = g->groupIndex++;
+
+    b[0] = BENCH_RDS_PI;
+    if (k % 2 == 0) {
+        int seg = (k / 2) % 4;
+        b[1] = (uint16_t)(common | (1 << 3) | seg);              // 0A, MS
+        b[2] = 0xE0CD;                                          // no AF
+        b[3] = (uint16_t)((ps[2 * seg] << 8) | ps[2 * seg + 1]);
+    } else {
+        int seg = (k / 2) % rtSegs;
+        b[1] = (uint16_t)((2 << 12) | common | seg);            // 2A, text A
+        b[2] = (uint16_t)((rt[4 * seg] << 8) | rt[4 * seg + 1]);
+        b[3] = (uint16_t)((rt[4 * seg + 2] << 8) | rt[4 * seg + 3]);
+    }
+    for (int j = 0; j < 4; j++) {
+        g->groupBlocks[j] = ((uint32_t)b[j] << 10) | (rds_check_bits(b[j]) ^ G_RdsOffsets[j == 3 ? 4 : j]);
+    }
+    g->groupBit = 0;
+}
 
-            float vL = in[i * 2];
-            float vR = in[i * 2 + 1];
+static int MpxGen_NextBit(MpxGenerator *g) {
+    if (g->groupBit == 104) MpxGen_NextGroup(g);
+    int blk = g->groupBit / 26, k = 25 - g->groupBit % 26;
+    g->groupBit++;
+    return (int)((g->groupBlocks[blk] >> k) & 1u);
+}
 
-            if (!channel_locked) {
-                energyL += (double)vL * (double)vL;
-                energyR += (double)vR * (double)vR;
-                energy_samples++;
-                if (energy_samples >= 4096) {
-                    active_channel = (energyR > energyL * 1.2) ? 1 : 0;
-                    channel_locked = 1;
-                    fprintf(stderr, "[MPX] Channel locked: %s\n", active_channel ? "RIGHT" : "LEFT");
-                }
-            }
+// frames stereo FLOAT_LE: composite on L, low noise on R (locks LEFT)
+static void MpxGen_Block(MpxGenerator *g, float *out, int frames) {
+    const double dt = 1.0 / (double)g->sr;
+    const double w = 2.0 * M_PI * (19000.0 + g->p.pilotOffsetHz);
+
+    for (int i = 0; i < frames; i++) {
+        double t = (double)g->n * dt;
 
-            float vRaw = (active_channel == 0 ? vL : vR) * BASE_PREAMP;
+        g->bitPhase += BENCH_RDS_BITRATE * dt;
+        if (g->bitPhase >= 1.0) {
+            g->bitPhase -= 1.0;
+            g->bit ^= MpxGen_NextBit(g);   // differential encoding
+        }
+        double chip = sin(2.0 * M_PI * g->bitPhase) * (g->bit ? 1.0 : -1.0);
 
-            // --- DC BLOCKER (Before gain/calibration) ---
-            float v = DCBlocker_Process(&dcBlocker, vRaw);
+        double v = MpxGen_Composite(g, t, g->pilotPhase, chip);
+        for (int k = 1; k < 4; k++) {
+            double tk = t + dt * k / 4.0;
+            double vk = fabs(MpxGen_Composite(g, tk, g->pilotPhase + w * dt * k / 4.0, chip));
+            if (vk > g->peakKHz) g->peakKHz = vk;
+        }
+        if (fabs(v) > g->peakKHz) g->peakKHz = fabs(v);
 
-            float vMeters = v * G_MeterGain;
-            float vSpec   = v * G_SpectrumGain;
+        double mono, side;
+        MpxGen_Program(g, t, &mono, &side);
+        double l = mono + side, r = mono - side;
+        g->powL   += (l * l - g->powL)   * g->stereoAlpha;
+        g->powR   += (r * r - g->powR)   * g->stereoAlpha;
+        g->prodLR += (l * r - g->prodLR) * g->stereoAlpha;
 
-            // --- BS.412 MPX POWER MEASUREMENT ---
-            // Calculate using the SCALED value (assuming G_MeterMPXScale maps 1.0 to 100 kHz)
-            // If the signal is not scaled to kHz, the result will be wrong.
-            float vScaledForPower = vMeters * G_MeterMPXScale;
-            float pwrInst = vScaledForPower * vScaledForPower;
-            bs412_power += (pwrInst - bs412_power) * bs412_alpha;
+        v += g->p.noiseKHz * MpxGen_Gauss(g);
+        g->sumSq += v * v;
+        if ((g->n + 1) % g->subLen == 0 && g->nSub < g->maxSub) g->subSums[g->nSub++] = g->sumSq;
 
-            // --- MPX PEAK PATH ONLY ---
-            float vPeak = vMeters;
-            if (G_EnableMpxLpf) vPeak = BiQuad_Process(&mpxPeakLpf, vPeak);
+        out[2 * i]     = (float)(v * g->kHzToInput);
+        out[2 * i + 1] = (float)(0.001 * MpxGen_Gauss(g) * g->kHzToInput);
 
-            float tp = TruePeakN_Process(&tpN, vPeak, G_TruePeakFactor);
-            float envPeak = PeakHoldRelease_Process(&mpxEnv, tp);
+        g->pilotPhase = fmod(g->pilotPhase + w * dt, 2.0 * M_PI);
+        g->n++;
+    }
+}
 
-            // Demod (Pilot+RDS)
-            MpxDemod_Process(&demod, vMeters);
+static int bench_check(const char *name, double got, double want, double tol, int relative) {
+    double err = relative ? fabs(got - want) / fmax(fabs(want), 1e-9) : fabs(got - want);
+    int ok = err <= tol;
+    fprintf(stderr, "[BENCH] %-8s got %9.4f  expected %9.4f  err %.4f%s (tol %.4f%s)  %s\n",
+            name, got, want, err, relative ? " rel" : "", tol, relative ? " rel" : "", ok ? "PASS" : "FAIL");
+    return ok;
+}
 
-            // FFT
-            if (fftIndex < fftSize) {
-                fftBuf[fftIndex].r = vSpec * window[fftIndex];
-                fftBuf[fftIndex].i = 0.0f;
-                fftIndex++;
-            }
+static int Bench_Run(int sr, int fftSize, double seconds, const GenParams *gp) {
+    if (sr < 128000) {
+        fprintf(stderr, "[BENCH] Sample rate %d Hz cannot carry the 57 kHz RDS subcarrier; use >= 128000.\n", sr);
+        return 1;
+    }
 
-            counter++;
+    G_MeterGain = 1.0f;
+    G_SpectrumGain = 1.0f;
+    G_MeterPilotScale = 2.0f * G_MeterMPXScale;
+    G_MeterRDSScale = 2.0f * G_MeterMPXScale;
+    G_FftSize = fftSize;
+    if (G_OutputFormat == OUT_SHM) G_OutputFormat = OUT_F32;
+    G_OutputFd = -1;
+    G_StatsInterval = 0;
+    G_ZoomCount = 2;
+    G_ZoomCentre[0] = 19000.0f;  G_ZoomSpan[0] = 1000.0f;
+    G_ZoomCentre[1] = 57000.0f;  G_ZoomSpan[1] = 6000.0f;
+
+    MpxGenerator *gen = (MpxGenerator*)malloc(sizeof(MpxGenerator));
+    SpectrumOutput *output = (SpectrumOutput*)malloc(sizeof(SpectrumOutput));
+    MeterStage *meter = (MeterStage*)malloc(sizeof(MeterStage));
+    static float in[BLOCK_FRAMES * 2];
+    static MeterBlock blk;
+    if (!gen || !output || !meter || !Config_Publish() || !SpectrumOutput_Init(output, sr, 0)) {
+        fprintf(stderr, "[MPX] Memory allocation failed!\n");
+        return 1;
+    }
+    MeterStage_Init(meter, sr, SAMPLE_FLOAT_LE, 2);
+    meter->pollConfig = 0;
+    meter->stats = &output->stats;
+    if (!MpxGen_Init(gen, sr, gp, seconds)) {
+        fprintf(stderr, "[MPX] Memory allocation failed!\n");
+        return 1;
+    }
+
+    fprintf(stderr, "[BENCH] %.0f s at %d Hz: pilot %.2f kHz %+.2f Hz, RDS %.2f kHz, program %.1f kHz, 38 kHz residual %.2f kHz, noise %.2f kHz rms, burst %.1f kHz every %.1f s\n",
+            seconds, sr, gp->pilotKHz, gp->pilotOffsetHz, gp->rdsKHz, gp->programKHz, gp->carrierKHz, gp->noiseKHz, gp->burstKHz, gp->burstEvery);
+
+    // Generate outside the timed region: the whole signal up front would
+    // be large, so per block with the generator time subtracted.
+    G_StageTiming = 1;
+
+    long long blocks = (long long)(seconds * (double)sr) / BLOCK_FRAMES;
+    double genSeconds = 0.0, total = 0.0;
+    double maxM = 0.0, bs412Want = 0.0;
+    float lastP = 0, lastR = 0, lastB = 0;
+    StereoInfo lastSt;
+    memset(&lastSt, 0, sizeof(lastSt));
+    const long long warmupBlocks = (long long)(2.0 * sr) / BLOCK_FRAMES;
+
+    for (long long b = 0; b < blocks; b++) {
+        uint64_t t0 = stats_clock_ns();
+        MpxGen_Block(gen, in, BLOCK_FRAMES);
+        uint64_t t1 = stats_clock_ns();
+        MeterStage_ProcessBlock(meter, in, &blk);
+        SpectrumOutput_ProcessBlock(output, &blk);
+        uint64_t t2 = stats_clock_ns();
+        genSeconds += (double)(t1 - t0) * 1e-9;
+        total += (double)(t2 - t1) * 1e-9;
+
+        for (int k = 0; k < blk.nMarks; k++) {
+            lastP = blk.marks[k].p;
+            lastR = blk.marks[k].r;
+            lastB = blk.marks[k].b;
+            lastSt = blk.marks[k].st;
+            // Same window as the meter: completed 100 ms sub-windows
+            long long at = b * BLOCK_FRAMES + blk.marks[k].pos;
+            bs412Want = 10.0 * log10(MpxGen_WindowPower(gen, at) / BS412_REF_POWER + 1e-12);
+            if (b >= warmupBlocks && blk.marks[k].m > maxM) maxM = blk.marks[k].m;
+        }
+    }
+    G_StageTiming = 0;
+
+    StatsSnapshot st;
+    StreamStats_Take(&output->stats, &st);
+    double audio = (double)(blocks * BLOCK_FRAMES) / (double)sr;
+    fprintf(stderr, "[BENCH] total   %8.3f s  %10.0f samples/s  realtime x%.1f  (generator %.3f s, not counted)\n",
+            total, audio * sr / fmax(total, 1e-9), audio / fmax(total, 1e-9), genSeconds);
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        double sec = (double)st.stageNs[s] * 1e-9;
+        fprintf(stderr, "[BENCH] %-9s %7.3f s  %5.1f%%  %10.0f samples/s  realtime x%.1f\n",
+                G_StageNames[s], sec, 100.0 * sec / fmax(total, 1e-9),
+                audio * sr / fmax(sec, 1e-9), audio / fmax(sec, 1e-9));
+    }
 
-            if (counter >= outputSampleThreshold) {
+    int ok = 1;
+    ok &= bench_check("pilot", lastP, gp->pilotKHz, 0.02, 1);
+    ok &= bench_check("rds", lastR, gp->rdsKHz * BENCH_RDS_RMS_FACTOR, 0.05, 1);
+    ok &= bench_check("peak", maxM, gen->peakKHz, 0.03, 1);
+    ok &= bench_check("bs412", lastB, bs412Want, 0.05, 0);
+    if (gp->rdsKHz > 0.0) {
+        const RdsInfo *ri = &blk.rds;
+        int rdsOk = ri->pi == BENCH_RDS_PI && strcmp(ri->ps, BENCH_RDS_PS) == 0 && strcmp(ri->rt, BENCH_RDS_RT) == 0;
+        fprintf(stderr, "[BENCH] rds-data PI %04X PS '%s' RT '%s' (%u groups)  %s\n",
+                ri->pi >= 0 ? ri->pi : 0, ri->ps, ri->rt, ri->groups, rdsOk ? "PASS" : "FAIL");
+        ok &= rdsOk;
+        ok &= bench_check("rds-bler", ri->bler, 0.0, 0.01, 0);
+    }
+    if (gp->noiseKHz > 0.0 && output->noise.nGap >= NOISE_MIN_BINS) {
+        // White noise over 0 .. sr/2
+        const NoiseInfo *ni = &output->noiseInfo;
+        double n2 = gp->noiseKHz * gp->noiseKHz / (0.5 * (double)sr);
+        ok &= bench_check("nf", ni->nf, sqrt(n2 * NOISE_REF_HZ), 0.06, 1);
+        if (gp->pilotKHz > 0.0) {
+            ok &= bench_check("nf-pilot", ni->pilotSnr,
+                              10.0 * log10(0.5 * gp->pilotKHz * gp->pilotKHz / (n2 * NOISE_REF_HZ)), 1.0, 0);
+        }
+        if (gp->rdsKHz > 0.0) {
+            ok &= bench_check("nf-rds", ni->rdsSnr,
+                              10.0 * log10(0.5 * gp->rdsKHz * gp->rdsKHz * BENCH_RDS_BAND_FACTOR / (n2 * 2.0 * NOISE_RDS_HALF_HZ)), 1.0, 0);
+        }
+    }
+    if (blk.devOn) {
+        // The whole run is inside the 24 h window. Program, pilot, RDS and
+        // noise alone stay below the limit, so every burst that ended
+        // before the last summary is exactly one event.
+        const DevWindowInfo *dw = &blk.dev.w[DEV_WINDOWS - 1];
+        ok &= bench_check("dev-max", dw->max, gen->peakKHz, 0.03, 1);
+        double quiet = gp->programKHz + gp->pilotKHz + gp->rdsKHz + gp->carrierKHz + 5.0 * gp->noiseKHz;
+        if (gp->burstEvery > 0.0 && gp->burstKHz > G_DeviationLimit && quiet < G_DeviationLimit) {
+            double bursts = floor((dw->seconds - BENCH_BURST_MS / 1000.0) / gp->burstEvery - 0.5) + 1.0;
+            ok &= bench_check("dev-events", dw->events, fmax(bursts, 0.0), 0.0, 0);
+        }
+    }
+    const ZoomSpectrum *zs = &output->zoom;
+    if (zs->count == 2) {
+        // Pilot: peak bin, and the power over its main lobe; RDS: the
+        // power within NOISE_RDS_HALF_HZ (see ZOOM SPECTRUM)
+        const ZoomWindow *zp = &zs->w[0], *zr = &zs->w[1];
+        int pk = 0;
+        for (int k = 1; k <= 2 * zp->half; k++) if (zp->amp[k] > zp->amp[pk]) pk = k;
+        if (gp->pilotKHz > 0.0 && zp->amp[pk] > 0.0f) {
+            double pow = 0.0;
+            for (int k = (pk > 4 ? pk - 4 : 0); k <= pk + 4 && k <= 2 * zp->half; k++) pow += (double)zp->amp[k] * zp->amp[k];
+            ok &= bench_check("zoom-f", zp->centre + (float)(pk - zp->half) * zp->binHz, 19000.0 + gp->pilotOffsetHz, zp->binHz, 0);
+            ok &= bench_check("zoom-p", sqrt(pow / zs->noiseBw), gp->pilotKHz, 0.02, 1);
+        }
+        int lim = (int)(NOISE_RDS_HALF_HZ / zr->binHz);
+        if (gp->rdsKHz > 0.0 && zr->amp[zr->half] > 0.0f && lim <= zr->half) {
+            double pow = 0.0;
+            for (int k = zr->half - lim; k <= zr->half + lim; k++) pow += (double)zr->amp[k] * zr->amp[k];
+            ok &= bench_check("zoom-r", sqrt(pow / zs->noiseBw), gp->rdsKHz * sqrt(BENCH_RDS_BAND_FACTOR), 0.05, 1);
+        }
+    }
+    if (lastSt.on) {
+        double pl = gen->powL, pr = gen->powR;
+        ok &= bench_check("st-l", lastSt.l, sqrt(pl), 0.02, 1);
+        ok &= bench_check("st-r", lastSt.r, sqrt(pr), 0.02, 1);
+        ok &= bench_check("st-sep", lastSt.sep, 10.0 * log10(fmax(pl, pr) / fmin(pl, pr)), 0.2, 0);
+        ok &= bench_check("st-cor", lastSt.cor, gen->prodLR / sqrt(pl * pr), 0.01, 0);
+        ok &= bench_check("st-c38", lastSt.c38, gp->pilotKHz > 0.0 ? gp->carrierKHz : 0.0, 0.02, 0);
+        ok &= bench_check("st-ppm", lastSt.ppm, gp->pilotKHz > 0.0 ? gp->pilotOffsetHz / 19000.0 * 1e6 : 0.0, 1.0, 0);
+    }
+    fprintf(stderr, "[BENCH] %s\n", ok ? "PASS" : "FAIL");
+
+    SpectrumOutput_Free(output);
+    free(output);
+    free(meter);
+    free(gen->subSums);
+    free(gen);
+    return ok ? 0 : 1;
+}
 
-                float pScaled = demod.pilotMag * G_MeterPilotScale;
-                float rScaled = demod.rdsMag   * G_MeterRDSScale;
+/* ============================================================
+   MAIN
+   ============================================================ */
+// --version prints "MPXCapture <version> <feature>...". The server picks
+// its arguments from the features; builds without the option print
+// nothing and get the original command line (stdin float, JSON).
+#define MPX_VERSION  "2"
+#ifdef MPX_WITH_ALSA
+#define MPX_FEATURE_ALSA " alsa"
+#else
+#define MPX_FEATURE_ALSA ""
+#endif
+#define MPX_FEATURES "binary format shm" MPX_FEATURE_ALSA
 
-                if (smoothP == 0.0f) smoothP = pScaled; else smoothP = smoothP * 0.90f + pScaled * 0.10f;
-                if (smoothR == 0.0f) smoothR = rScaled; else smoothR = smoothR * 0.90f + rScaled * 0.10f;
+int main(int argc, char **argv)
+{
+    int sr = 192000;
+    int fftSize = 4096;
+    int useThreads = 1;
+    int waitWhenFull = -1;     // -1 = drop for live input, wait for files
+    const char *inputSpecs[MAX_INPUTS];
+    int nInputs = 0;
+    int bothChannels = 0;
+    int nWorkers = 0;           // 0 = one per CPU, at most one per stream
+    InputOptions inputOpt = { SAMPLE_FLOAT_LE, 0, 0 };
+    double benchSeconds = 0.0;
+    GenParams gen = { 9.0, 0.0, 3.0, 60.0, 0.05, 110.0, 2.0, 0.1 };
+
+    // Positional: <sampleRate> <device> <fftSize> <configPath>
+    // Options (anywhere): --output=json|f32|u16|u8|shm  --shm=PATH  --threads=0|1  --overflow=drop|wait
+    //                     --input=stdin|file:PATH|alsa[:DEVICE]  --period=FRAMES  --buffer=FRAMES
+    //                     --format=FLOAT_LE|S16_LE|S24_3LE|S32_LE
+    //                     --input= may be repeated (multi-source)  --channels=auto|both  --workers=N
+    //                     --stats=MS (stats record every MS ms of audio, see STATS)
+    //                     --control=PATH (live reconfiguration socket, see CONFIG WATCHER)
+    //                     --archive=PATH --archive-days=N --archive-second-days=N --archive-source=N
+    //                     (per-second / per-minute metrics file, see METRICS ARCHIVE)
+    //                     --version (see MPX_FEATURES)
+    //                     --bench[=SECONDS] --gen-pilot= --gen-pilot-offset= --gen-rds= --gen-program=
+    //                     --gen-noise= --gen-burst= --gen-burst-every= --gen-c38=  (see BENCHMARK)
+    const char *pos[4] = { NULL, NULL, NULL, NULL };
+    int npos = 0;
+    for (int a = 1; a < argc; a++) {
+        if (strncmp(argv[a], "--", 2) == 0) {
+            const char *opt = argv[a] + 2;
+            if (strncmp(opt, "output=", 7) == 0) {
+                int fmt = parse_output_format(opt + 7);
+                if (fmt < 0) fprintf(stderr, "[MPX] Unknown output format '%s', using json\n", opt + 7);
+                else G_OutputFormat = fmt;
+            } else if (strcmp(opt, "version") == 0) {
+                printf("MPXCapture %s %s\n", MPX_VERSION, MPX_FEATURES);
+                return 0;
+            } else if (strncmp(opt, "threads=", 8) == 0) {
+                useThreads = atoi(opt + 8) != 0;
+            } else if (strncmp(opt, "overflow=", 9) == 0) {
+                waitWhenFull = strcmp(opt + 9, "wait") == 0;
+            } else if (strncmp(opt, "input=", 6) == 0) {
+                if (nInputs < MAX_INPUTS) inputSpecs[nInputs++] = opt + 6;
+                else fprintf(stderr, "[MPX] At most %d inputs, ignoring '%s'\n", MAX_INPUTS, opt + 6);
+            } else if (strncmp(opt, "channels=", 9) == 0) {
+                bothChannels = strcmp(opt + 9, "both") == 0;
+            } else if (strcmp(opt, "bench") == 0 || strncmp(opt, "bench=", 6) == 0) {
+                benchSeconds = (opt[5] == '=') ? atof(opt + 6) : 20.0;
+                if (benchSeconds < 3.0) benchSeconds = 3.0;
+            } else if (strncmp(opt, "gen-pilot=", 10) == 0) {
+                gen.pilotKHz = atof(opt + 10);
+            } else if (strncmp(opt, "gen-pilot-offset=", 17) == 0) {
+                gen.pilotOffsetHz = atof(opt + 17);
+            } else if (strncmp(opt, "gen-rds=", 8) == 0) {
+                gen.rdsKHz = atof(opt + 8);
+            } else if (strncmp(opt, "gen-program=", 12) == 0) {
+                gen.programKHz = atof(opt + 12);
+            } else if (strncmp(opt, "gen-noise=", 10) == 0) {
+                gen.noiseKHz = atof(opt + 10);
+            } else if (strncmp(opt, "gen-burst=", 10) == 0) {
+                gen.burstKHz = atof(opt + 10);
+            } else if (strncmp(opt, "gen-burst-every=", 16) == 0) {
+                gen.burstEvery = atof(opt + 16);
+            } else if (strncmp(opt, "gen-c38=", 8) == 0) {
+                gen.carrierKHz = atof(opt + 8);
+            } else if (strncmp(opt, "stats=", 6) == 0) {
+                G_StatsInterval = atoi(opt + 6);
+            } else if (strncmp(opt, "control=", 8) == 0) {
+                G_ControlPath = opt + 8;
+            } else if (strncmp(opt, "shm=", 4) == 0) {
+                G_ShmPath = opt + 4;
+            } else if (strncmp(opt, "archive=", 8) == 0) {
+                G_ArchivePath = opt + 8;
+            } else if (strncmp(opt, "archive-days=", 13) == 0) {
+                G_ArchiveDays[1] = atoi(opt + 13);
+            } else if (strncmp(opt, "archive-second-days=", 20) == 0) {
+                G_ArchiveDays[0] = atoi(opt + 20);
+            } else if (strncmp(opt, "archive-source=", 15) == 0) {
+                G_ArchiveSource = atoi(opt + 15);
+            } else if (strncmp(opt, "workers=", 8) == 0) {
+                nWorkers = atoi(opt + 8);
+            } else if (strncmp(opt, "format=", 7) == 0) {
+                int sf = parse_sample_format(opt + 7);
+                if (sf < 0) fprintf(stderr, "[MPX] Unknown sample format '%s', using FLOAT_LE\n", opt + 7);
+                else inputOpt.format = sf;
+            } else if (strncmp(opt, "period=", 7) == 0) {
+                inputOpt.periodFrames = atoi(opt + 7);
+            } else if (strncmp(opt, "buffer=", 7) == 0) {
+                inputOpt.bufferFrames = atoi(opt + 7);
+            } else {
+                fprintf(stderr, "[MPX] Unknown option '%s'\n", argv[a]);
+            }
+        } else if (npos < 4) {
+            pos[npos++] = argv[a];
+        }
+    }
 
-                // BS.412 dBr calculation (relative to 19kHz sine power)
-                float bs412_dBr = 10.0f * log10f((bs412_power + 1e-12f) / BS412_REF_POWER);
-                
-                // Slower smoothing for BS412 text display
-                if (smoothB < -90.0f) smoothB = bs412_dBr; else smoothB = smoothB * 0.98f + bs412_dBr * 0.02f;
+    if (pos[0]) sr = atoi(pos[0]);
 
-                float mFinal = envPeak * G_MeterMPXScale;
+    const char *devName = "Default";
+    if (pos[1] && strlen(pos[1]) > 0) devName = pos[1];
 
-                if (fftIndex >= fftSize) {
-                    QuickFFT(fftBuf, fftSize);
+    if (pos[2]) fftSize = atoi(pos[2]);
+    if (!is_power_of_two(fftSize) || fftSize < CONFIG_MIN_FFT || fftSize > CONFIG_MAX_FFT) fftSize = 4096;
 
-                    printf("{\"p\":%.4f,\"r\":%.4f,\"m\":%.4f,\"b\":%.4f,\"s\":[", smoothP, smoothR, mFinal, smoothB);
+    if (benchSeconds > 0.0) return Bench_Run(sr, fftSize, benchSeconds, &gen);
 
-                    for (int k = 0; k < maxBin; k++) {
-                        float mag = hypotf(fftBuf[k].r, fftBuf[k].i);
-                        float linearAmp = (mag * 2.0f) / (float)fftSize;
+    // The config file may change fftSize (also later, see CONFIG SNAPSHOT)
+    G_FftSize = fftSize;
+    if (pos[3]) {
+        strncpy(G_ConfigPath, pos[3], 1023);
+        G_ConfigPath[1023] = 0;
+        update_config(1);
+    }
+    if (!Config_Publish()) {
+        fprintf(stderr, "[MPX] Memory allocation failed!\n");
+        return 1;
+    }
+    fftSize = G_FftSize;
 
-                        if (linearAmp > smoothBuf[k]) {
-                            smoothBuf[k] = smoothBuf[k] * (1.0f - G_SpectrumAttack) + linearAmp * G_SpectrumAttack;
-                        } else {
-                            smoothBuf[k] = smoothBuf[k] * (1.0f - G_SpectrumDecay)  + linearAmp * G_SpectrumDecay;
-                        }
+#ifdef _WIN32
+    _setmode(_fileno(stdin),  _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
 
-                        if (k) printf(",");
-                        printf("%.4f", smoothBuf[k] * 15.0f);
-                    }
-                    printf("]}\n");
-                    fftIndex = 0;
-                }
+    if (nInputs == 0) inputSpecs[nInputs++] = "stdin";
 
-                counter = 0;
+    static InputSource inputs[MAX_INPUTS];
+    int anyRealtime = 0;
+    for (int i = 0; i < nInputs; i++) {
+        InputSource *src = &inputs[i];
+        if (!Input_Open(src, inputSpecs[i], devName, sr, &inputOpt)) return 1;
+        if (i == 0 && src->sampleRate > 0 && src->sampleRate != sr) {
+            fprintf(stderr, "[MPX] Input runs at %d Hz, overriding %d Hz\n", src->sampleRate, sr);
+            sr = src->sampleRate;
+        }
+        anyRealtime |= src->realtime;
+    }
+    if (waitWhenFull < 0) waitWhenFull = !anyRealtime;
+
+    // One stream per input, or per channel of each stereo input
+    static Stream streams[MAX_STREAMS];
+    int nStreams = 0;
+    for (int i = 0; i < nInputs; i++) {
+        int split = bothChannels && inputs[i].channels == 2;
+        for (int ch = 0; ch <= split; ch++) {
+            Stream *st = &streams[nStreams];
+            int streamSr = inputs[i].sampleRate > 0 ? inputs[i].sampleRate : sr;
+            st->input = i;
+            st->output = (SpectrumOutput*)malloc(sizeof(SpectrumOutput));
+            st->meter = (MeterStage*)malloc(sizeof(MeterStage));
+            if (!st->output || !st->meter || !SpectrumOutput_Init(st->output, streamSr, nStreams)) {
+                fprintf(stderr, "[MPX] Memory allocation failed!\n");
+                return 1;
             }
+            MeterStage_Init(st->meter, streamSr, inputs[i].format, inputs[i].channels);
+            st->meter->pollConfig = (nStreams == 0);
+            st->meter->stats = &st->output->stats;
+            if (split) MeterStage_FixChannel(st->meter, ch);
+            nStreams++;
+        }
+    }
+    G_TagSources = nStreams > 1;
+    if (G_StatsInterval > 0) {
+        if (G_StatsInterval < 100) G_StatsInterval = 100;
+        G_StageTiming = 1;
+        fprintf(stderr, "[MPX] Stats record every %d ms\n", G_StatsInterval);
+    }
+    // Slots fit the largest FFT the config can switch to
+    int shmBins = CONFIG_MAX_FFT / 2;
+    if (G_OutputFormat == OUT_SHM && !Shm_Open(nStreams, shmBins)) return 1;
+    // Without the archive the analysis still runs
+    if (G_ArchivePath && !Archive_Open()) fprintf(stderr, "[MPX] archive: off\n");
+
+    static const char *fmtNames[] = { "json", "f32", "u16", "u8", "shm" };
+    fprintf(stderr, "[MPX] Init SR:%d FFT:%d Dev:'%s' In:%s %s | MODE: DEVA-DSP (PLL+IQ, RDS dual-ref, truepeak) | Output: %s\n",
+            sr, fftSize, devName, inputs[0].kind, G_SampleFormatNames[inputs[0].format], fmtNames[G_OutputFormat]);
+    for (int k = 0; G_TagSources && k < nStreams; k++) {
+        const MeterStage *ms = streams[k].meter;
+        fprintf(stderr, "[MPX] Source %d: input %d (%s '%s'), %d Hz, channel %s\n",
+                k, streams[k].input, inputs[streams[k].input].kind, inputSpecs[streams[k].input], ms->sr,
+                !ms->channel_locked ? "auto" : ms->active_channel ? "RIGHT" : "LEFT");
+    }
+
+    // From here on the config thread (if any) owns config changes
+    if (ConfigWatcher_Start()) streams[0].meter->pollConfig = 0;
+
+    int ran = 0;
+#ifndef MPX_NO_THREADS
+    if (useThreads) {
+        if (nStreams == 1) {
+            ran = Pipeline_Run(&inputs[0], streams[0].meter, streams[0].output, waitWhenFull);
+        } else {
+            if (nWorkers <= 0) nWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            if (nWorkers < 1) nWorkers = 1;
+            if (nWorkers > nStreams) nWorkers = nStreams;
+            ran = MultiPipeline_Run(inputs, nInputs, streams, nStreams, nWorkers, waitWhenFull);
         }
+        if (!ran) fprintf(stderr, "[MPX] Thread setup failed, running single-threaded\n");
     }
+#else
+    (void)useThreads;
+    (void)waitWhenFull;
+    (void)nWorkers;
+#endif
+
+    if (!ran) Streams_RunSingle(inputs, nInputs, streams, nStreams);
 
-    free(smoothBuf);
-    free(window);
-    free(fftBuf);
+    for (int i = 0; i < nInputs; i++) inputs[i].close(&inputs[i]);
+    for (int k = 0; k < nStreams; k++) {
+        SpectrumOutput_Free(streams[k].output);
+        free(streams[k].output);
+        free(streams[k].meter);
+    }
+    ConfigWatcher_Stop();
+    Config_FreeAll();
+    Shm_Close();
+    Archive_Close();
     return 0;
-}
\ No newline at end of file
+}
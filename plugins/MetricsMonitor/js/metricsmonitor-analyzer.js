@@ -65,7 +65,7 @@ const MpxHub = (() => {
         try { msg = JSON.parse(evt.data); } catch { return; }
         if (!msg || typeof msg !== "object" || msg.type !== "MPX" || !Array.isArray(msg.value)) return;
         listeners.forEach(fn => {
-          try { fn(msg.value); } catch (e) { /* ignore */ }
+          try { fn(msg.value, msg.scale || null); } catch (e) { /* ignore */ }
         });
       };
       ws.onclose = () => scheduleReconnect();
@@ -190,6 +190,8 @@ function createAnalyzerInstance(containerId = "level-meter-container", options =
   //////////////////////////////////////////////////////////////////
   let mpxSpectrum = [];
   let mpxSmoothSpectrum = [];
+  // Non-linear display-bin layout from MPXCapture ({ type, fLow, fHigh }), null = linear
+  let mpxBinScale = null;
 
   const TOP_MARGIN = 18;
   const BOTTOM_MARGIN = 14;
@@ -281,13 +283,36 @@ function createAnalyzerInstance(containerId = "level-meter-container", options =
   //////////////////////////////////////////////////////////////////
   function getDisplayRange() { return { min: visibleDbMin, max: visibleDbMax }; }
 
+  // Position (0..1) of a frequency within a non-linear bin layout, and back.
+  // "mpx" puts 80% of the bins below fLow (see DISPLAY BINS in MPXCapture.c).
+  const MPX_SCALE_SHARE = 0.8;
+
+  function scaleFreqToPos(freqHz) {
+    const s = mpxBinScale;
+    if (s.type === "log") return Math.log(Math.max(freqHz, s.fLow) / s.fLow) / Math.log(s.fHigh / s.fLow);
+    if (freqHz < s.fLow) return (freqHz / s.fLow) * MPX_SCALE_SHARE;
+    return MPX_SCALE_SHARE + ((freqHz - s.fLow) / (s.fHigh - s.fLow)) * (1 - MPX_SCALE_SHARE);
+  }
+
+  function scalePosToFreq(pos) {
+    const s = mpxBinScale;
+    if (s.type === "log") return s.fLow * Math.pow(s.fHigh / s.fLow, pos);
+    if (pos < MPX_SCALE_SHARE) return s.fLow * pos / MPX_SCALE_SHARE;
+    return s.fLow + (s.fHigh - s.fLow) * (pos - MPX_SCALE_SHARE) / (1 - MPX_SCALE_SHARE);
+  }
+
   function freqToBin(freqHz, totalBins) {
+    if (mpxBinScale) {
+      const binIndex = scaleFreqToPos(freqHz) * (totalBins - 1);
+      return Math.round(Math.max(0, Math.min(totalBins - 1, binIndex)));
+    }
     const normalizedDisplayX = freqHz / (MPX_FMAX_HZ * LABEL_CURVE_X_SCALE);
     const binIndex = normalizedDisplayX * (totalBins - 1) / CURVE_X_STRETCH;
     return Math.round(Math.max(0, Math.min(totalBins - 1, binIndex)));
   }
 
   function binToFreq(binIndex, totalBins) {
+    if (mpxBinScale) return scalePosToFreq(binIndex / (totalBins - 1));
     const normalizedDisplayX = (binIndex / (totalBins - 1)) * CURVE_X_STRETCH;
     const freqHz = normalizedDisplayX * MPX_FMAX_HZ * LABEL_CURVE_X_SCALE;
     return freqHz;
@@ -608,7 +633,10 @@ function createAnalyzerInstance(containerId = "level-meter-container", options =
         if (val > MPX_DB_MAX_DEFAULT) val = MPX_DB_MAX_DEFAULT;
         const norm = (val - range.min) / (range.max - range.min);
         const y = TOP_MARGIN + (1 - norm) * usableHeight * Y_STRETCH;
-        const x = leftStart + ((i / (mpxSpectrum.length - 1)) * usableWidth * CURVE_X_STRETCH) * horizontalScale;
+        const xFrac = mpxBinScale
+          ? binToFreq(i, mpxSpectrum.length) / (MPX_FMAX_HZ * LABEL_CURVE_X_SCALE)
+          : (i / (mpxSpectrum.length - 1)) * CURVE_X_STRETCH;
+        const x = leftStart + (xFrac * usableWidth) * horizontalScale;
         if (i === 0) ctx.moveTo(x, y);
         else ctx.lineTo(x, y);
       }
@@ -747,10 +775,18 @@ function createAnalyzerInstance(containerId = "level-meter-container", options =
   //////////////////////////////////////////////////////////////////
   // Data Handler (per instance)
   //////////////////////////////////////////////////////////////////
-  function handleMpxArray(data) {
+  function handleMpxArray(data, scale = null) {
     if (!canvas || !canvas.isConnected) return;
     if (!Array.isArray(data) || data.length === 0) return;
 
+    // Bin layout changed (SpectrumBins / SpectrumBinScale): restart smoothing
+    const scaleKey = scale ? `${scale.type}:${scale.fLow}:${scale.fHigh}` : "";
+    const oldKey = mpxBinScale ? `${mpxBinScale.type}:${mpxBinScale.fLow}:${mpxBinScale.fHigh}` : "";
+    if (scaleKey !== oldKey || data.length !== mpxSmoothSpectrum.length) {
+      mpxBinScale = scale;
+      mpxSmoothSpectrum = [];
+    }
+
     const arr = [];
     for (let i = 0; i < data.length; i++) {
       // Support both old format {f, m} and new format (just magnitude number)
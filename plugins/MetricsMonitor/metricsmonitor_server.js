@@ -22,10 +22,11 @@ let ENABLE_EXTENDED_LOGGING = false;
 //  MODULE IMPORTS
 //  We need these built-in Node.js modules and external dependencies to function.
 // ====================================================================================
-const { spawn, execSync } = require("child_process");
+const { spawn, spawnSync, execSync } = require("child_process");
 const WebSocket = require("ws");
 const fs = require("fs");
 const path = require("path");
+const net = require("net");
 
 // Import core server utilities for logging and configuration
 // These paths assume the standard file structure of the FM-DX-Webserver
@@ -54,6 +55,14 @@ const defaultConfig = {
   MPXmode: "off",               // Mode switch (off/auto/on)
   MPXStereoDecoder: "off",      // Internal stereo decoder switch
   MPXInputCard: "",             // Input device name (if empty, uses config.json device)
+  MPXOutputFormat: "json",      // MPXCapture -> server transport: "json", "binary", "binary16", "binary8", "shm" (Linux only)
+  MPXInputBackend: "arecord",   // Linux capture: "arecord" (pipe) or "alsa" (MPXCapture opens the card itself, mmap)
+  MPXSampleFormat: "FLOAT_LE",  // Linux capture sample format: "FLOAT_LE", "S16_LE", "S24_3LE", "S32_LE"
+  MPXChannels: "auto",          // Linux: "auto" (analyse the louder channel) or "both" (L = source 0, R = source 1)
+  MPXSourceId: 0,               // Source shown by the meters/spectrum when MPXCapture analyses several sources
+  MPXStatsInterval: 0,          // Linux: seconds between MPXCapture stats records (stage timing, drops), 0 = off
+  MPXArchiveDays: 0,            // Linux: days of 1-minute metrics kept in the archive file, 0 = no archive
+  MPXArchiveSecondDays: 7,      // Linux: days of 1-second metrics kept in the archive file
 
   // 2. Calibration Offsets (Meters)
   MeterInputCalibration: 0.0,
@@ -195,6 +204,14 @@ function normalizePluginConfig(json) {
     MPXmode: typeof json.MPXmode !== "undefined" ? json.MPXmode : defaultConfig.MPXmode,
     MPXStereoDecoder: typeof json.MPXStereoDecoder !== "undefined" ? json.MPXStereoDecoder : defaultConfig.MPXStereoDecoder,
     MPXInputCard: typeof json.MPXInputCard !== "undefined" ? json.MPXInputCard : defaultConfig.MPXInputCard,
+    MPXOutputFormat: typeof json.MPXOutputFormat !== "undefined" ? json.MPXOutputFormat : defaultConfig.MPXOutputFormat,
+    MPXInputBackend: typeof json.MPXInputBackend !== "undefined" ? json.MPXInputBackend : defaultConfig.MPXInputBackend,
+    MPXSampleFormat: typeof json.MPXSampleFormat !== "undefined" ? json.MPXSampleFormat : defaultConfig.MPXSampleFormat,
+    MPXChannels: typeof json.MPXChannels !== "undefined" ? json.MPXChannels : defaultConfig.MPXChannels,
+    MPXSourceId: typeof json.MPXSourceId !== "undefined" ? json.MPXSourceId : defaultConfig.MPXSourceId,
+    MPXStatsInterval: typeof json.MPXStatsInterval !== "undefined" ? json.MPXStatsInterval : defaultConfig.MPXStatsInterval,
+    MPXArchiveDays: typeof json.MPXArchiveDays !== "undefined" ? json.MPXArchiveDays : defaultConfig.MPXArchiveDays,
+    MPXArchiveSecondDays: typeof json.MPXArchiveSecondDays !== "undefined" ? json.MPXArchiveSecondDays : defaultConfig.MPXArchiveSecondDays,
 
     MeterInputCalibration: typeof json.MeterInputCalibration !== "undefined" ? json.MeterInputCalibration : defaultConfig.MeterInputCalibration,
     MeterPilotCalibration: typeof json.MeterPilotCalibration !== "undefined" ? json.MeterPilotCalibration : defaultConfig.MeterPilotCalibration,
@@ -341,6 +358,14 @@ let SPECTRUM_DECAY_LEVEL;
 let MPX_MODE;
 let MPX_STEREO_DECODER;
 let MPX_INPUT_CARD;
+let MPX_OUTPUT_FORMAT;
+let MPX_INPUT_BACKEND;
+let MPX_SAMPLE_FORMAT;
+let MPX_CHANNELS;
+let MPX_SOURCE_ID;
+let MPX_STATS_INTERVAL;
+let MPX_ARCHIVE_DAYS;
+let MPX_ARCHIVE_SECOND_DAYS;
 let LOCK_VOLUME_SLIDER;
 let ENABLE_SPECTRUM_ON_LOAD;
 
@@ -403,6 +428,17 @@ function applyConfig(newConfig) {
     MPX_STEREO_DECODER = String(configPlugin.MPXStereoDecoder || "off").toLowerCase();
     
     MPX_INPUT_CARD = String(configPlugin.MPXInputCard || "").replace(/^["'](.*)["']$/, "$1").trim();
+    MPX_OUTPUT_FORMAT = String(configPlugin.MPXOutputFormat || "json").toLowerCase();
+    if (!["json", "binary", "binary16", "binary8", "shm"].includes(MPX_OUTPUT_FORMAT)) MPX_OUTPUT_FORMAT = "json";
+    MPX_INPUT_BACKEND = String(configPlugin.MPXInputBackend || "arecord").toLowerCase();
+    if (!["arecord", "alsa"].includes(MPX_INPUT_BACKEND)) MPX_INPUT_BACKEND = "arecord";
+    MPX_SAMPLE_FORMAT = String(configPlugin.MPXSampleFormat || "FLOAT_LE").toUpperCase();
+    if (!["FLOAT_LE", "S16_LE", "S24_3LE", "S32_LE"].includes(MPX_SAMPLE_FORMAT)) MPX_SAMPLE_FORMAT = "FLOAT_LE";
+    MPX_CHANNELS = String(configPlugin.MPXChannels || "auto").toLowerCase() === "both" ? "both" : "auto";
+    MPX_SOURCE_ID = Math.max(0, Math.min(255, Math.trunc(Number(configPlugin.MPXSourceId) || 0)));
+    MPX_STATS_INTERVAL = Math.max(0, Math.min(3600, Number(configPlugin.MPXStatsInterval) || 0));
+    MPX_ARCHIVE_DAYS = Math.max(0, Math.min(366, Math.round(Number(configPlugin.MPXArchiveDays) || 0)));
+    MPX_ARCHIVE_SECOND_DAYS = Math.max(1, Math.min(366, Math.round(Number(configPlugin.MPXArchiveSecondDays) || 7)));
     
     LOCK_VOLUME_SLIDER = configPlugin.LockVolumeSlider === true;
     ENABLE_SPECTRUM_ON_LOAD = configPlugin.EnableSpectrumOnLoad === true;
@@ -1206,8 +1242,51 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
   
   let dataPluginsWs = null;
   let reconnectTimer = null;
-  let backpressureHits = 0;
-  const MAX_BACKPRESSURE_HITS = 200;
+
+  // ------------------------------------------------------------------------------------
+  //  FAN-OUT
+  //  A message is encoded once into a Buffer and the same Buffer goes to every
+  //  consumer (sent as a text frame, the browsers parse JSON). A consumer whose
+  //  socket is still draining skips messages instead of being disconnected and
+  //  picks up the newest frame once its backlog is below MAX_WS_BACKLOG_BYTES.
+  // ------------------------------------------------------------------------------------
+
+  const mpxConsumers = new Set();   // { ws, dropped }
+
+  function addMpxConsumer(ws) {
+      mpxConsumers.add({ ws, dropped: 0 });
+  }
+
+  function removeMpxConsumer(ws) {
+      for (const c of mpxConsumers) if (c.ws === ws) mpxConsumers.delete(c);
+  }
+
+  function hasMpxConsumers() {
+      for (const c of mpxConsumers) if (c.ws.readyState === WebSocket.OPEN) return true;
+      return false;
+  }
+
+  function encodeMpxMessage(msg) {
+      return Buffer.from(JSON.stringify(msg), "utf8");
+  }
+
+  // skippable: a broadcast frame (a newer one follows); one-off messages are always sent
+  function sendMpxEncoded(data, skippable) {
+      for (const c of mpxConsumers) {
+          if (c.ws.readyState !== WebSocket.OPEN) continue;
+          if (skippable && c.ws.bufferedAmount > MAX_WS_BACKLOG_BYTES) {
+              c.dropped++;
+              continue;
+          }
+          if (skippable) {
+              if (c.dropped && ENABLE_EXTENDED_LOGGING) {
+                  logInfo(`[MPX] Consumer caught up, ${c.dropped} frames skipped.`);
+              }
+              c.dropped = 0;
+          }
+          c.ws.send(data, { binary: false }, () => {});
+      }
+  }
 
   function connectDataPluginsWs() {
     const url = `ws://127.0.0.1:${SERVER_PORT}/data_plugins`;
@@ -1222,17 +1301,18 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
 
     logInfo("[MPX] Connecting to /data_plugins:", url);
 
-    dataPluginsWs = new WebSocket(url);
-    backpressureHits = 0;
+    const ws = new WebSocket(url);
+    dataPluginsWs = ws;
 
-    dataPluginsWs.on("open", () => {
+    ws.on("open", () => {
       logInfo("[MPX] Connected to /data_plugins WebSocket.");
-      backpressureHits = 0;
+      addMpxConsumer(ws);
     });
 
-    dataPluginsWs.on("close", () => {
+    ws.on("close", () => {
       logInfo("[MPX] /data_plugins WebSocket closed  retrying in 5 seconds.");
-      dataPluginsWs = null;
+      removeMpxConsumer(ws);
+      if (dataPluginsWs === ws) dataPluginsWs = null;
 
       if (!reconnectTimer) {
         reconnectTimer = setTimeout(() => {
@@ -1242,11 +1322,11 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
       }
     });
 
-    dataPluginsWs.on("error", (err) => {
+    ws.on("error", (err) => {
       logError("[MPX] /data_plugins WebSocket error:", err);
     });
 
-    dataPluginsWs.on("message", () => {});
+    ws.on("message", (data) => handleMpxClientMessage(data));
   }
 
   connectDataPluginsWs();
@@ -1258,11 +1338,88 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
   let currentPilotPeak = 0;
   let currentRdsPeak = 0;
   let currentMaxPeak = 0;
-  let currentNoiseFloor = 0;
+  let currentBs412 = null;      // BS.412 MPX power, dBr over the last 60 s
+  let currentBs412Max10 = null; // highest 60 s value within 10 / 60 minutes
+  let currentBs412Max60 = null;
+  let currentNoiseFloor = 0;    // kHz RMS in 1 kHz (MPXCapture NOISE FLOOR), 0 until estimated
+  let currentPilotSnr = null;   // dB, pilot against the noise in 1 kHz
+  let currentRdsSnr = null;     // dB, RDS against the noise in its band
   let latestMpxFrame = null;
+  let mpxFrameSeq = 0;         // bumped by every frame of MPX_SOURCE_ID; the broadcast encodes each once
+  let latestMpxScale = null;   // { type, fLow, fHigh } for non-linear display bins, else null
+  let latestMpxStats = null;   // newest stats record of MPX_SOURCE_ID, sent once with the next broadcast
+  let latestMpxRds = null;     // newest RDS record of MPX_SOURCE_ID, likewise
+  let latestMpxDeviation = null;   // newest deviation histogram summary of MPX_SOURCE_ID, likewise
+  let latestMpxZoom = null;    // newest zoom spectrum of MPX_SOURCE_ID per ZoomSpectrum window (by id), likewise
+  let currentStereo = null;    // stereo metrics of the newest frame (StereoMetrics), null when off
 
   const readline = require('readline');
 
+  // Display-bin layout sent by MPXCapture (SpectrumBins / SpectrumBinScale).
+  // The object is reused while the layout is unchanged.
+  function getMpxScale(type, fLow, fHigh) {
+      if (latestMpxScale && latestMpxScale.type === type &&
+          latestMpxScale.fLow === fLow && latestMpxScale.fHigh === fHigh) {
+          return latestMpxScale;
+      }
+      return { type, fLow, fHigh };
+  }
+
+  // Stats record (MPXStatsInterval): log every source, expose ours
+  function handleMpxStats(st) {
+      if (!st || typeof st !== "object") return;
+      const stages = st.stage || {};
+      const stageText = Object.keys(stages).map((k) => `${k} ${Number(stages[k]).toFixed(1)}`).join(" ");
+      logInfo(
+          `[MPX] Stats src${st.src || 0}: ${(st.t / 1000).toFixed(1)} s audio in ${(st.wall / 1000).toFixed(2)} s, ` +
+          `realtime x${Number(st.rt).toFixed(1)} | ${stageText} ms | read wait ${Number(st.read).toFixed(1)} ms, ` +
+          `write ${Number(st.write).toFixed(1)} ms | frames ${st.frames}, dropped ${st.dropIn}/${st.dropBlk} blocks, ` +
+          `late ${st.late} | config #${st.cfg}`
+      );
+      if ((st.src || 0) === MPX_SOURCE_ID) latestMpxStats = st;
+  }
+
+  // One JSON line of MPXCapture; also used by the shm reader when the build writes JSON
+  function handleMpxJsonLine(line) {
+      try {
+          const trimmed = line.trim();
+          if (!trimmed.startsWith('{')) return;
+          
+          const data = JSON.parse(trimmed);
+          if (data.stats) { handleMpxStats(data.stats); return; }
+          if (data.hist) { handleMpxHistory(data.hist); return; }
+          if (data.rds) { handleMpxRds(data.rds); return; }
+          if (data.dev) { handleMpxDeviation(data.dev); return; }
+          if (data.zoom) { handleMpxZoom(data.zoom); return; }
+          if ((data.src || 0) !== MPX_SOURCE_ID) return;
+          
+          if (typeof data.p === 'number') currentPilotPeak = data.p;
+          if (typeof data.r === 'number') currentRdsPeak = data.r;
+          if (typeof data.m === 'number') currentMaxPeak = data.m;
+          if (typeof data.b === 'number') currentBs412 = data.b;
+          if (typeof data.b10 === 'number') currentBs412Max10 = data.b10;
+          if (typeof data.b60 === 'number') currentBs412Max60 = data.b60;
+          currentStereo = (typeof data.sl === 'number')
+              ? { st: data.st, l: data.sl, r: data.sr, m: data.sm, s: data.ss,
+                  sep: data.sep, cor: data.cor, c38: data.c38, ppm: data.ppm }
+              : null;
+          if (typeof data.nf === 'number') {
+              currentNoiseFloor = data.nf;
+              currentPilotSnr = data.psnr;
+              currentRdsSnr = data.rsnr;
+          }
+          mpxFrameSeq++;
+          
+          if (Array.isArray(data.s) && data.s.length > 0) {
+              latestMpxFrame = data.s;
+              latestMpxScale = (typeof data.sc === 'string')
+                  ? getMpxScale(data.sc, data.fl, data.fh)
+                  : null;
+          }
+
+      } catch (e) { }
+  }
+
   function setupJsonReader(childProcess) {
       if (!childProcess || !childProcess.stdout) return;
 
@@ -1271,23 +1428,625 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
           crlfDelay: Infinity 
       });
 
+      rl.on('line', handleMpxJsonLine);
+  }
+
+  // ====================================================================================
+  //  BINARY FRAME READER (MPXOutputFormat: binary / binary16 / binary8)
+  //  Frame layout is documented in MPXCapture.c (OUTPUT section).
+  // ====================================================================================
+
+  const MPX_FRAME_MAGIC = 0x4658504D; // "MPXF"
+  const MPX_FRAME_MAGIC_BYTES = Buffer.from("MPXF", "ascii");
+  const MPX_FRAME_TYPE_SPECTRUM = 1;
+  const MPX_FRAME_TYPE_STATS = 2;
+  const MPX_FRAME_TYPE_HISTORY = 3;
+  const MPX_FRAME_TYPE_RDS = 4;
+  const MPX_FRAME_TYPE_DEVIATION = 5;
+  const MPX_FRAME_TYPE_ZOOM = 6;
+  const MPX_STAGE_NAMES = ["convert", "dcblock", "bs412", "truepeak", "demod", "fft", "output"];
+  const MPX_FRAME_MIN_HEADER = 52;
+  const MPX_FRAME_SCALE_HEADER = 64;   // bin scale fields at 52..63
+  const MPX_FRAME_BS412_HEADER = 72;   // BS.412 maxima at 64..71
+  const MPX_FRAME_STEREO_HEADER = 104; // stereo metrics at 72..103, flags at 54
+  const MPX_FRAME_NOISE_HEADER = 116;  // noise floor, pilot / RDS SNR at 104..115
+  const MPX_FRAME_MAX_HEADER = 1024;   // headers only grow by appended fields
+  const MPX_MAX_FFT = 65536;           // CONFIG_MAX_FFT in MPXCapture.c
+  const MPX_HISTORY_MAX_PAYLOAD = (3600 + 2) * 1024;  // HISTORY_MAX_ROWS / _BINS, full dump
+  const MPX_BIN_SCALE_NAMES = ["linear", "log", "mpx"];
+
+  const round4 = (v) => Math.round(v * 10000) / 10000;
+
+  // dB -> linear lookup tables for the quantized encodings, keyed by range
+  const mpxDequantTables = new Map();
+
+  function getDequantTable(levels, dbMin, dbMax) {
+      const key = `${levels}:${dbMin}:${dbMax}`;
+      let table = mpxDequantTables.get(key);
+      if (!table) {
+          table = new Float64Array(levels);
+          const step = (dbMax - dbMin) / (levels - 1);
+          for (let q = 0; q < levels; q++) {
+              table[q] = round4(Math.pow(10, (dbMin + q * step) / 20));
+          }
+          mpxDequantTables.set(key, table);
+      }
+      return table;
+  }
+
+  let mpxSpectrumArray = [];
+
+  // RDS record (MPXCapture RDS DECODER): PI, PS, PTY, RadioText, block error rate
+  function handleMpxRds(r) {
+      if (!r || typeof r !== "object" || (r.src || 0) !== MPX_SOURCE_ID) return;
+      latestMpxRds = r;
+  }
+
+  // RDS characters -> printable ASCII, as in the JSON records
+  function rdsText(buf, start, len) {
+      let s = "";
+      for (let i = start; i < start + len && buf[i] !== 0; i++) {
+          s += (buf[i] >= 0x20 && buf[i] < 0x7F) ? String.fromCharCode(buf[i]) : "?";
+      }
+      return s;
+  }
+
+  function handleBinaryRds(buf, off, headerBytes, payloadBytes) {
+      const p = off + headerBytes;
+      if (payloadBytes < 84) return;
+      const flags = buf[p + 2];
+      handleMpxRds({
+          src: buf[off + 43],
+          sync: flags & 1,
+          pi: (flags & 2) ? buf.readUInt16LE(p).toString(16).toUpperCase().padStart(4, "0") : "",
+          pty: buf[p + 3],
+          tp: (flags >> 2) & 1,
+          ta: (flags >> 3) & 1,
+          ms: (flags >> 4) & 1,
+          ps: rdsText(buf, p + 12, 8),
+          rt: rdsText(buf, p + 20, 64),
+          bler: round4(buf.readFloatLE(p + 4)),
+          groups: buf.readUInt32LE(p + 8)
+      });
+  }
+
+  // Deviation record (MPXCapture DEVIATION HISTOGRAM): true-peak percentiles,
+  // time over DeviationLimit and overdeviation events per rolling window
+  function handleMpxDeviation(d) {
+      if (!d || typeof d !== "object" || (d.src || 0) !== MPX_SOURCE_ID) return;
+      latestMpxDeviation = d;
+  }
+
+  const MPX_DEV_WINDOWS = ["1m", "1h", "24h"];
+  const MPX_DEV_PERCENTILES = ["p50", "p90", "p99", "p999", "p9999"];
+
+  function handleBinaryDeviation(buf, off, headerBytes, payloadBytes) {
+      const p = off + headerBytes;
+      if (payloadBytes < 8) return;
+      const nWin = Math.min(buf[p + 4], MPX_DEV_WINDOWS.length);
+      const nPct = buf[p + 5];
+      const winBytes = 4 * (nPct + 4);
+      if (payloadBytes < 8 + nWin * winBytes) return;
+      const d = { src: buf[off + 43], limit: round4(buf.readFloatLE(p)) };
+      for (let w = 0; w < nWin; w++) {
+          const q = p + 8 + w * winBytes;
+          const win = { s: round4(buf.readFloatLE(q)) };
+          for (let k = 0; k < nPct; k++) {
+              win[MPX_DEV_PERCENTILES[k] || `p${k}`] = round4(buf.readFloatLE(q + 4 + 4 * k));
+          }
+          const r = q + 4 + 4 * nPct;
+          win.max = round4(buf.readFloatLE(r));
+          win.over = round4(buf.readFloatLE(r + 4));
+          win.events = buf.readUInt32LE(r + 8);
+          d[MPX_DEV_WINDOWS[w]] = win;
+      }
+      handleMpxDeviation(d);
+  }
+
+  // Zoom record (MPXCapture ZOOM SPECTRUM): fine-resolution spectrum of one
+  // ZoomSpectrum window, dB relative to 1 kHz deviation from f0 in df steps
+  function handleMpxZoom(z) {
+      if (!z || typeof z !== "object" || (z.src || 0) !== MPX_SOURCE_ID || !Array.isArray(z.db)) return;
+      if (!latestMpxZoom) latestMpxZoom = {};
+      latestMpxZoom[z.id || 0] = z;
+  }
+
+  function handleBinaryZoom(buf, off, headerBytes, payloadBytes) {
+      const bins = buf.readUInt16LE(off + 40);
+      const p = off + headerBytes;
+      if (bins === 0 || headerBytes < MPX_FRAME_MIN_HEADER || payloadBytes < 4 * bins) return;
+      const db = new Array(bins);
+      for (let k = 0; k < bins; k++) db[k] = round4(buf.readFloatLE(p + 4 * k));
+      handleMpxZoom({
+          src: buf[off + 43],
+          id: buf[off + 44],
+          seq: buf.readUInt32LE(off + 12),
+          fc: round4(buf.readFloatLE(off + 24)),
+          span: round4(buf.readFloatLE(off + 28)),
+          df: round4(buf.readFloatLE(off + 32)),
+          f0: round4(buf.readFloatLE(off + 36)),
+          ffts: buf.readUInt32LE(off + 48),
+          bins,
+          db
+      });
+  }
+
+  function handleBinaryStats(buf, off, headerBytes, payloadBytes) {
+      const p = off + headerBytes;
+      if (payloadBytes < 44) return;
+      const nStages = Math.min(buf[p + 40], (payloadBytes - 44) >> 2);
+      const stage = {};
+      for (let k = 0; k < nStages; k++) {
+          stage[MPX_STAGE_NAMES[k] || `stage${k}`] = round4(buf.readFloatLE(p + 44 + 4 * k));
+      }
+      handleMpxStats({
+          src: buf[off + 43],
+          t: round4(buf.readFloatLE(p)),
+          wall: round4(buf.readFloatLE(p + 4)),
+          rt: round4(buf.readFloatLE(p + 8)),
+          read: round4(buf.readFloatLE(p + 12)),
+          write: round4(buf.readFloatLE(p + 16)),
+          stage,
+          frames: buf.readUInt32LE(p + 20),
+          dropIn: buf.readUInt32LE(p + 24),
+          dropBlk: buf.readUInt32LE(p + 28),
+          late: buf.readUInt32LE(p + 32),
+          cfg: buf.readUInt32LE(p + 36)
+      });
+  }
+
+  function handleBinaryHistory(buf, off, headerBytes, payloadBytes) {
+      const rows = buf.readUInt32LE(off + 24);
+      const bins = buf.readUInt16LE(off + 40);
+      const p = off + headerBytes;
+      if (bins === 0 || payloadBytes < (rows + 2) * bins) return;
+      const data = p + rows * bins;
+      handleMpxHistory({
+          src: buf[off + 43],
+          seq: buf.readUInt32LE(off + 12),
+          full: buf[off + 28],
+          rows,
+          bins,
+          sc: MPX_BIN_SCALE_NAMES[buf[off + 52]] || "linear",
+          fl: round4(buf.readFloatLE(off + 56)),
+          fh: round4(buf.readFloatLE(off + 60)),
+          dbMin: buf.readFloatLE(off + 44),
+          dbMax: buf.readFloatLE(off + 48),
+          data: buf.toString("base64", p, data),
+          max: buf.toString("base64", data, data + bins),
+          min: buf.toString("base64", data + bins, data + 2 * bins)
+      });
+  }
+
+  // f32View: optional Float32Array over the payload of a 116-byte header frame
+  // (shared-memory slots)
+  function handleBinaryFrame(buf, off, headerBytes, payloadBytes, f32View) {
+      if (buf[off + 5] === MPX_FRAME_TYPE_STATS) return handleBinaryStats(buf, off, headerBytes, payloadBytes);
+      if (buf[off + 5] === MPX_FRAME_TYPE_HISTORY) return handleBinaryHistory(buf, off, headerBytes, payloadBytes);
+      if (buf[off + 5] === MPX_FRAME_TYPE_RDS) return handleBinaryRds(buf, off, headerBytes, payloadBytes);
+      if (buf[off + 5] === MPX_FRAME_TYPE_DEVIATION) return handleBinaryDeviation(buf, off, headerBytes, payloadBytes);
+      if (buf[off + 5] === MPX_FRAME_TYPE_ZOOM) return handleBinaryZoom(buf, off, headerBytes, payloadBytes);
+      if (buf[off + 5] !== MPX_FRAME_TYPE_SPECTRUM || headerBytes < MPX_FRAME_MIN_HEADER) return;
+      if (buf[off + 43] !== MPX_SOURCE_ID) return;
+
+      currentPilotPeak = buf.readFloatLE(off + 24);
+      currentRdsPeak = buf.readFloatLE(off + 28);
+      currentMaxPeak = buf.readFloatLE(off + 32);
+      currentBs412 = round4(buf.readFloatLE(off + 36));
+      if (headerBytes >= MPX_FRAME_BS412_HEADER) {
+          currentBs412Max10 = round4(buf.readFloatLE(off + 64));
+          currentBs412Max60 = round4(buf.readFloatLE(off + 68));
+      }
+      const stereoFlags = (headerBytes >= MPX_FRAME_STEREO_HEADER) ? buf[off + 54] : 0;
+      currentStereo = (stereoFlags & 1) ? {
+          st: (stereoFlags & 2) ? 1 : 0,
+          l: round4(buf.readFloatLE(off + 72)),
+          r: round4(buf.readFloatLE(off + 76)),
+          m: round4(buf.readFloatLE(off + 80)),
+          s: round4(buf.readFloatLE(off + 84)),
+          sep: round4(buf.readFloatLE(off + 88)),
+          cor: round4(buf.readFloatLE(off + 92)),
+          c38: round4(buf.readFloatLE(off + 96)),
+          ppm: round4(buf.readFloatLE(off + 100))
+      } : null;
+      if (headerBytes >= MPX_FRAME_NOISE_HEADER && buf.readFloatLE(off + 104) > 0) {
+          currentNoiseFloor = round4(buf.readFloatLE(off + 104));
+          currentPilotSnr = round4(buf.readFloatLE(off + 108));
+          currentRdsSnr = round4(buf.readFloatLE(off + 112));
+      }
+      mpxFrameSeq++;
+
+      const bins = buf.readUInt16LE(off + 40);
+      const encoding = buf[off + 42];
+      const p = off + headerBytes;
+      if (bins === 0) return;
+
+      if (mpxSpectrumArray.length !== bins) mpxSpectrumArray = new Array(bins);
+      const out = mpxSpectrumArray;
+
+      if (encoding === 0 && f32View && f32View.length >= bins && headerBytes === MPX_FRAME_NOISE_HEADER) {
+          for (let k = 0; k < bins; k++) out[k] = round4(f32View[k]);
+      } else if (encoding === 0 && payloadBytes >= bins * 4) {
+          for (let k = 0; k < bins; k++) out[k] = round4(buf.readFloatLE(p + 4 * k));
+      } else if (encoding === 1 && payloadBytes >= bins * 2) {
+          const t = getDequantTable(65536, buf.readFloatLE(off + 44), buf.readFloatLE(off + 48));
+          for (let k = 0; k < bins; k++) out[k] = t[buf.readUInt16LE(p + 2 * k)];
+      } else if (encoding === 2 && payloadBytes >= bins) {
+          const t = getDequantTable(256, buf.readFloatLE(off + 44), buf.readFloatLE(off + 48));
+          for (let k = 0; k < bins; k++) out[k] = t[buf[p + k]];
+      } else {
+          return;
+      }
+      latestMpxFrame = out;
+
+      const scale = (headerBytes >= MPX_FRAME_SCALE_HEADER) ? buf[off + 52] : 0;
+      latestMpxScale = (scale > 0 && scale < MPX_BIN_SCALE_NAMES.length)
+          ? getMpxScale(MPX_BIN_SCALE_NAMES[scale], buf.readFloatLE(off + 56), buf.readFloatLE(off + 60))
+          : null;
+  }
+
+  function setupBinaryReader(childProcess) {
+      if (!childProcess || !childProcess.stdout) return;
+
+      let pending = null;
+      // Largest payload MPXCapture writes; anything above is a false magic
+      // match inside payload data
+      const maxPayload = Math.max(4 * Math.max(FFT_SIZE, MPX_MAX_FFT), MPX_HISTORY_MAX_PAYLOAD);
+
+      childProcess.stdout.on('data', (chunk) => {
+          let buf = pending ? Buffer.concat([pending, chunk]) : chunk;
+          let off = 0;
+
+          while (buf.length - off >= 12) {
+              if (buf.readUInt32LE(off) !== MPX_FRAME_MAGIC) {
+                  // Lost sync: skip to the next magic
+                  const next = buf.indexOf(MPX_FRAME_MAGIC_BYTES, off + 1);
+                  if (next < 0) { off = buf.length - 3; break; }
+                  off = next;
+                  continue;
+              }
+              const headerBytes = buf.readUInt16LE(off + 6);
+              const payloadBytes = buf.readUInt32LE(off + 8);
+              if (headerBytes < 12 || headerBytes > MPX_FRAME_MAX_HEADER || payloadBytes > maxPayload) {
+                  off += 1;
+                  continue;
+              }
+              const total = headerBytes + payloadBytes;
+              if (buf.length - off < total) break;
+
+              try { handleBinaryFrame(buf, off, headerBytes, payloadBytes); } catch (e) { }
+              off += total;
+          }
+
+          pending = (off < buf.length) ? buf.subarray(off) : null;
+      });
+  }
+
+  // ====================================================================================
+  //  SHARED-MEMORY READER (MPXOutputFormat: shm)
+  //  Ring layout is documented in MPXCapture.c (SHARED-MEMORY OUTPUT). The
+  //  broadcast tick copies the newest complete frame into preallocated
+  //  buffers; stdout only carries a heartbeat byte, stats, history and RDS records.
+  // ====================================================================================
+
+  const MPX_SHM_MAGIC = 0x5358504D; // "MPXS"
+  const MPX_SHM_SLOT_PREFIX = 8;
+  const MPX_SHM_PAYLOAD = MPX_SHM_SLOT_PREFIX + MPX_FRAME_NOISE_HEADER;    // slot prefix + frame header
+  const MPX_SHM_PATH = `/dev/shm/metricsmonitor-mpx-${process.pid}`;
+
+  let mpxShmEnabled = false;
+  let mpxShm = null;
+
+  function openMpxShm() {
+      let fd;
+      try { fd = fs.openSync(MPX_SHM_PATH, "r"); } catch (e) { return null; }
+
+      const header = Buffer.alloc(128);
+      if (fs.readSync(fd, header, 0, 128, 0) < 128 || header.readUInt32LE(0) !== MPX_SHM_MAGIC) {
+          fs.closeSync(fd);
+          return null;
+      }
+      const slotBytes = header.readUInt32LE(8);
+      const maxBins = header.readUInt32LE(16);
+      // Own ArrayBuffer so the payload view is 4-byte aligned
+      const slot = Buffer.from(new ArrayBuffer(slotBytes));
+      return {
+          fd,
+          header,
+          slot,
+          slotBytes,
+          headerBytes: header.readUInt16LE(6),
+          slots: header.readUInt32LE(12),
+          sources: header[5],
+          spectrum: new Float32Array(slot.buffer, MPX_SHM_PAYLOAD, maxBins),
+          lastWritten: 0
+      };
+  }
+
+  function closeMpxShm() {
+      if (!mpxShm) return;
+      try { fs.closeSync(mpxShm.fd); } catch (e) { }
+      mpxShm = null;
+  }
+
+  function readMpxShm() {
+      if (!mpxShmEnabled) return;
+      if (!mpxShm && !(mpxShm = openMpxShm())) return;
+
+      const s = mpxShm;
+      if (MPX_SOURCE_ID >= s.sources) return;
+      try {
+          fs.readSync(s.fd, s.header, 0, 64 + 4 * s.sources, 0);
+          const written = s.header.readUInt32LE(64 + 4 * MPX_SOURCE_ID);
+          if (written === s.lastWritten) return;
+
+          // Newest frame; if it is being rewritten, the one before
+          for (let back = 1; back <= 2 && back <= written; back++) {
+              const n = written - back;
+              const pos = s.headerBytes + (MPX_SOURCE_ID * s.slots + (n % s.slots)) * s.slotBytes;
+              fs.readSync(s.fd, s.slot, 0, s.slotBytes, pos);
+
+              const lead = s.slot.readUInt32LE(0);
+              if (lead !== s.slot.readUInt32LE(s.slotBytes - 4) || (lead & 1)) continue;
+
+              const off = MPX_SHM_SLOT_PREFIX;
+              handleBinaryFrame(s.slot, off, s.slot.readUInt16LE(off + 6), s.slot.readUInt32LE(off + 8), s.spectrum);
+              s.lastWritten = written;
+              return;
+          }
+      } catch (e) {
+          closeMpxShm();
+      }
+  }
+
+  function setupShmReader(childProcess) {
+      if (!childProcess || !childProcess.stdout) return;
+      mpxShmEnabled = true;
+      let jsonFallback = false;
+      const rl = readline.createInterface({ input: childProcess.stdout, crlfDelay: Infinity });
       rl.on('line', (line) => {
+          if (jsonFallback) { handleMpxJsonLine(line); return; }
+          if (!line.startsWith('{')) return;   // heartbeat
           try {
-              const trimmed = line.trim();
-              if (!trimmed.startsWith('{')) return;
-              
-              const data = JSON.parse(trimmed);
-              
-              if (typeof data.p === 'number') currentPilotPeak = data.p;
-              if (typeof data.r === 'number') currentRdsPeak = data.r;
-              if (typeof data.m === 'number') currentMaxPeak = data.m;
-              
-              if (Array.isArray(data.s) && data.s.length > 0) {
-                  latestMpxFrame = data.s;
+              const data = JSON.parse(line);
+              if (data.stats) handleMpxStats(data.stats);
+              else if (data.hist) handleMpxHistory(data.hist);
+              else if (data.rds) handleMpxRds(data.rds);
+              else if (data.dev) handleMpxDeviation(data.dev);
+              else if (data.zoom) handleMpxZoom(data.zoom);
+              else if (Array.isArray(data.s)) {
+                  // Full frames on stdout: this build never creates the segment
+                  logWarn("[MPX] MPXCapture writes JSON frames instead of the shm ring, reading those.");
+                  jsonFallback = true;
+                  mpxShmEnabled = false;
+                  handleMpxJsonLine(line);
               }
-
           } catch (e) { }
       });
+      childProcess.on('close', () => {
+          mpxShmEnabled = false;
+          closeMpxShm();
+          // MPXCapture removes the file itself unless it was killed
+          try { fs.unlinkSync(MPX_SHM_PATH); } catch (e) { }
+      });
+  }
+
+  // ====================================================================================
+  //  SPECTRUM HISTORY (waterfall rows, max/min hold)
+  //  Kept by MPXCapture (SpectrumHistoryRows, see MPXCapture.c SPECTRUM HISTORY).
+  //  New rows ride along with the next broadcast as "history"; a client that
+  //  connects sends { type: "MPX-history-request" } and the whole ring goes out
+  //  once as an "MPX-history" message. Requests and hold resets reach
+  //  MPXCapture over its control socket (Linux only).
+  // ====================================================================================
+
+  const MPX_CONTROL_PATH = `/tmp/metricsmonitor-mpx-${process.pid}.sock`;
+  const MPX_HISTORY_MAX_PENDING = 32;        // rows kept if broadcasts stall
+  const MPX_HISTORY_REQUEST_GAP_MS = 1000;   // one full history per second is enough for everyone
+
+  let mpxControlEnabled = false;
+  let pendingMpxHistory = [];
+  let lastMpxHistoryRequest = 0;
+  let mpxHistoryRequestTimer = null;
+
+  function handleMpxHistory(h) {
+      if (!h || typeof h !== "object" || (h.src || 0) !== MPX_SOURCE_ID) return;
+      if (h.full) {
+          // Broadcast at once: every client that is waiting gets the same ring
+          if (hasMpxConsumers()) sendMpxEncoded(encodeMpxMessage({ type: "MPX-history", ...h }), false);
+          return;
+      }
+      if (pendingMpxHistory.length >= MPX_HISTORY_MAX_PENDING) pendingMpxHistory.shift();
+      pendingMpxHistory.push(h);
+  }
+
+  function sendMpxControl(cmd) {
+      if (!mpxControlEnabled) return;
+      const sock = net.createConnection(MPX_CONTROL_PATH);
+      sock.on("error", () => {});
+      sock.setTimeout(2000, () => sock.destroy());
+      sock.end(cmd + "\n");
+  }
+
+  // Messages from browsers on /data_plugins (other plugins' traffic is ignored)
+  function handleMpxClientMessage(data) {
+      if (!data || data.length > 256) return;
+      let msg;
+      try { msg = JSON.parse(data.toString()); } catch (e) { return; }
+      if (!msg || typeof msg.type !== "string") return;
+
+      if (msg.type === "MPX-history-request") {
+          // Requests arriving inside the gap share one deferred dump
+          if (mpxHistoryRequestTimer) return;
+          const wait = lastMpxHistoryRequest + MPX_HISTORY_REQUEST_GAP_MS - Date.now();
+          mpxHistoryRequestTimer = setTimeout(() => {
+              mpxHistoryRequestTimer = null;
+              lastMpxHistoryRequest = Date.now();
+              sendMpxControl("history");
+          }, Math.max(0, wait));
+      } else if (msg.type === "MPX-hold-reset") {
+          sendMpxControl("reset-hold");
+      } else if (msg.type === "MPX-archive-request") {
+          handleMpxArchiveRequest(msg);
+      }
+  }
+
+  // ====================================================================================
+  //  METRICS ARCHIVE (per-second / per-minute p, r, m, b, noise floor)
+  //  Written by MPXCapture (--archive, see MPXCapture.c METRICS ARCHIVE) when
+  //  MPXArchiveDays > 0. A client sends
+  //    { type: "MPX-archive-request", id, from, to, points }
+  //  (Unix seconds) and gets { type: "MPX-archive", id, from, to, step, t,
+  //  p, r, m, b, nf } with min / max / mean arrays per metric, at most
+  //  `points` buckets of `step` seconds. Ranges up to
+  //  MPX_ARCHIVE_SECOND_SPAN use the 1 s records if they reach back far
+  //  enough (or as far as the 1 min ones), longer ones the 1 min records.
+  //  The start is found by binary search over the record times, then the
+  //  range is read in one go; all file access is asynchronous and one
+  //  request runs at a time.
+  // ====================================================================================
+
+  const MPX_ARCHIVE_PATH = path.join(path.dirname(configFilePath), "metricsmonitor-archive.bin");
+  const MPX_ARCHIVE_MAGIC = 0x4158504D;      // "MPXA"
+  const MPX_ARCHIVE_METRICS = ["p", "r", "m", "b", "nf"];
+  const MPX_ARCHIVE_SECOND_SPAN = 6 * 3600;
+  const MPX_ARCHIVE_MAX_RECORDS = 200000;    // per request (~14 MB), newest kept
+  const MPX_ARCHIVE_MAX_POINTS = 2000;
+  const MPX_ARCHIVE_MAX_PENDING = 4;
+
+  let mpxArchiveQueue = Promise.resolve();
+  let mpxArchivePending = 0;
+
+  async function readArchiveTiers(fh) {
+      const h = Buffer.alloc(64);
+      await fh.read(h, 0, 64, 0);
+      if (h.readUInt32LE(0) !== MPX_ARCHIVE_MAGIC || h[4] !== 1) return null;
+      const recordBytes = h.readUInt32LE(8);
+      const tiers = [];
+      for (let t = 0; t < h[5] && 16 + 24 * t + 24 <= 64; t++) {
+          const o = 16 + 24 * t;
+          const capacity = h.readUInt32LE(o + 4);
+          const written = h.readUInt32LE(o + 8);
+          // The slot being overwritten is never read
+          const count = Math.min(written, capacity - 1);
+          tiers.push({
+              interval: h.readUInt32LE(o),
+              capacity,
+              first: written - count,
+              count,
+              offset: h.readUInt32LE(o + 16) + h.readUInt32LE(o + 20) * 4294967296,
+              recordBytes
+          });
+      }
+      return tiers;
+  }
+
+  function archiveRecordPos(tier, i) {
+      return tier.offset + ((tier.first + i) % tier.capacity) * tier.recordBytes;
+  }
+
+  async function archiveTimeAt(fh, tier, i) {
+      const b = Buffer.alloc(4);
+      await fh.read(b, 0, 4, archiveRecordPos(tier, i));
+      return b.readUInt32LE(0);
+  }
+
+  // First record index with time >= t (times never decrease)
+  async function archiveLowerBound(fh, tier, t) {
+      let lo = 0, hi = tier.count;
+      while (lo < hi) {
+          const mid = (lo + hi) >> 1;
+          if (await archiveTimeAt(fh, tier, mid) < t) lo = mid + 1;
+          else hi = mid;
+      }
+      return lo;
+  }
+
+  // Records [i0, i1) in ring order, split where the ring wraps
+  async function readArchiveRecords(fh, tier, i0, i1) {
+      const buf = Buffer.alloc((i1 - i0) * tier.recordBytes);
+      let done = 0;
+      while (i0 + done < i1) {
+          const slot = (tier.first + i0 + done) % tier.capacity;
+          const n = Math.min(i1 - i0 - done, tier.capacity - slot);
+          await fh.read(buf, done * tier.recordBytes, n * tier.recordBytes, tier.offset + slot * tier.recordBytes);
+          done += n;
+      }
+      return buf;
+  }
+
+  async function queryMpxArchive(req) {
+      const fh = await fs.promises.open(MPX_ARCHIVE_PATH, "r");
+      try {
+          const tiers = await readArchiveTiers(fh);
+          if (!tiers || tiers.length < 2) return null;
+
+          const now = Math.floor(Date.now() / 1000);
+          const to = Number.isFinite(req.to) ? Math.floor(req.to) : now;
+          const from = Number.isFinite(req.from) ? Math.floor(req.from) : to - 3600;
+          if (!(to > from)) return null;
+          const points = Math.max(1, Math.min(MPX_ARCHIVE_MAX_POINTS, Math.floor(Number(req.points) || 600)));
+
+          // The 1 s records unless the 1 min records reach further back
+          let tier = tiers[1];
+          if (to - from <= MPX_ARCHIVE_SECOND_SPAN && tiers[0].count > 0) {
+              // (minute records start on the minute, before their first second)
+              const minuteStart = tiers[1].count > 0 ? await archiveTimeAt(fh, tiers[1], 0) + tiers[1].interval : Infinity;
+              if (await archiveTimeAt(fh, tiers[0], 0) <= Math.max(from, minuteStart)) tier = tiers[0];
+          }
+          const i1 = await archiveLowerBound(fh, tier, to + 1);
+          let i0 = await archiveLowerBound(fh, tier, from);
+          if (i1 - i0 > MPX_ARCHIVE_MAX_RECORDS) i0 = i1 - MPX_ARCHIVE_MAX_RECORDS;
+          const buf = await readArchiveRecords(fh, tier, i0, i1);
+
+          // Buckets of `step` seconds: min of min, max of max, mean weighted by readings
+          const step = Math.max(tier.interval, Math.ceil((to - from) / points));
+          const nb = Math.ceil((to - from + 1) / step);
+          const acc = MPX_ARCHIVE_METRICS.map(() => ({
+              min: new Array(nb).fill(Infinity), max: new Array(nb).fill(-Infinity),
+              sum: new Array(nb).fill(0), n: new Array(nb).fill(0)
+          }));
+          for (let o = 0; o < buf.length; o += tier.recordBytes) {
+              const k = Math.floor((buf.readUInt32LE(o) - from) / step);
+              if (k < 0 || k >= nb) continue;
+              const readings = buf.readUInt16LE(o + 4);
+              for (let j = 0; j < MPX_ARCHIVE_METRICS.length; j++) {
+                  if (j === 4 && !(buf[o + 6] & 1)) continue;   // no noise floor estimate
+                  const q = o + 8 + 12 * j, a = acc[j];
+                  a.min[k] = Math.min(a.min[k], buf.readFloatLE(q));
+                  a.max[k] = Math.max(a.max[k], buf.readFloatLE(q + 4));
+                  a.sum[k] += buf.readFloatLE(q + 8) * readings;
+                  a.n[k] += readings;
+              }
+          }
+
+          // Empty buckets are dropped (gaps while MPXCapture was not running)
+          const used = [];
+          for (let k = 0; k < nb; k++) if (acc[0].n[k] > 0) used.push(k);
+          const msg = { type: "MPX-archive", id: req.id, from, to, step, t: used.map((k) => from + k * step) };
+          MPX_ARCHIVE_METRICS.forEach((name, j) => {
+              const a = acc[j];
+              const pick = (arr) => used.map((k) => (a.n[k] > 0 ? round4(arr[k]) : null));
+              msg[name] = { min: pick(a.min), max: pick(a.max), mean: used.map((k) => (a.n[k] > 0 ? round4(a.sum[k] / a.n[k]) : null)) };
+          });
+          return msg;
+      } finally {
+          await fh.close();
+      }
+  }
+
+  function handleMpxArchiveRequest(req) {
+      if (MPX_ARCHIVE_DAYS <= 0 || mpxArchivePending >= MPX_ARCHIVE_MAX_PENDING) return;
+      mpxArchivePending++;
+      mpxArchiveQueue = mpxArchiveQueue
+          .then(() => queryMpxArchive(req))
+          .then((msg) => {
+              if (msg && hasMpxConsumers()) sendMpxEncoded(encodeMpxMessage(msg), false);
+          })
+          .catch((e) => {
+              if (ENABLE_EXTENDED_LOGGING) logWarn(`[MPX] Archive query failed: ${e.message}`);
+          })
+          .then(() => { mpxArchivePending--; });
   }
 
   // ====================================================================================
@@ -1317,6 +2076,19 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
       }
   }
 
+  // Features of the installed MPXCapture build ("MPXCapture <version> <feature>..."
+  // from --version), or null for builds from before the option: they read the
+  // empty stdin, print nothing and only take the positional arguments, stdin
+  // float and JSON output.
+  function probeMpxCapture(exePath) {
+      try {
+          const r = spawnSync(exePath, ["--version"], { input: "", timeout: 3000, encoding: "utf8" });
+          const m = /^MPXCapture\s+\S+(.*)$/m.exec(r.stdout || "");
+          if (m) return new Set(m[1].trim().split(/\s+/).filter(Boolean));
+      } catch (e) { }
+      return null;
+  }
+
   // --- STARTUP ---
 
   if (MPX_MODE !== "off" || (MPX_MODE === "off" && MPX_INPUT_CARD !== "") && MPX_EXE_PATH && fs.existsSync(MPX_EXE_PATH)) {
@@ -1327,6 +2099,49 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
 
     logInfo(`[MPX] Starting MPXCapture`);
 
+    // Metrics archive (Linux): MPXCapture writes, the server only reads
+    const mpxArchiveArgs = MPX_ARCHIVE_DAYS > 0 ? [
+        `--archive=${MPX_ARCHIVE_PATH}`,
+        `--archive-days=${MPX_ARCHIVE_DAYS}`,
+        `--archive-second-days=${MPX_ARCHIVE_SECOND_DAYS}`,
+        `--archive-source=${MPX_SOURCE_ID}`
+    ] : [];
+
+    const mpxFeatures = osPlatform !== "win32" ? probeMpxCapture(MPX_EXE_PATH) : null;
+    const mpxHas = (feature) => !!mpxFeatures && mpxFeatures.has(feature);
+    if (osPlatform !== "win32" && !mpxFeatures) {
+        logWarn("[MPX] MPXCapture predates --version: starting it without options (arecord FLOAT_LE, JSON). Rebuild it from code/MPXCapture Linux for the newer settings.");
+    }
+    let mpxOutputFormat = MPX_OUTPUT_FORMAT;
+    if (mpxOutputFormat.startsWith("binary") && !mpxHas("binary")) {
+        logWarn(`[MPX] MPXCapture has no binary output, using json instead of ${mpxOutputFormat}.`);
+        mpxOutputFormat = "json";
+    }
+    if (mpxOutputFormat === "shm" && !mpxHas("shm")) {
+        logWarn("[MPX] MPXCapture has no shared-memory output, using json instead of shm.");
+        mpxOutputFormat = "json";
+    }
+    let mpxInputBackend = MPX_INPUT_BACKEND;
+    if (mpxInputBackend === "alsa" && !mpxHas("alsa")) {
+        logWarn("[MPX] MPXCapture was built without ALSA capture (-DMPX_WITH_ALSA), using the arecord pipe.");
+        mpxInputBackend = "arecord";
+    }
+    // arecord and MPXCapture must agree on the format
+    let mpxSampleFormat = MPX_SAMPLE_FORMAT;
+    if (mpxSampleFormat !== "FLOAT_LE" && !mpxHas("format")) {
+        logWarn(`[MPX] MPXCapture only reads FLOAT_LE, capturing that instead of ${mpxSampleFormat}.`);
+        mpxSampleFormat = "FLOAT_LE";
+    }
+    const mpxOptions = mpxFeatures ? [
+        `--format=${mpxSampleFormat}`,
+        `--channels=${MPX_CHANNELS}`,
+        `--output=${mpxOutputFormat}`,
+        `--shm=${MPX_SHM_PATH}`,
+        `--stats=${Math.round(MPX_STATS_INTERVAL * 1000)}`,
+        `--control=${MPX_CONTROL_PATH}`,
+        ...mpxArchiveArgs
+    ] : [];
+
     /* =====================================================
        WINDOWS: MPXCapture opens Audio itself
        ===================================================== */
@@ -1359,6 +2174,31 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
             }
         );
 
+    /* =====================================================
+       LINUX: MPXCapture captures directly (ALSA mmap)
+       ===================================================== */
+    } else if (mpxInputBackend === "alsa") {
+        const deviceArg = (targetDevice && targetDevice.length > 0) ? targetDevice : "Default";
+
+        logInfo(
+        `[MPX] MPXCapture (ALSA) | Rate=${SAMPLE_RATE}, Dev="${deviceArg}", Format=${mpxSampleFormat}, Config="${configFilePath}", Output=${mpxOutputFormat}`
+        );
+
+        rec = spawn(
+            MPX_EXE_PATH,
+            [
+                String(SAMPLE_RATE),
+                deviceArg,
+                String(FFT_SIZE),
+                configFilePath,
+                "--input=alsa",
+                ...mpxOptions
+            ],
+            {
+                stdio: ["ignore", "pipe", "pipe"]
+            }
+        );
+
     /* =====================================================
        LINUX: arecord -> stdin -> MPXCapture
        ===================================================== */
@@ -1367,14 +2207,14 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
         const deviceArg = (targetDevice && targetDevice.length > 0) ? targetDevice : "Default";
 
         logInfo(
-        `[MPX] arecord -> MPXCapture | Rate=${SAMPLE_RATE}, Dev="${deviceArg}", Config="${configFilePath}"`
+        `[MPX] arecord -> MPXCapture | Rate=${SAMPLE_RATE}, Dev="${deviceArg}", Format=${mpxSampleFormat}, Config="${configFilePath}", Output=${mpxOutputFormat}`
         );
 
         rec = spawn("bash", ["-c", `
     arecord -F 25000 -D "${deviceArg}" \
-    -c2 -r${SAMPLE_RATE} -f FLOAT_LE \
+    -c2 -r${SAMPLE_RATE} -f ${mpxSampleFormat} \
     -t raw -q \
-    | "${MPX_EXE_PATH}" ${SAMPLE_RATE} "Default" ${FFT_SIZE} "${escapedConfigPath}"
+    | "${MPX_EXE_PATH}" ${SAMPLE_RATE} "Default" ${FFT_SIZE} "${escapedConfigPath}" ${mpxOptions.map((a) => `"${a.replace(/"/g, '\\"')}"`).join(" ")}
     `], {
         stdio: ["ignore", "pipe", "pipe"]
         });
@@ -1389,9 +2229,24 @@ if (!ENABLE_MPX && MPX_INPUT_CARD === ""){
     });
 
     /* =====================================================
-       JSON Reader (stdout)
+       JSON / Binary Reader (stdout)
        ===================================================== */
-    setupJsonReader(rec);
+    if (osPlatform !== "win32" && mpxOutputFormat === "shm") {
+        setupShmReader(rec);
+    } else if (osPlatform !== "win32" && mpxOutputFormat !== "json") {
+        setupBinaryReader(rec);
+    } else {
+        setupJsonReader(rec);
+    }
+
+    if (mpxFeatures) {
+        mpxControlEnabled = true;
+        rec.on("close", () => {
+            mpxControlEnabled = false;
+            // MPXCapture removes the socket itself unless it was killed
+            try { fs.unlinkSync(MPX_CONTROL_PATH); } catch (e) { }
+        });
+    }
 
     rec.on("close", (code) => {
         logInfo("[MPX] MPXCapture exited with code:", code);
@@ -1410,19 +2265,13 @@ if (typeof global.mpxPeakState === 'undefined') {
   global.logThrottle = 0;
 }
 
+let lastBroadcastSeq = -1;
+
 setInterval(() => {
-    // 1. Check WebSocket connection
-    if (!dataPluginsWs || dataPluginsWs.readyState !== WebSocket.OPEN) return;
-    
-    // 2. Check Backpressure
-    if (dataPluginsWs.bufferedAmount > MAX_WS_BACKLOG_BYTES) {
-        if (++backpressureHits >= MAX_BACKPRESSURE_HITS) {
-            try { dataPluginsWs.terminate(); } catch {}
-            dataPluginsWs = null;
-        }
-        return;
-    }
-    backpressureHits = 0;
+    // 1. Check WebSocket connections (slow consumers are handled in sendMpxEncoded)
+    if (!hasMpxConsumers()) return;
+
+    readMpxShm();
 
     // -----------------------------------------------------------------------
     // PREPARE DATA
@@ -1503,24 +2352,47 @@ setInterval(() => {
     // -----------------------------------------------------------------------
     // SEND TO CLIENT
     // -----------------------------------------------------------------------
+    // Ticks without a new frame, stats, RDS, deviation, zoom or history record send nothing;
+    // otherwise the message is encoded once for all consumers.
+    const hasExtras = latestMpxStats || latestMpxRds || latestMpxDeviation || latestMpxZoom || pendingMpxHistory.length;
+    if (mpxFrameSeq === lastBroadcastSeq && !hasExtras) return;
+    lastBroadcastSeq = mpxFrameSeq;
+
     let finalSpectrum = [];
     if (latestMpxFrame && latestMpxFrame.length > 0) {
         finalSpectrum = latestMpxFrame;
     }
 
-    const payload = JSON.stringify({
+    const payload = encodeMpxMessage({
       type: "MPX", 
+      seq: mpxFrameSeq,
       value: finalSpectrum,
+      scale: latestMpxScale || undefined,
       peak: out_mpx, 
       pilotKHz: out_pilot, 
       rdsKHz: out_rds,
+      bs412: currentBs412 !== null ? currentBs412 : undefined,
+      bs412Max10: currentBs412Max10 !== null ? currentBs412Max10 : undefined,
+      bs412Max60: currentBs412Max60 !== null ? currentBs412Max60 : undefined,
       pilot: valP, 
       rds: valR, 
       noise: valN, 
-      snr: (valN > 1e-6) ? (valP / valN) : 0
+      snr: currentPilotSnr !== null ? currentPilotSnr : undefined,
+      rdsSnr: currentRdsSnr !== null ? currentRdsSnr : undefined,
+      stereo: currentStereo || undefined,
+      stats: latestMpxStats || undefined,
+      rdsData: latestMpxRds || undefined,
+      deviation: latestMpxDeviation || undefined,
+      zoom: latestMpxZoom ? Object.values(latestMpxZoom) : undefined,
+      history: pendingMpxHistory.length ? pendingMpxHistory : undefined
     });
+    latestMpxStats = null;
+    latestMpxRds = null;
+    latestMpxDeviation = null;
+    latestMpxZoom = null;
+    if (pendingMpxHistory.length) pendingMpxHistory = [];
 
-    dataPluginsWs.send(payload, () => {});
+    sendMpxEncoded(payload, true);
 
 }, SPECTRUM_SEND_INTERVAL);
   